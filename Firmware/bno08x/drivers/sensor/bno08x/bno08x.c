@@ -6,12 +6,14 @@
 
 #define DT_DRV_COMPAT ceva_bno08x
 
+#include <math.h>
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/init.h>
 #include <zephyr/kernel.h>
 #include <zephyr/sys/__assert.h>
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
 
 
 #include "bno08x.h"
@@ -68,28 +70,330 @@ int bno08x_buf_write(const struct device *dev,
 	return cfg->bus_io->write(&cfg->bus, data, length);
 }
 
+static uint8_t bno08x_cal_status(const struct device *dev);
+
+struct bno08x_report {
+	sh2_SensorId_t id;
+	uint32_t interval_us;
+};
+
+/* Reports streamed in each mode */
+static const struct bno08x_report bno08x_fusion_reports[] = {
+	{ SH2_ACCELEROMETER, SAMPLE_INTERVAL_US },
+	{ SH2_MAGNETIC_FIELD_CALIBRATED, SAMPLE_INTERVAL_US },
+	// { SH2_LINEAR_ACCELERATION, SAMPLE_INTERVAL_US },
+	{ SH2_GYROSCOPE_CALIBRATED, SAMPLE_INTERVAL_US },
+	{ SH2_ROTATION_VECTOR, SAMPLE_INTERVAL_US },
+#ifdef CONFIG_BNO08X_MOTION_DETECT
+	{ SH2_STABILITY_CLASSIFIER, CONFIG_BNO08X_STABILITY_INTERVAL_US },
+#endif
+};
+
+#ifdef CONFIG_BNO08X_RAW_MODE
+static const struct bno08x_report bno08x_raw_reports[] = {
+	{ SH2_RAW_ACCELEROMETER, CONFIG_BNO08X_RAW_INTERVAL_US },
+	{ SH2_RAW_GYROSCOPE, CONFIG_BNO08X_RAW_INTERVAL_US },
+	{ SH2_RAW_MAGNETOMETER, CONFIG_BNO08X_RAW_INTERVAL_US },
+#ifdef CONFIG_BNO08X_MOTION_DETECT
+	{ SH2_STABILITY_CLASSIFIER, CONFIG_BNO08X_STABILITY_INTERVAL_US },
+#endif
+};
+#endif
+
+#ifdef CONFIG_BNO08X_MOTION_DETECT
+/* Both are event driven; the interval only sets how often they evaluate */
+static const struct bno08x_report bno08x_idle_reports[] = {
+	{ SH2_STABILITY_DETECTOR, CONFIG_BNO08X_STABILITY_INTERVAL_US },
+	{ SH2_SIGNIFICANT_MOTION, CONFIG_BNO08X_STABILITY_INTERVAL_US },
+};
+#endif
+
+static void bno08x_enable_reports(const struct device *dev, uint8_t mode, bool enable)
+{
+	const struct bno08x_report *reports = bno08x_fusion_reports;
+	size_t count = ARRAY_SIZE(bno08x_fusion_reports);
+
+	switch (mode) {
+#ifdef CONFIG_BNO08X_RAW_MODE
+	case BNO08X_MODE_RAW:
+		reports = bno08x_raw_reports;
+		count = ARRAY_SIZE(bno08x_raw_reports);
+		break;
+#endif
+#ifdef CONFIG_BNO08X_MOTION_DETECT
+	case BNO08X_MODE_IDLE:
+		reports = bno08x_idle_reports;
+		count = ARRAY_SIZE(bno08x_idle_reports);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		enableReport(reports[i].id, enable ? reports[i].interval_us : 0, 0, dev);
+	}
+}
+
+static int bno08x_set_mode(const struct device *dev, int32_t mode)
+{
+	struct bno08x_data *data = dev->data;
+
+	if (mode != BNO08X_MODE_FUSION &&
+	    !(IS_ENABLED(CONFIG_BNO08X_RAW_MODE) && mode == BNO08X_MODE_RAW) &&
+	    !(IS_ENABLED(CONFIG_BNO08X_MOTION_DETECT) && mode == BNO08X_MODE_IDLE)) {
+		return -ENOTSUP;
+	}
+
+	if (mode == data->mode) {
+		return 0;
+	}
+
+#ifdef CONFIG_BNO08X_INIT_ASYNC
+	if (!data->hub_ready) {
+		return -EBUSY;
+	}
+#endif
+
+	bno08x_enable_reports(dev, data->mode, false);
+	data->mode = mode;
+	bno08x_enable_reports(dev, data->mode, true);
+	/* The gap is measured on the old mode's stream */
+	data->recovering = false;
+
+	return 0;
+}
+
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+/* Ring holding the samples of the current mode's main report, as the number
+ * of samples written to it so far and their timestamps
+ */
+static uint32_t bno08x_stream_ring(struct bno08x_data *data, const uint64_t **timestamp_us)
+{
+#ifdef CONFIG_BNO08X_RAW_MODE
+	if (data->mode == BNO08X_MODE_RAW) {
+		*timestamp_us = data->batch.rawGyroscope.timestamp_uS;
+		return data->batch.rawGyroscope.head;
+	}
+#endif
+	*timestamp_us = data->batch.rotationVector.timestamp_uS;
+	return data->batch.rotationVector.head;
+}
+#endif
+
+/* After the hub has reset itself (brown-out, watchdog), bring back the
+ * configuration it lost and measure how long the sample stream stopped for.
+ */
+static void bno08x_recover(const struct device *dev)
+{
+	struct bno08x_data *data = dev->data;
+	uint64_t latest_us;
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+	const uint64_t *timestamp_us;
+	uint32_t head = bno08x_stream_ring(data, &timestamp_us);
+
+	latest_us = head ? timestamp_us[sh2_batchLatest(head)] :
+		    k_ticks_to_us_floor64(k_uptime_ticks());
+#else
+	latest_us = data->quat_timestamp_us;
+#endif
+
+	if (data->hub_reset) {
+		data->hub_reset = false;
+		LOG_WRN("hub reset, restoring its configuration");
+
+		if (data->mode != BNO08X_MODE_IDLE && !data->recovering) {
+			/* The stream stopped after its latest sample */
+			data->recovering = true;
+			data->gap.start_us = latest_us;
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+			data->gap_head = head;
+#endif
+		}
+
+		bno08x_enable_reports(dev, data->mode, true);
+#ifdef CONFIG_BNO08X_GESTURES
+		bno08x_gesture_replay(dev);
+#endif
+#ifdef CONFIG_BNO08X_CALIBRATION
+		bno08x_cal_replay(dev);
+#endif
+		return;
+	}
+
+	if (!data->recovering) {
+		return;
+	}
+
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+	if (head == data->gap_head) {
+		return;
+	}
+	/* Up to the first sample after the reset */
+	latest_us = timestamp_us[data->gap_head & SH2_BATCH_RING_MASK];
+#else
+	if (latest_us == data->gap.start_us) {
+		return;
+	}
+#endif
+
+	data->recovering = false;
+	data->gap.duration_us = (uint32_t)MIN(latest_us - data->gap.start_us, UINT32_MAX);
+	data->gap_valid = true;
+	LOG_WRN("sample stream resumed after %u us", data->gap.duration_us);
+}
+
 static int bno08x_sample_fetch(const struct device *dev, enum sensor_channel chan)
 {
 	// todo maybe allow for enabling only needed reports
 	if (chan != SENSOR_CHAN_ALL) {
 		return -ENOTSUP;
 	}
-	enableReport(SH2_ACCELEROMETER, SAMPLE_INTERVAL_US, 0, dev);
-	enableReport(SH2_MAGNETIC_FIELD_CALIBRATED, SAMPLE_INTERVAL_US, 0, dev);
-	// enableReport(SH2_LINEAR_ACCELERATION, SAMPLE_INTERVAL_US, 0, dev);
-	enableReport(SH2_GYROSCOPE_CALIBRATED, SAMPLE_INTERVAL_US, 0, dev);
-	enableReport(SH2_ROTATION_VECTOR, SAMPLE_INTERVAL_US, 0, dev);
+	struct bno08x_data *data = dev->data;
+
+#ifdef CONFIG_BNO08X_INIT_ASYNC
+	if (!data->hub_ready) {
+		return -EBUSY;
+	}
+#endif
 	LOG_INF("BNO08X sample fetch");
 	sh2_service();
+	bno08x_recover(dev);
+
+#ifdef CONFIG_BNO08X_STATS
+	bno08x_stats_service(dev);
+#endif
+
+#ifdef CONFIG_BNO08X_CALIBRATION
+	bno08x_cal_service(dev, bno08x_cal_status(dev));
+#endif
 
 	return 0;
 }
 
+#define BNO08X_CAL_STATUS_SET(status, sensor, accuracy)				\
+	(((status) & ~(0x3 << BNO08X_CAL_STATUS_##sensor##_POS)) |		\
+	 (((accuracy) & 0x3) << BNO08X_CAL_STATUS_##sensor##_POS))
+
+static uint8_t bno08x_cal_status(const struct device *dev)
+{
+	struct bno08x_data *data = dev->data;
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+	const sh2_BatchSink_t *b = &data->batch;
+	uint8_t status = 0;
+
+	if (b->accelerometer.head) {
+		status = BNO08X_CAL_STATUS_SET(status, ACCEL,
+			b->accelerometer.status[sh2_batchLatest(b->accelerometer.head)]);
+	}
+	if (b->gyroscope.head) {
+		status = BNO08X_CAL_STATUS_SET(status, GYRO,
+			b->gyroscope.status[sh2_batchLatest(b->gyroscope.head)]);
+	}
+	if (b->magneticField.head) {
+		status = BNO08X_CAL_STATUS_SET(status, MAGN,
+			b->magneticField.status[sh2_batchLatest(b->magneticField.head)]);
+	}
+	if (b->rotationVector.head) {
+		status = BNO08X_CAL_STATUS_SET(status, ROTATION_VEC,
+			b->rotationVector.status[sh2_batchLatest(b->rotationVector.head)]);
+	}
+
+	return status;
+#else
+	return data->cal_status;
+#endif
+}
+
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+static void bno08x_latest_vec3(const sh2_Vec3Ring_t *ring, struct sensor_value *val)
+{
+	uint32_t n = sh2_batchLatest(ring->head);
+
+	if (ring->head == 0) {
+		memset(val, 0, 3 * sizeof(*val));
+		return;
+	}
+
+	sensor_value_from_double(&val[0], ring->x[n]);
+	sensor_value_from_double(&val[1], ring->y[n]);
+	sensor_value_from_double(&val[2], ring->z[n]);
+}
+
+static void bno08x_latest_quat(const sh2_QuatRing_t *ring, struct sensor_value *val)
+{
+	uint32_t n = sh2_batchLatest(ring->head);
+
+	if (ring->head == 0) {
+		memset(val, 0, 4 * sizeof(*val));
+		return;
+	}
+
+	sensor_value_from_double(&val[0], ring->i[n]);
+	sensor_value_from_double(&val[1], ring->j[n]);
+	sensor_value_from_double(&val[2], ring->k[n]);
+	sensor_value_from_double(&val[3], ring->real[n]);
+}
+
+/* Single axes come from the same rings as the vector channels, the last
+ * report in data->sensor_value is not kept when batch decoding.
+ */
+static int bno08x_latest_axis(struct bno08x_data *data, enum sensor_channel chan,
+			      struct sensor_value *val)
+{
+	const sh2_QuatRing_t *rv = &data->batch.rotationVector;
+	struct sensor_value v[4];
+
+	switch (chan) {
+	case SENSOR_CHAN_ACCEL_X:
+	case SENSOR_CHAN_ACCEL_Y:
+	case SENSOR_CHAN_ACCEL_Z:
+		bno08x_latest_vec3(&data->batch.accelerometer, v);
+		*val = v[chan - SENSOR_CHAN_ACCEL_X];
+		break;
+	case SENSOR_CHAN_GYRO_X:
+	case SENSOR_CHAN_GYRO_Y:
+	case SENSOR_CHAN_GYRO_Z:
+		bno08x_latest_vec3(&data->batch.gyroscope, v);
+		*val = v[chan - SENSOR_CHAN_GYRO_X];
+		break;
+	case SENSOR_CHAN_MAGN_X:
+	case SENSOR_CHAN_MAGN_Y:
+	case SENSOR_CHAN_MAGN_Z:
+		bno08x_latest_vec3(&data->batch.magneticField, v);
+		*val = v[chan - SENSOR_CHAN_MAGN_X];
+		break;
+	case SENSOR_CHAN_ROTATION_VEC_I:
+	case SENSOR_CHAN_ROTATION_VEC_J:
+	case SENSOR_CHAN_ROTATION_VEC_K:
+	case SENSOR_CHAN_ROTATION_VEC_REAL:
+		bno08x_latest_quat(rv, v);
+		*val = v[chan == SENSOR_CHAN_ROTATION_VEC_REAL ? 3 :
+			 chan - SENSOR_CHAN_ROTATION_VEC_I];
+		break;
+	case SENSOR_CHAN_ROTATION_VEC_ACCURACY:
+		sensor_value_from_double(val, rv->head ?
+					 rv->accuracy[sh2_batchLatest(rv->head)] : 0.0);
+		break;
+	default:
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+#endif
+
 static int bno08x_channel_get(const struct device *dev, enum sensor_channel chan,
 			      struct sensor_value *val)
 {
 	struct bno08x_data *data = dev->data;
 
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+	if (bno08x_latest_axis(data, chan, val) == 0) {
+		return 0;
+	}
+#endif
+
 	switch(chan){
 		case SENSOR_CHAN_ACCEL_X:
 			sensor_value_from_double(val,data->sensor_value.un.linearAcceleration.x);
@@ -104,9 +408,13 @@ static int bno08x_channel_get(const struct device *dev, enum sensor_channel chan
 			// sensor_value_from_double(val,data->sensor_value.un.linearAcceleration.x);
 			// sensor_value_from_double(val+1,data->sensor_value.un.linearAcceleration.y);
 			// sensor_value_from_double(val+2,data->sensor_value.un.linearAcceleration.z);
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+			bno08x_latest_vec3(&data->batch.accelerometer, val);
+#else
 			val[0] = data->accel[0];
 			val[1] = data->accel[1];
 			val[2] = data->accel[2];
+#endif
 			break;
 		case SENSOR_CHAN_GYRO_X:
 			sensor_value_from_double(val,data->sensor_value.un.gyroscope.x);
@@ -121,9 +429,13 @@ static int bno08x_channel_get(const struct device *dev, enum sensor_channel chan
 			// sensor_value_from_double(val,data->sensor_value.un.gyroscope.x);
 			// sensor_value_from_double(val+1,data->sensor_value.un.gyroscope.y);
 			// sensor_value_from_double(val+2,data->sensor_value.un.gyroscope.z);
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+			bno08x_latest_vec3(&data->batch.gyroscope, val);
+#else
 			val[0] = data->gyro[0];
 			val[1] = data->gyro[1];
 			val[2] = data->gyro[2];
+#endif
 			break;
 		case SENSOR_CHAN_MAGN_X:
 			sensor_value_from_double(val,data->sensor_value.un.magneticField.x);
@@ -138,9 +450,13 @@ static int bno08x_channel_get(const struct device *dev, enum sensor_channel chan
 			// sensor_value_from_double(val,data->sensor_value.un.magneticField.x);
 			// sensor_value_from_double(val+1,data->sensor_value.un.magneticField.y);
 			// sensor_value_from_double(val+2,data->sensor_value.un.magneticField.z);
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+			bno08x_latest_vec3(&data->batch.magneticField, val);
+#else
 			val[0] = data->mag[0];
 			val[1] = data->mag[1];
 			val[2] = data->mag[2];
+#endif
 			break;
 		case SENSOR_CHAN_ROTATION_VEC_I:
 			sensor_value_from_double(val,data->sensor_value.un.rotationVector.i);
@@ -160,14 +476,66 @@ static int bno08x_channel_get(const struct device *dev, enum sensor_channel chan
 			// sensor_value_from_double(val+1,data->sensor_value.un.rotationVector.j);
 			// sensor_value_from_double(val+2,data->sensor_value.un.rotationVector.k);
 			// sensor_value_from_double(val+3,data->sensor_value.un.rotationVector.real);
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+			bno08x_latest_quat(&data->batch.rotationVector, val);
+#else
 			val[0] = data->quat[0];
 			val[1] = data->quat[1];
 			val[2] = data->quat[2];
 			val[3] = data->quat[3];
+#endif
 			break;		
 		case SENSOR_CHAN_ROTATION_VEC_ACCURACY:
 			sensor_value_from_double(val,data->sensor_value.un.rotationVector.accuracy);
 			break;
+		case SENSOR_CHAN_CALIBRATION_STATUS:
+			val->val1 = bno08x_cal_status(dev);
+			val->val2 = 0;
+			break;
+		case SENSOR_CHAN_ROTATION_VEC_TIMESTAMP: {
+			uint64_t t_us;
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+			const sh2_QuatRing_t *ring = &data->batch.rotationVector;
+
+			t_us = ring->head ? ring->timestamp_uS[sh2_batchLatest(ring->head)] : 0;
+#else
+			t_us = data->quat_timestamp_us;
+#endif
+			val->val1 = (int32_t)(t_us / USEC_PER_SEC);
+			val->val2 = (int32_t)(t_us % USEC_PER_SEC);
+			break;
+		}
+		case SENSOR_CHAN_STABILITY:
+			val->val1 = data->stability;
+			val->val2 = 0;
+			break;
+#ifdef CONFIG_BNO08X_EULER
+		case SENSOR_CHAN_YPR: {
+			float quat[4], ypr[3];
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+			const sh2_QuatRing_t *ring = &data->batch.rotationVector;
+			uint32_t n = sh2_batchLatest(ring->head);
+
+			if (ring->head == 0) {
+				memset(val, 0, 3 * sizeof(*val));
+				break;
+			}
+			quat[0] = ring->i[n];
+			quat[1] = ring->j[n];
+			quat[2] = ring->k[n];
+			quat[3] = ring->real[n];
+#else
+			for (int n = 0; n < 4; n++) {
+				quat[n] = (float)sensor_value_to_double(&data->quat[n]);
+			}
+#endif
+			bno08x_quat_to_ypr(quat, ypr);
+			for (int n = 0; n < 3; n++) {
+				sensor_value_from_double(&val[n], ypr[n] * (180.0 / M_PI));
+			}
+			break;
+		}
+#endif
 		default:
 			return -ENOTSUP;
 	
@@ -182,7 +550,13 @@ static int bno08x_attr_set(const struct device *dev, enum sensor_channel chan,
 {
 	int ret = -ENOTSUP;
 
-	if ((chan == SENSOR_CHAN_ACCEL_X) || (chan == SENSOR_CHAN_ACCEL_Y)
+	if ((chan == SENSOR_CHAN_ALL) && ((int)attr == SENSOR_ATTR_BNO08X_MODE)) {
+		ret = bno08x_set_mode(dev, val->val1);
+#ifdef CONFIG_BNO08X_GESTURES
+	} else if ((chan == SENSOR_CHAN_ALL) && ((int)attr == SENSOR_ATTR_BNO08X_GESTURES)) {
+		ret = bno08x_gesture_set(dev, val->val1);
+#endif
+	} else if ((chan == SENSOR_CHAN_ACCEL_X) || (chan == SENSOR_CHAN_ACCEL_Y)
 	    || (chan == SENSOR_CHAN_ACCEL_Z)
 	    || (chan == SENSOR_CHAN_ACCEL_XYZ)) {
 		switch (attr) {
@@ -240,6 +614,12 @@ static void sh2_bus_close(sh2_Hal_t *self, const struct device *dev) {
 	return;
 }
 
+/* SH2 host time: kernel uptime in microseconds, wrapping at 32 bits. */
+static inline uint32_t bno08x_time_us(void)
+{
+	return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
 static int sh2_bus_open(sh2_Hal_t *self, const struct device *dev) {
 	bno08x_reset(dev);
 	bno08x_wait_for_int(dev);
@@ -250,6 +630,7 @@ static int sh2_bus_open(sh2_Hal_t *self, const struct device *dev) {
 static int sh2_bus_read(sh2_Hal_t *self, uint8_t *pBuffer, unsigned len,
                        uint32_t *t_us, const struct device *dev) {
 
+	struct bno08x_data *data = dev->data;
 	uint16_t packet_size = 0;
 	int ret;
 	// LOG_ERR("sh2_bus_read");
@@ -260,6 +641,16 @@ static int sh2_bus_read(sh2_Hal_t *self, uint8_t *pBuffer, unsigned len,
 		return 0;
 	}
 
+	/* Timestamp the transfer with the INT edge if we caught it, otherwise
+	 * INT was already asserted and now is the best we have.
+	 */
+	if (data->irq_time_valid) {
+		*t_us = data->irq_time_us;
+		data->irq_time_valid = false;
+	} else {
+		*t_us = bno08x_time_us();
+	}
+
 	ret = bno08x_reg_read(dev, 0x00, pBuffer, 4);
 	if (ret != 0) {
 		LOG_ERR("err getting packet size");
@@ -319,28 +710,36 @@ static int sh2_bus_write(sh2_Hal_t *self, uint8_t *pBuffer, unsigned len, const
 	return len;
 }
 
+static void enableReportDone(void *cookie, int status)
+{
+	if (status != SH2_OK) {
+		LOG_ERR("Error setting sensor %u config: %d", (unsigned int)(uintptr_t)cookie, status);
+	}
+}
+
+/* Queue the config change; sh2_service() sends it between report reads */
 static bool enableReport(sh2_SensorId_t sensorId, uint32_t interval_us,
 							   	   uint32_t sensorSpecific, const struct device *dev) {
-  static sh2_SensorConfig_t config;
+  sh2_SensorConfig_t config;
 
   // These sensor options are disabled or not used in most cases
   config.changeSensitivityEnabled = false;
   config.wakeupEnabled = false;
   config.changeSensitivityRelative = false;
   config.alwaysOnEnabled = false;
+  config.sniffEnabled = false;
   config.changeSensitivity = 0;
   config.batchInterval_us = 0;
   config.sensorSpecific = sensorSpecific;
 
   config.reportInterval_us = interval_us;
 
-  bno08x_wait_for_int(dev);
-  
-  int status = sh2_setSensorConfig(sensorId, &config);
+  int status = sh2_setSensorConfigAsync(sensorId, &config, enableReportDone,
+					(void *)(uintptr_t)sensorId);
   LOG_INF("enableReport: %d", status);
 
   if (status != SH2_OK) {
-	LOG_ERR("Error setting sensor config: %d", status);
+	LOG_ERR("Error queueing sensor config: %d", status);
     return -ENODATA;
   }
 
@@ -368,11 +767,15 @@ static void bno08x_wake(const struct device *dev) {
 }
 
 static void sh2_callback(void *cookie, sh2_AsyncEvent_t *pEvent) {
+	const struct device *dev = cookie;
+	struct bno08x_data *data = dev->data;
+
 	// If we see a reset, set a flag so that sensors will be reconfigured.
 	LOG_INF("sh2_callback %d",pEvent->eventId);
 	// LOG_ERR("sh2_callback %d",pEvent->shtpEvent);
 	if (pEvent->eventId == SH2_RESET) {
 		LOG_ERR("SH2_RESET");
+		data->hub_reset = true;
 	}
 }
 
@@ -415,18 +818,21 @@ static void sh2_sensorHandler(void *cookie, sh2_SensorEvent_t *event,
         sensor_value_from_double(&data->accel[0], decoded.un.accelerometer.x);
         sensor_value_from_double(&data->accel[1], decoded.un.accelerometer.y);
         sensor_value_from_double(&data->accel[2], decoded.un.accelerometer.z);
+        data->cal_status = BNO08X_CAL_STATUS_SET(data->cal_status, ACCEL, decoded.status);
         break;
 
     case SH2_GYROSCOPE_CALIBRATED:
         sensor_value_from_double(&data->gyro[0], decoded.un.gyroscope.x);
         sensor_value_from_double(&data->gyro[1], decoded.un.gyroscope.y);
         sensor_value_from_double(&data->gyro[2], decoded.un.gyroscope.z);
+        data->cal_status = BNO08X_CAL_STATUS_SET(data->cal_status, GYRO, decoded.status);
         break;
 
     case SH2_MAGNETIC_FIELD_CALIBRATED:
         sensor_value_from_double(&data->mag[0], decoded.un.magneticField.x);
         sensor_value_from_double(&data->mag[1], decoded.un.magneticField.y);
         sensor_value_from_double(&data->mag[2], decoded.un.magneticField.z);
+        data->cal_status = BNO08X_CAL_STATUS_SET(data->cal_status, MAGN, decoded.status);
         break;
 
     case SH2_ROTATION_VECTOR:
@@ -435,10 +841,36 @@ static void sh2_sensorHandler(void *cookie, sh2_SensorEvent_t *event,
         sensor_value_from_double(&data->quat[1], decoded.un.rotationVector.j);
         sensor_value_from_double(&data->quat[2], decoded.un.rotationVector.k);
         sensor_value_from_double(&data->quat[3], decoded.un.rotationVector.real);
+        data->quat_timestamp_us = decoded.timestamp;
+        data->cal_status = BNO08X_CAL_STATUS_SET(data->cal_status, ROTATION_VEC, decoded.status);
         // If you need 'accuracy', do something similar with
         // decoded.un.rotationVector.accuracy
         break;
 
+    case SH2_STABILITY_CLASSIFIER:
+        data->stability = decoded.un.stabilityClassifier.classification;
+        break;
+
+    case SH2_STABILITY_DETECTOR:
+        if (decoded.un.stabilityDetector.stability & STABILITY_EXITED) {
+            data->stability = BNO08X_STABILITY_MOTION;
+        }
+        break;
+
+    case SH2_SIGNIFICANT_MOTION:
+        data->stability = BNO08X_STABILITY_MOTION;
+        break;
+
+#ifdef CONFIG_BNO08X_GESTURES
+    case SH2_TAP_DETECTOR:
+    case SH2_SHAKE_DETECTOR:
+    case SH2_FLIP_DETECTOR:
+    case SH2_PICKUP_DETECTOR:
+    case SH2_CIRCLE_DETECTOR:
+        bno08x_gesture_push(dev, &decoded);
+        break;
+#endif
+
     /* handle other sensors you want (Linear Accel, Gravity, etc.) */
 
     default:
@@ -448,9 +880,29 @@ static void sh2_sensorHandler(void *cookie, sh2_SensorEvent_t *event,
 }
 
 static uint32_t sh2_getTimeUs(sh2_Hal_t *self) {
-  return k_cyc_to_us_floor32(k_uptime_ticks());
+	return bno08x_time_us();
 }
 
+static void bno08x_irq_handler(const struct device *port, struct gpio_callback *cb,
+			       gpio_port_pins_t pins)
+{
+	struct bno08x_data *data = CONTAINER_OF(cb, struct bno08x_data, irq_cb);
+
+	data->irq_time_us = bno08x_time_us();
+	data->irq_time_valid = true;
+	k_sem_give(&data->irq_sem);
+}
+
+static int bno08x_hub_init(const struct device *dev);
+
+#ifdef CONFIG_BNO08X_INIT_ASYNC
+#define BNO08X_EVT_READY	BIT(0)
+#define BNO08X_EVT_FAILED	BIT(1)
+
+static K_KERNEL_STACK_DEFINE(bno08x_init_stack, CONFIG_BNO08X_INIT_THREAD_STACK_SIZE);
+static void bno08x_init_thread(void *p1, void *p2, void *p3);
+#endif
+
 static int bno08x_init(const struct device *dev)
 {
 	int ret;
@@ -463,8 +915,6 @@ static int bno08x_init(const struct device *dev)
     sh2_HAL.write = sh2_bus_write;
     sh2_HAL.getTimeUs = sh2_getTimeUs;
 
-    int err;
-
 	LOG_INF("BNO08X init");
 
 	ret = bno08x_bus_check(dev);
@@ -498,6 +948,18 @@ static int bno08x_init(const struct device *dev)
 	if (ret) {
 		return ret;
 	}
+
+	k_sem_init(&data->irq_sem, 0, 1);
+	gpio_init_callback(&data->irq_cb, bno08x_irq_handler, BIT(cfg->irq.pin));
+	ret = gpio_add_callback(cfg->irq.port, &data->irq_cb);
+	if (ret) {
+		return ret;
+	}
+
+	ret = gpio_pin_interrupt_configure_dt(&cfg->irq, GPIO_INT_EDGE_TO_ACTIVE);
+	if (ret) {
+		return ret;
+	}
 	
 	ret = gpio_pin_configure_dt(&cfg->wake, GPIO_OUTPUT_HIGH);
 	if (ret) {
@@ -509,6 +971,36 @@ static int bno08x_init(const struct device *dev)
 		return ret;
 	}
 
+#if defined(CONFIG_BNO08X_CALIBRATION_SETTINGS) || defined(CONFIG_BNO08X_METADATA_SETTINGS)
+	/* Here rather than on the hub thread so it cannot race Bluetooth's */
+	ret = settings_subsys_init();
+	if (ret) {
+		LOG_ERR("settings init failed: %d", ret);
+	}
+#endif
+
+#ifdef CONFIG_BNO08X_INIT_ASYNC
+	k_event_init(&data->ready);
+	k_thread_create(&data->init_thread, bno08x_init_stack,
+			K_KERNEL_STACK_SIZEOF(bno08x_init_stack),
+			bno08x_init_thread, (void *)dev, NULL, NULL,
+			CONFIG_BNO08X_INIT_THREAD_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&data->init_thread, "bno08x_init");
+	return 0;
+#else
+	return bno08x_hub_init(dev);
+#endif
+}
+
+/* Reset the hub, open SH2 and enable the reports. Takes a few hundred
+ * milliseconds, mostly waiting for the hub to come out of reset.
+ */
+static int bno08x_hub_init(const struct device *dev)
+{
+	struct bno08x_data *data = dev->data;
+	int ret = 0;
+	int err;
+
     bno08x_reset(dev);
 	// bno08x_wait_for_int(dev);
 
@@ -517,7 +1009,7 @@ static int bno08x_init(const struct device *dev)
 		service once to get initial data.
 	*/
 	LOG_INF("sh2_open");
-    err = sh2_open(&sh2_HAL, sh2_callback, NULL, dev);
+    err = sh2_open(&sh2_HAL, sh2_callback, (void *)dev, dev);
     if (err != SH2_OK) {
         LOG_ERR("Cannot open SH2 dev: %d", err);
         return -ENODEV;
@@ -532,18 +1024,205 @@ static int bno08x_init(const struct device *dev)
         return -ENODEV;
     }
 
+#ifdef CONFIG_BNO08X_METADATA
+	/* Before any reports arrive, so they decode with the hub's Q points */
+	if (bno08x_meta_init(dev) != 0) {
+		LOG_ERR("Sensor metadata not available, using default Q points");
+	}
+#endif
+
+#ifdef CONFIG_BNO08X_STATS
+	if (bno08x_stats_init(dev) != 0) {
+		LOG_ERR("Transport statistics not available");
+	}
+#endif
+
+#ifdef CONFIG_BNO08X_CALIBRATION
+	if (bno08x_cal_init(dev) != 0) {
+		LOG_ERR("Calibration persistence not available");
+	}
+#endif
+
+#ifdef CONFIG_BNO08X_BENCHMARK
+	bno08x_bench_run(dev);
+#endif
+
     sh2_setSensorCallback(sh2_sensorHandler, NULL, dev);
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+	sh2_setBatchSink(&data->batch);
+#endif
 
-	enableReport(SH2_ROTATION_VECTOR, SAMPLE_INTERVAL_US, 0, dev);
-	enableReport(SH2_ACCELEROMETER, SAMPLE_INTERVAL_US, 0, dev);
-	enableReport(SH2_GYROSCOPE_CALIBRATED, SAMPLE_INTERVAL_US, 0, dev);
-	enableReport(SH2_MAGNETIC_FIELD_CALIBRATED, SAMPLE_INTERVAL_US, 0, dev);
+	/* Resets up to here were part of bring-up */
+	data->hub_reset = false;
+	bno08x_enable_reports(dev, data->mode, true);
 
 
 	LOG_INF("BNO08X init done");
 	return ret;
 }
 
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+static void bno08x_latest_floats(const sh2_Vec3Ring_t *ring, float *out)
+{
+	uint32_t n = sh2_batchLatest(ring->head);
+
+	out[0] = ring->head ? ring->x[n] : 0.0f;
+	out[1] = ring->head ? ring->y[n] : 0.0f;
+	out[2] = ring->head ? ring->z[n] : 0.0f;
+}
+#endif
+
+int bno08x_sample_read(const struct device *dev, struct bno08x_sample *samples, int max)
+{
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+	struct bno08x_data *data = dev->data;
+	sh2_QuatRing_t *rv = &data->batch.rotationVector;
+	float accel[3], gyro[3], magn[3];
+	int count = 0;
+
+	bno08x_latest_floats(&data->batch.accelerometer, accel);
+	bno08x_latest_floats(&data->batch.gyroscope, gyro);
+	bno08x_latest_floats(&data->batch.magneticField, magn);
+
+	while (count < max && sh2_batchAvailable(rv->head, rv->tail) > 0) {
+		uint32_t n = rv->tail & SH2_BATCH_RING_MASK;
+		struct bno08x_sample *s = &samples[count++];
+
+		s->timestamp_us = rv->timestamp_uS[n];
+		s->quat[0] = rv->i[n];
+		s->quat[1] = rv->j[n];
+		s->quat[2] = rv->k[n];
+		s->quat[3] = rv->real[n];
+		memcpy(s->accel, accel, sizeof(accel));
+		memcpy(s->gyro, gyro, sizeof(gyro));
+		memcpy(s->magn, magn, sizeof(magn));
+		rv->tail++;
+	}
+
+	return count;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+int bno08x_gap_read(const struct device *dev, struct bno08x_gap *gap)
+{
+	struct bno08x_data *data = dev->data;
+
+	if (!data->gap_valid) {
+		return -ENODATA;
+	}
+
+	*gap = data->gap;
+	data->gap_valid = false;
+	return 0;
+}
+
+int bno08x_sensor_info_get(const struct device *dev, enum bno08x_sensor sensor,
+			   struct bno08x_sensor_info *info)
+{
+#ifdef CONFIG_BNO08X_METADATA
+	struct bno08x_data *data = dev->data;
+
+	if (sensor >= BNO08X_SENSOR_COUNT) {
+		return -EINVAL;
+	}
+
+	if (!data->meta_valid) {
+		return -ENODATA;
+	}
+
+	*info = data->meta[sensor];
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+int bno08x_raw_read(const struct device *dev, struct bno08x_raw_sample *samples, int max)
+{
+#ifdef CONFIG_BNO08X_RAW_MODE
+	struct bno08x_data *data = dev->data;
+	sh2_Vec3Ring_t *gyro = &data->batch.rawGyroscope;
+	const sh2_Vec3Ring_t *accel = &data->batch.rawAccelerometer;
+	const sh2_Vec3Ring_t *magn = &data->batch.rawMagnetometer;
+	uint32_t a = sh2_batchLatest(accel->head);
+	uint32_t m = sh2_batchLatest(magn->head);
+	int count = 0;
+
+	while (count < max && sh2_batchAvailable(gyro->head, gyro->tail) > 0) {
+		uint32_t g = gyro->tail & SH2_BATCH_RING_MASK;
+		struct bno08x_raw_sample *s = &samples[count++];
+
+		s->timestamp_us = gyro->timestamp_uS[g];
+		s->gyro[0] = (int16_t)gyro->x[g];
+		s->gyro[1] = (int16_t)gyro->y[g];
+		s->gyro[2] = (int16_t)gyro->z[g];
+		s->accel[0] = accel->head ? (int16_t)accel->x[a] : 0;
+		s->accel[1] = accel->head ? (int16_t)accel->y[a] : 0;
+		s->accel[2] = accel->head ? (int16_t)accel->z[a] : 0;
+		s->magn[0] = magn->head ? (int16_t)magn->x[m] : 0;
+		s->magn[1] = magn->head ? (int16_t)magn->y[m] : 0;
+		s->magn[2] = magn->head ? (int16_t)magn->z[m] : 0;
+		gyro->tail++;
+	}
+
+	return count;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+#ifdef CONFIG_BNO08X_INIT_ASYNC
+static void bno08x_init_thread(void *p1, void *p2, void *p3)
+{
+	const struct device *dev = p1;
+	struct bno08x_data *data = dev->data;
+
+	data->init_err = bno08x_hub_init(dev);
+	if (data->init_err) {
+		LOG_ERR("Hub bring-up failed: %d", data->init_err);
+		k_event_post(&data->ready, BNO08X_EVT_FAILED);
+		return;
+	}
+
+	data->hub_ready = true;
+	k_event_post(&data->ready, BNO08X_EVT_READY);
+}
+#endif
+
+int bno08x_wait_ready(const struct device *dev, k_timeout_t timeout)
+{
+#ifdef CONFIG_BNO08X_INIT_ASYNC
+	struct bno08x_data *data = dev->data;
+	uint32_t events;
+
+	events = k_event_wait(&data->ready, BNO08X_EVT_READY | BNO08X_EVT_FAILED,
+			      false, timeout);
+	if (events == 0) {
+		return -EAGAIN;
+	}
+
+	return (events & BNO08X_EVT_FAILED) ? data->init_err : 0;
+#else
+	return 0;
+#endif
+}
+
+int bno08x_wait_int(const struct device *dev, k_timeout_t timeout)
+{
+	struct bno08x_data *data = dev->data;
+	const struct bno08x_config *cfg = dev->config;
+
+	/* Edges from earlier transfers are stale; only the line level counts */
+	k_sem_reset(&data->irq_sem);
+	if (gpio_pin_get_dt(&cfg->irq) > 0) {
+		return 0;
+	}
+
+	return k_sem_take(&data->irq_sem, timeout);
+}
+
 static const struct sensor_driver_api bno08x_driver_api = {
 	.sample_fetch = bno08x_sample_fetch,
 	.channel_get = bno08x_channel_get,
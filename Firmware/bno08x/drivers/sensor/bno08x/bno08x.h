@@ -22,6 +22,9 @@
 #include "sh2/sh2.h"
 #include "sh2/sh2_SensorValue.h"
 #include "sh2/sh2_err.h"
+#include "sh2/sh2_batch.h"
+
+#include <drivers/sensor/bno08x.h>
 
 
 #define BNO08X_SET_BITS(reg_data, bitname, data)		  \
@@ -30,17 +33,9 @@
 #define BNO08X_SET_BITS_POS_0(reg_data, bitname, data) \
 	((reg_data & ~(bitname##_MSK)) | (data & bitname##_MSK))
 
-enum bno08x_channel{
- 
-    /** Quaternion */
-    SENSOR_CHAN_ROTATION_VEC_I = SENSOR_CHAN_PRIV_START,
-	SENSOR_CHAN_ROTATION_VEC_J,
-	SENSOR_CHAN_ROTATION_VEC_K,
-	SENSOR_CHAN_ROTATION_VEC_IJKR,
-	SENSOR_CHAN_ROTATION_VEC_REAL,
-	SENSOR_CHAN_ROTATION_VEC_ACCURACY,
- 
-};
+/* Largest FRS record the SH2 layer can transfer, in 32-bit words */
+#define BNO08X_DCD_MAX_WORDS 72
+
 /*
 struct bno08x_data {
 	sh2_SensorValue_t sensor_value;
@@ -61,14 +56,80 @@ struct bno08x_data {
     // For rotation vector, we have 4 components: i, j, k, real
     // Some drivers also store 'accuracy' as a fifth
     struct sensor_value quat[4];
+	uint64_t quat_timestamp_us;
+
+	/* enum bno08x_mode */
+	uint8_t mode;
+
+	/* Packed per-sensor accuracy, see BNO08X_CAL_STATUS_GET() */
+	uint8_t cal_status;
+
+	/* Host time of the last INT assertion, in kernel uptime microseconds */
+	struct gpio_callback irq_cb;
+	uint32_t irq_time_us;
+	bool irq_time_valid;
+	struct k_sem irq_sem;
+
+	/* enum bno08x_stability */
+	uint8_t stability;
+
+	/* Hub reset seen by the SH2 event callback, not handled yet */
+	bool hub_reset;
+	/* Waiting for the first sample after a hub reset */
+	bool recovering;
+	/* gap holds an outage not read yet */
+	bool gap_valid;
+	struct bno08x_gap gap;
+	/* Samples in the stream ring when the hub reset */
+	uint32_t gap_head;
 
-	
     // Could store others if you need them, e.g. raw accel, raw gyro, etc.
 
 	int16_t ax, ay, az, gx, gy, gz;
 	uint8_t acc_range, acc_odr, gyr_odr;
 	uint16_t gyr_range;
 
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+	/* Rings filled by the SH2 batch decoder */
+	sh2_BatchSink_t batch;
+#endif
+
+#ifdef CONFIG_BNO08X_INIT_ASYNC
+	/* Hub bring-up runs on its own thread so it overlaps the rest of boot */
+	struct k_thread init_thread;
+	struct k_event ready;
+	int init_err;
+	bool hub_ready;
+#endif
+
+#ifdef CONFIG_BNO08X_METADATA
+	/* Sensor metadata, by enum bno08x_sensor */
+	struct bno08x_sensor_info meta[BNO08X_SENSOR_COUNT];
+	bool meta_valid;
+#endif
+
+#ifdef CONFIG_BNO08X_STATS
+	/* Uptime of the next hub counts refresh, ms */
+	int64_t stats_next_counts;
+#endif
+
+#ifdef CONFIG_BNO08X_GESTURES
+	/* Enabled detectors, BIT(enum bno08x_gesture) */
+	uint8_t gestures;
+	/* Detected gestures not read yet */
+	struct bno08x_gesture_event gesture_queue[CONFIG_BNO08X_GESTURE_QUEUE_LEN];
+	uint32_t gesture_head;
+	uint32_t gesture_tail;
+#endif
+
+#ifdef CONFIG_BNO08X_CALIBRATION
+	/* Last DCD record mirrored to settings */
+	uint32_t dcd[BNO08X_DCD_MAX_WORDS];
+	uint16_t dcd_words;
+	int64_t dcd_next_save;
+	/* The hub has confirmed a save that is not mirrored yet */
+	bool dcd_saved;
+#endif
 };
 union bno08x_bus {
 #if CONFIG_BNO08X_BUS_SPI
@@ -128,6 +189,33 @@ int bno08x_reg_write_with_delay(const struct device *dev,
 				uint16_t length,
 				uint32_t delay_us);
 
+extern sh2_ProductIds_t productIds;
+
+#ifdef CONFIG_BNO08X_METADATA
+int bno08x_meta_init(const struct device *dev);
+#endif
+
+#ifdef CONFIG_BNO08X_STATS
+int bno08x_stats_init(const struct device *dev);
+void bno08x_stats_service(const struct device *dev);
+#endif
+
+#ifdef CONFIG_BNO08X_GESTURES
+int bno08x_gesture_set(const struct device *dev, int32_t mask);
+void bno08x_gesture_replay(const struct device *dev);
+void bno08x_gesture_push(const struct device *dev, const sh2_SensorValue_t *value);
+#endif
+
+#ifdef CONFIG_BNO08X_CALIBRATION
+int bno08x_cal_init(const struct device *dev);
+void bno08x_cal_service(const struct device *dev, uint8_t cal_status);
+void bno08x_cal_replay(const struct device *dev);
+#endif
+
+#ifdef CONFIG_BNO08X_BENCHMARK
+void bno08x_bench_run(const struct device *dev);
+#endif
+
 #ifdef CONFIG_BNO08X_TRIGGER
 int bno08x_trigger_set(const struct device *dev,
 		       const struct sensor_trigger *trig,
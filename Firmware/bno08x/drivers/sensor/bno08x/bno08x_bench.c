@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Decoder and Euler angle benchmarks, run once during driver init.
+ *
+ * Results go through printk so they are visible regardless of the driver's
+ * log level.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/timing/timing.h>
+
+#include "bno08x.h"
+#include "sh2/sh2_util.h"
+#include "sh2/euler.h"
+
+#define BENCH_SETS_PER_PAYLOAD 20
+#define BENCH_REPORTS_PER_SET  4
+#define BENCH_ITERATIONS       200
+#define BENCH_QUATS            256
+
+/* Base timestamp reference followed by BENCH_SETS_PER_PAYLOAD sets of
+ * rotation vector (14), accelerometer (10), gyroscope (10) and
+ * magnetometer (10) reports, as the hub sends them on the input channel.
+ */
+static uint8_t bench_payload[5 + BENCH_SETS_PER_PAYLOAD * (14 + 10 + 10 + 10)];
+static uint16_t bench_payload_len;
+
+static sh2_BatchSink_t bench_sink;
+static sh2_SensorValue_t bench_value;
+static uint32_t bench_events;
+
+static uint8_t *bench_put_report(uint8_t *p, uint8_t id, uint8_t len, uint8_t seq)
+{
+	memset(p, 0, len);
+	p[0] = id;
+	p[1] = seq;
+	p[2] = 0x03;
+	for (int n = 4; n + 1 < len; n += 2) {
+		write16(&p[n], (int16_t)((seq * 37 + n * 101) & 0x3FFF));
+	}
+
+	return p + len;
+}
+
+static void bench_build_payload(void)
+{
+	uint8_t *p = bench_payload;
+
+	*p++ = 0xFB;
+	write32(p, 0);
+	p += 4;
+
+	for (int set = 0; set < BENCH_SETS_PER_PAYLOAD; set++) {
+		p = bench_put_report(p, SH2_ROTATION_VECTOR, 14, set);
+		p = bench_put_report(p, SH2_ACCELEROMETER, 10, set);
+		p = bench_put_report(p, SH2_GYROSCOPE_CALIBRATED, 10, set);
+		p = bench_put_report(p, SH2_MAGNETIC_FIELD_CALIBRATED, 10, set);
+	}
+
+	bench_payload_len = p - bench_payload;
+}
+
+/* Per-event path: what the driver's sensor callback does minus the
+ * conversion into struct sensor_value.
+ */
+static void bench_event_cb(void *cookie, sh2_SensorEvent_t *event, const struct device *dev)
+{
+	if (sh2_decodeSensorEvent(&bench_value, event) == SH2_OK) {
+		bench_events++;
+	}
+}
+
+static uint64_t bench_time_ns(void)
+{
+	/* Use the current host time so the SH2 timestamp rollover tracking
+	 * is left consistent for the real input that follows.
+	 */
+	uint32_t t_us = (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+	timing_t start, end;
+
+	start = timing_counter_get();
+	for (int n = 0; n < BENCH_ITERATIONS; n++) {
+		sh2_processInput(bench_payload, bench_payload_len, t_us);
+	}
+	end = timing_counter_get();
+
+	return timing_cycles_to_ns(timing_cycles_get(&start, &end));
+}
+
+static uint32_t bench_reports_per_sec(uint64_t ns)
+{
+	uint64_t reports = (uint64_t)BENCH_ITERATIONS * BENCH_SETS_PER_PAYLOAD *
+			   BENCH_REPORTS_PER_SET;
+
+	return ns ? (uint32_t)(reports * NSEC_PER_SEC / ns) : 0;
+}
+
+#ifdef CONFIG_BNO08X_EULER
+/* Orientations spread over the sphere, including the pitch +-90 deg poles */
+static float bench_quat[BENCH_QUATS][4];
+static volatile float bench_sink_f;
+
+static void bench_build_quats(void)
+{
+	uint32_t seed = 0x2545F491;
+
+	for (int n = 0; n < BENCH_QUATS; n++) {
+		float norm = 0.0f;
+
+		for (int c = 0; c < 4; c++) {
+			seed = seed * 1664525 + 1013904223;
+			bench_quat[n][c] = (float)(int32_t)seed / 2147483648.0f;
+			norm += bench_quat[n][c] * bench_quat[n][c];
+		}
+		norm = 1.0f / sqrtf(norm);
+		for (int c = 0; c < 4; c++) {
+			bench_quat[n][c] *= norm;
+		}
+	}
+
+	/* i = r = 0.5 sqrt(2) puts pitch at +90 deg */
+	bench_quat[0][0] = bench_quat[0][3] = 0.70710678f;
+	bench_quat[0][1] = bench_quat[0][2] = 0.0f;
+}
+
+static float bench_angle_err(float a, float b)
+{
+	float e = fabsf(a - b);
+
+	/* atan2 at +-pi may land on either side */
+	return (e > 3.14159265f) ? fabsf(e - 6.28318531f) : e;
+}
+
+static void bench_euler(void)
+{
+	timing_t start, end;
+	uint64_t ref_ns, fast_ns;
+	float max_err = 0.0f;
+
+	bench_build_quats();
+
+	start = timing_counter_get();
+	for (int n = 0; n < BENCH_QUATS; n++) {
+		float y, p, r;
+		const float *q = bench_quat[n];
+
+		q_to_ypr(q[3], q[0], q[1], q[2], &y, &p, &r);
+		bench_sink_f = y + p + r;
+	}
+	end = timing_counter_get();
+	ref_ns = timing_cycles_to_ns(timing_cycles_get(&start, &end));
+
+	start = timing_counter_get();
+	for (int n = 0; n < BENCH_QUATS; n++) {
+		float ypr[3];
+
+		bno08x_quat_to_ypr(bench_quat[n], ypr);
+		bench_sink_f = ypr[0] + ypr[1] + ypr[2];
+	}
+	end = timing_counter_get();
+	fast_ns = timing_cycles_to_ns(timing_cycles_get(&start, &end));
+
+	for (int n = 0; n < BENCH_QUATS; n++) {
+		const float *q = bench_quat[n];
+		float ref[3], ypr[3];
+
+		/* q_to_ypr() fills yaw, pitch, roll in that order */
+		q_to_ypr(q[3], q[0], q[1], q[2], &ref[0], &ref[1], &ref[2]);
+		bno08x_quat_to_ypr(q, ypr);
+		for (int c = 0; c < 3; c++) {
+			max_err = MAX(max_err, bench_angle_err(ypr[c], ref[c]));
+		}
+	}
+
+	printk("bno08x euler bench: %d quaternions\n", BENCH_QUATS);
+	printk("  double q_to_ypr:         %u ns/sample\n", (uint32_t)(ref_ns / BENCH_QUATS));
+	printk("  float bno08x_quat_to_ypr: %u ns/sample, max error %u urad\n",
+	       (uint32_t)(fast_ns / BENCH_QUATS), (uint32_t)(max_err * 1e6f));
+}
+#endif
+
+void bno08x_bench_run(const struct device *dev)
+{
+	uint64_t event_ns, batch_ns;
+
+	bench_build_payload();
+
+	timing_init();
+	timing_start();
+
+	sh2_setBatchSink(NULL);
+	sh2_setSensorCallback(bench_event_cb, NULL, dev);
+	bench_events = 0;
+	event_ns = bench_time_ns();
+
+	memset(&bench_sink, 0, sizeof(bench_sink));
+	sh2_setBatchSink(&bench_sink);
+	batch_ns = bench_time_ns();
+
+#ifdef CONFIG_BNO08X_EULER
+	bench_euler();
+#endif
+
+	timing_stop();
+
+	sh2_setBatchSink(NULL);
+	sh2_setSensorCallback(NULL, NULL, dev);
+
+	printk("bno08x decode bench: %u byte payload, %d reports x %d iterations\n",
+	       bench_payload_len, BENCH_SETS_PER_PAYLOAD * BENCH_REPORTS_PER_SET,
+	       BENCH_ITERATIONS);
+	printk("  per-event path: %u reports/s (%u decoded)\n",
+	       bench_reports_per_sec(event_ns), bench_events);
+	printk("  batch path:     %u reports/s (%u decoded)\n",
+	       bench_reports_per_sec(batch_ns), bench_sink.reports);
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Dynamic calibration persistence for the BNO08X.
+ *
+ * The hub keeps its dynamic calibration data (DCD) in its own flash and loads
+ * it at reset. Auto-save keeps that copy fresh, and a periodic explicit save
+ * makes sure a well converged calibration is stored before power is cut.
+ * With CONFIG_BNO08X_CALIBRATION_SETTINGS the record is also mirrored in
+ * Zephyr settings and written back if the hub comes up without one.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+
+#include "bno08x.h"
+
+LOG_MODULE_DECLARE(bno08x, CONFIG_SENSOR_LOG_LEVEL);
+
+#define BNO08X_CAL_SENSORS (SH2_CAL_ACCEL | SH2_CAL_GYRO | SH2_CAL_MAG)
+#define BNO08X_DCD_SETTINGS_KEY "bno08x/dcd"
+
+/* Only save once the rotation vector reports high accuracy */
+#define BNO08X_DCD_SAVE_MIN_STATUS 3
+
+#ifdef CONFIG_BNO08X_CALIBRATION_SETTINGS
+static int bno08x_dcd_load_cb(const char *key, size_t len, settings_read_cb read_cb,
+			      void *cb_arg, void *param)
+{
+	struct bno08x_data *data = param;
+	ssize_t rc;
+
+	if (len > sizeof(data->dcd) || (len % sizeof(uint32_t)) != 0) {
+		return -EINVAL;
+	}
+
+	rc = read_cb(cb_arg, data->dcd, len);
+	if (rc < 0) {
+		return rc;
+	}
+
+	data->dcd_words = rc / sizeof(uint32_t);
+	return 0;
+}
+
+static void bno08x_dcd_restore(const struct device *dev)
+{
+	struct bno08x_data *data = dev->data;
+	uint32_t hub_dcd[BNO08X_DCD_MAX_WORDS];
+	uint16_t words = ARRAY_SIZE(hub_dcd);
+	int err;
+
+	data->dcd_words = 0;
+	err = settings_load_subtree_direct(BNO08X_DCD_SETTINGS_KEY, bno08x_dcd_load_cb, data);
+	if (err || data->dcd_words == 0) {
+		return;
+	}
+
+	err = sh2_getFrs(DYNAMIC_CALIBRATION, hub_dcd, &words);
+	if (err == SH2_OK && words != 0) {
+		/* The hub has its own copy, which is at least as recent. */
+		return;
+	}
+
+	LOG_WRN("hub has no DCD, restoring %u words from settings", data->dcd_words);
+	err = sh2_setFrs(DYNAMIC_CALIBRATION, data->dcd, data->dcd_words);
+	if (err != SH2_OK) {
+		LOG_ERR("DCD restore failed: %d", err);
+		return;
+	}
+
+	/* DCD is only loaded from flash at hub reset */
+	err = sh2_reinitialize();
+	if (err != SH2_OK) {
+		LOG_ERR("hub reinitialize failed: %d", err);
+	}
+}
+
+static void bno08x_dcd_mirror(const struct device *dev)
+{
+	struct bno08x_data *data = dev->data;
+	uint32_t hub_dcd[BNO08X_DCD_MAX_WORDS];
+	uint16_t words = ARRAY_SIZE(hub_dcd);
+	int err;
+
+	err = sh2_getFrs(DYNAMIC_CALIBRATION, hub_dcd, &words);
+	if (err != SH2_OK || words == 0) {
+		return;
+	}
+
+	if (words == data->dcd_words &&
+	    memcmp(hub_dcd, data->dcd, words * sizeof(uint32_t)) == 0) {
+		return;
+	}
+
+	err = settings_save_one(BNO08X_DCD_SETTINGS_KEY, hub_dcd, words * sizeof(uint32_t));
+	if (err) {
+		LOG_ERR("DCD settings save failed: %d", err);
+		return;
+	}
+
+	memcpy(data->dcd, hub_dcd, words * sizeof(uint32_t));
+	data->dcd_words = words;
+}
+#endif /* CONFIG_BNO08X_CALIBRATION_SETTINGS */
+
+int bno08x_cal_init(const struct device *dev)
+{
+	struct bno08x_data *data = dev->data;
+	int err;
+
+#ifdef CONFIG_BNO08X_CALIBRATION_SETTINGS
+	bno08x_dcd_restore(dev);
+#endif
+
+	err = sh2_setCalConfig(BNO08X_CAL_SENSORS);
+	if (err != SH2_OK) {
+		LOG_ERR("sh2_setCalConfig failed: %d", err);
+		return -EIO;
+	}
+
+	err = sh2_setDcdAutoSave(true);
+	if (err != SH2_OK) {
+		LOG_ERR("sh2_setDcdAutoSave failed: %d", err);
+		return -EIO;
+	}
+
+	data->dcd_next_save = k_uptime_get() +
+			      CONFIG_BNO08X_CALIBRATION_SAVE_INTERVAL * MSEC_PER_SEC;
+	return 0;
+}
+
+static void bno08x_cal_replayed(void *cookie, int status)
+{
+	if (status != SH2_OK) {
+		LOG_ERR("restoring calibration setting %s failed: %d", (const char *)cookie, status);
+	}
+}
+
+/* The hub reloads its DCD from flash at reset, but not these settings */
+void bno08x_cal_replay(const struct device *dev)
+{
+	int err;
+
+	ARG_UNUSED(dev);
+
+	err = sh2_setCalConfigAsync(BNO08X_CAL_SENSORS, bno08x_cal_replayed, "cal config");
+	if (err == SH2_OK) {
+		err = sh2_setDcdAutoSaveAsync(true, bno08x_cal_replayed, "DCD auto-save");
+	}
+	if (err != SH2_OK) {
+		LOG_ERR("calibration settings not queued: %d", err);
+	}
+}
+
+static void bno08x_dcd_saved(void *cookie, int status)
+{
+	struct bno08x_data *data = cookie;
+
+	if (status != SH2_OK) {
+		LOG_ERR("sh2_saveDcdNow failed: %d", status);
+		return;
+	}
+
+	data->dcd_saved = true;
+}
+
+void bno08x_cal_service(const struct device *dev, uint8_t cal_status)
+{
+	struct bno08x_data *data = dev->data;
+	int err;
+
+#ifdef CONFIG_BNO08X_CALIBRATION_SETTINGS
+	/* Mirror the save made on an earlier call, outside the SH2 callback */
+	if (data->dcd_saved) {
+		data->dcd_saved = false;
+		bno08x_dcd_mirror(dev);
+	}
+#endif
+
+	if (k_uptime_get() < data->dcd_next_save) {
+		return;
+	}
+
+	if (BNO08X_CAL_STATUS_GET(cal_status, ROTATION_VEC) < BNO08X_DCD_SAVE_MIN_STATUS) {
+		return;
+	}
+
+	data->dcd_next_save = k_uptime_get() +
+			      CONFIG_BNO08X_CALIBRATION_SAVE_INTERVAL * MSEC_PER_SEC;
+
+	err = sh2_saveDcdNowAsync(bno08x_dcd_saved, data);
+	if (err != SH2_OK) {
+		LOG_ERR("DCD save not queued: %d", err);
+	}
+}
@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Emulated BNO08x behind the driver's public API, for simulated boards.
+ *
+ * No SH2 traffic: each sensor_sample_fetch() synthesises the samples that
+ * fell due on the kernel clock since the previous one. The device turns
+ * slowly about the vertical axis with gravity along z, a matching gyroscope
+ * rate and a constant magnetic field, and the stability classifier always
+ * reports motion so motion-gated applications keep streaming. Accuracy is
+ * always high, and there are no gestures, hub resets or stream gaps.
+ */
+
+#define DT_DRV_COMPAT ceva_bno08x_emul
+
+#include <math.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/logging/log.h>
+
+#include <drivers/sensor/bno08x.h>
+
+LOG_MODULE_REGISTER(bno08x_emul, CONFIG_SENSOR_LOG_LEVEL);
+
+/* Samples kept for bno08x_sample_read() and bno08x_raw_read(), power of 2 */
+#define BNO08X_EMUL_RING_LEN	32
+#define BNO08X_EMUL_RING_MASK	(BNO08X_EMUL_RING_LEN - 1)
+
+/* One turn every four seconds */
+#define BNO08X_EMUL_TURN_US	4000000U
+#define BNO08X_EMUL_OMEGA	(2.0f * (float)M_PI * USEC_PER_SEC / BNO08X_EMUL_TURN_US)
+#define BNO08X_EMUL_GRAVITY	9.80665f
+#define BNO08X_EMUL_FIELD_UT	40.0f
+
+/* Raw ADC scales of the hub's sensors */
+#define BNO08X_EMUL_RAW_ACCEL_PER_G	4096.0f
+#define BNO08X_EMUL_RAW_GYRO_PER_RAD	939.65f
+#define BNO08X_EMUL_RAW_MAGN_PER_UT	16.0f
+
+#define BNO08X_EMUL_CAL_HIGH	0xff
+
+struct bno08x_emul_data {
+	/* enum bno08x_mode */
+	uint8_t mode;
+	uint8_t gestures;
+	/* Time of the next sample to synthesise, kernel uptime us; 0 to restart */
+	uint64_t next_us;
+	struct bno08x_sample latest;
+	struct bno08x_sample ring[BNO08X_EMUL_RING_LEN];
+	uint32_t head;
+	uint32_t tail;
+#ifdef CONFIG_BNO08X_RAW_MODE
+	struct bno08x_raw_sample raw[BNO08X_EMUL_RING_LEN];
+	uint32_t raw_head;
+	uint32_t raw_tail;
+#endif
+};
+
+/* Same values as the hub's metadata records, with its Q points */
+static const struct bno08x_sensor_info bno08x_emul_info[BNO08X_SENSOR_COUNT] = {
+	[BNO08X_SENSOR_ACCEL] = { 2500, 0, 20070, 10, 8, 0 },
+	[BNO08X_SENSOR_GYRO] = { 2500, 0, 17873, 1, 9, 0 },
+	[BNO08X_SENSOR_MAGN] = { 10000, 0, 20800, 6, 4, 0 },
+	[BNO08X_SENSOR_ROTATION_VEC] = { 2500, 0, 16384, 1, 14, 12 },
+	[BNO08X_SENSOR_RAW_ACCEL] = { 1000, 0, 32767, 1, 0, 0 },
+	[BNO08X_SENSOR_RAW_GYRO] = { 1000, 0, 32767, 1, 0, 0 },
+	[BNO08X_SENSOR_RAW_MAGN] = { 10000, 0, 32767, 1, 0, 0 },
+};
+
+static inline uint64_t bno08x_emul_now_us(void)
+{
+	return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static void bno08x_emul_synth(uint64_t t_us, struct bno08x_sample *s)
+{
+	const float angle = BNO08X_EMUL_OMEGA * (float)(t_us % BNO08X_EMUL_TURN_US) /
+			    USEC_PER_SEC;
+
+	s->timestamp_us = t_us;
+	s->quat[0] = 0.0f;
+	s->quat[1] = 0.0f;
+	s->quat[2] = sinf(angle / 2.0f);
+	s->quat[3] = cosf(angle / 2.0f);
+	s->accel[0] = 0.0f;
+	s->accel[1] = 0.0f;
+	s->accel[2] = BNO08X_EMUL_GRAVITY;
+	s->gyro[0] = 0.0f;
+	s->gyro[1] = 0.0f;
+	s->gyro[2] = BNO08X_EMUL_OMEGA;
+	/* The field stays put while the device turns under it */
+	s->magn[0] = BNO08X_EMUL_FIELD_UT * cosf(angle);
+	s->magn[1] = -BNO08X_EMUL_FIELD_UT * sinf(angle);
+	s->magn[2] = -BNO08X_EMUL_FIELD_UT / 2.0f;
+}
+
+static void bno08x_emul_push(struct bno08x_emul_data *data, const struct bno08x_sample *s)
+{
+	data->latest = *s;
+
+	data->ring[data->head & BNO08X_EMUL_RING_MASK] = *s;
+	data->head++;
+	if (data->head - data->tail > BNO08X_EMUL_RING_LEN) {
+		data->tail = data->head - BNO08X_EMUL_RING_LEN;
+	}
+
+#ifdef CONFIG_BNO08X_RAW_MODE
+	if (data->mode == BNO08X_MODE_RAW) {
+		struct bno08x_raw_sample *r = &data->raw[data->raw_head & BNO08X_EMUL_RING_MASK];
+
+		r->timestamp_us = s->timestamp_us;
+		for (int i = 0; i < 3; i++) {
+			r->accel[i] = (int16_t)(s->accel[i] / BNO08X_EMUL_GRAVITY *
+						BNO08X_EMUL_RAW_ACCEL_PER_G);
+			r->gyro[i] = (int16_t)(s->gyro[i] * BNO08X_EMUL_RAW_GYRO_PER_RAD);
+			r->magn[i] = (int16_t)(s->magn[i] * BNO08X_EMUL_RAW_MAGN_PER_UT);
+		}
+		data->raw_head++;
+		if (data->raw_head - data->raw_tail > BNO08X_EMUL_RING_LEN) {
+			data->raw_tail = data->raw_head - BNO08X_EMUL_RING_LEN;
+		}
+	}
+#endif
+}
+
+static int bno08x_emul_sample_fetch(const struct device *dev, enum sensor_channel chan)
+{
+	struct bno08x_emul_data *data = dev->data;
+	const uint64_t now = bno08x_emul_now_us();
+	uint32_t interval_us = CONFIG_BNO08X_EMUL_INTERVAL_US;
+	struct bno08x_sample s;
+
+	if (chan != SENSOR_CHAN_ALL) {
+		return -ENOTSUP;
+	}
+
+	if (data->mode == BNO08X_MODE_IDLE) {
+		data->next_us = 0;
+		return 0;
+	}
+
+#ifdef CONFIG_BNO08X_RAW_MODE
+	if (data->mode == BNO08X_MODE_RAW) {
+		interval_us = CONFIG_BNO08X_RAW_INTERVAL_US;
+	}
+#endif
+
+	/* Samples that would have overflowed the rings are never made */
+	if (data->next_us == 0 ||
+	    now - data->next_us > (uint64_t)BNO08X_EMUL_RING_LEN * interval_us) {
+		data->next_us = now - (uint64_t)(BNO08X_EMUL_RING_LEN - 1) * interval_us;
+	}
+
+	while (data->next_us <= now) {
+		bno08x_emul_synth(data->next_us, &s);
+		bno08x_emul_push(data, &s);
+		data->next_us += interval_us;
+	}
+
+	return 0;
+}
+
+static void bno08x_emul_vec(struct sensor_value *val, const float *v, int n)
+{
+	for (int i = 0; i < n; i++) {
+		sensor_value_from_double(&val[i], v[i]);
+	}
+}
+
+static int bno08x_emul_channel_get(const struct device *dev, enum sensor_channel chan,
+				   struct sensor_value *val)
+{
+	struct bno08x_emul_data *data = dev->data;
+	const struct bno08x_sample *s = &data->latest;
+
+	switch ((int)chan) {
+	case SENSOR_CHAN_ACCEL_XYZ:
+		bno08x_emul_vec(val, s->accel, 3);
+		break;
+	case SENSOR_CHAN_GYRO_XYZ:
+		bno08x_emul_vec(val, s->gyro, 3);
+		break;
+	case SENSOR_CHAN_MAGN_XYZ:
+		bno08x_emul_vec(val, s->magn, 3);
+		break;
+	case SENSOR_CHAN_ROTATION_VEC_IJKR:
+		bno08x_emul_vec(val, s->quat, 4);
+		break;
+	case SENSOR_CHAN_ROTATION_VEC_TIMESTAMP:
+		val->val1 = (int32_t)(s->timestamp_us / USEC_PER_SEC);
+		val->val2 = (int32_t)(s->timestamp_us % USEC_PER_SEC);
+		break;
+	case SENSOR_CHAN_CALIBRATION_STATUS:
+		val->val1 = BNO08X_EMUL_CAL_HIGH;
+		val->val2 = 0;
+		break;
+	case SENSOR_CHAN_STABILITY:
+		val->val1 = BNO08X_STABILITY_MOTION;
+		val->val2 = 0;
+		break;
+#ifdef CONFIG_BNO08X_EULER
+	case SENSOR_CHAN_YPR: {
+		float ypr[3];
+
+		bno08x_quat_to_ypr(s->quat, ypr);
+		for (int i = 0; i < 3; i++) {
+			sensor_value_from_double(&val[i], ypr[i] * (180.0 / M_PI));
+		}
+		break;
+	}
+#endif
+	default:
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+
+static int bno08x_emul_attr_set(const struct device *dev, enum sensor_channel chan,
+				enum sensor_attribute attr, const struct sensor_value *val)
+{
+	struct bno08x_emul_data *data = dev->data;
+
+	if (chan != SENSOR_CHAN_ALL) {
+		return -ENOTSUP;
+	}
+
+	switch ((int)attr) {
+	case SENSOR_ATTR_BNO08X_MODE:
+		if ((val->val1 == BNO08X_MODE_RAW && !IS_ENABLED(CONFIG_BNO08X_RAW_MODE)) ||
+		    (val->val1 == BNO08X_MODE_IDLE && !IS_ENABLED(CONFIG_BNO08X_MOTION_DETECT)) ||
+		    val->val1 < BNO08X_MODE_FUSION || val->val1 > BNO08X_MODE_IDLE) {
+			return -ENOTSUP;
+		}
+		data->mode = val->val1;
+		data->next_us = 0;
+		data->tail = data->head;
+#ifdef CONFIG_BNO08X_RAW_MODE
+		data->raw_tail = data->raw_head;
+#endif
+		return 0;
+#ifdef CONFIG_BNO08X_GESTURES
+	case SENSOR_ATTR_BNO08X_GESTURES:
+		data->gestures = (uint8_t)val->val1;
+		return 0;
+#endif
+	default:
+		return -ENOTSUP;
+	}
+}
+
+int bno08x_sample_read(const struct device *dev, struct bno08x_sample *samples, int max)
+{
+#ifdef CONFIG_BNO08X_BATCH_DECODE
+	struct bno08x_emul_data *data = dev->data;
+	int count = 0;
+
+	while (count < max && data->tail != data->head) {
+		samples[count++] = data->ring[data->tail & BNO08X_EMUL_RING_MASK];
+		data->tail++;
+	}
+
+	return count;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+int bno08x_raw_read(const struct device *dev, struct bno08x_raw_sample *samples, int max)
+{
+#ifdef CONFIG_BNO08X_RAW_MODE
+	struct bno08x_emul_data *data = dev->data;
+	int count = 0;
+
+	while (count < max && data->raw_tail != data->raw_head) {
+		samples[count++] = data->raw[data->raw_tail & BNO08X_EMUL_RING_MASK];
+		data->raw_tail++;
+	}
+
+	return count;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+#ifdef CONFIG_BNO08X_GESTURES
+int bno08x_gesture_read(const struct device *dev, struct bno08x_gesture_event *events,
+			size_t max)
+{
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_BNO08X_ORIENTATION
+int bno08x_reorient(const struct device *dev, const float quat[4])
+{
+	return 0;
+}
+
+int bno08x_tare(const struct device *dev, bool heading_only)
+{
+	struct bno08x_emul_data *data = dev->data;
+
+	return (data->mode == BNO08X_MODE_IDLE) ? -EAGAIN : 0;
+}
+#endif
+
+int bno08x_gap_read(const struct device *dev, struct bno08x_gap *gap)
+{
+	return -ENODATA;
+}
+
+int bno08x_sensor_info_get(const struct device *dev, enum bno08x_sensor sensor,
+			   struct bno08x_sensor_info *info)
+{
+	if (sensor >= BNO08X_SENSOR_COUNT) {
+		return -EINVAL;
+	}
+
+	*info = bno08x_emul_info[sensor];
+	return 0;
+}
+
+int bno08x_wait_int(const struct device *dev, k_timeout_t timeout)
+{
+	/* Always moving, so the motion reports of BNO08X_MODE_IDLE are pending */
+	return 0;
+}
+
+int bno08x_wait_ready(const struct device *dev, k_timeout_t timeout)
+{
+	return 0;
+}
+
+static int bno08x_emul_init(const struct device *dev)
+{
+	LOG_INF("Emulated hub, fusion interval %u us", CONFIG_BNO08X_EMUL_INTERVAL_US);
+	return 0;
+}
+
+static const struct sensor_driver_api bno08x_emul_api = {
+	.sample_fetch = bno08x_emul_sample_fetch,
+	.channel_get = bno08x_emul_channel_get,
+	.attr_set = bno08x_emul_attr_set,
+};
+
+#define BNO08X_EMUL_CREATE_INST(inst)					\
+									\
+	static struct bno08x_emul_data bno08x_emul_data_##inst;		\
+									\
+	SENSOR_DEVICE_DT_INST_DEFINE(inst,				\
+			      bno08x_emul_init,				\
+			      NULL,					\
+			      &bno08x_emul_data_##inst,			\
+			      NULL,					\
+			      POST_KERNEL,				\
+			      CONFIG_SENSOR_INIT_PRIORITY,		\
+			      &bno08x_emul_api);
+
+DT_INST_FOREACH_STATUS_OKAY(BNO08X_EMUL_CREATE_INST);
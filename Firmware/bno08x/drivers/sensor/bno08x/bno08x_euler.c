@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Single precision yaw, pitch and roll from the rotation vector.
+ *
+ * The Cortex-M33 FPU only handles float, so the double atan2()/asin() in
+ * sh2/euler.c go through software emulation. These replace them with an
+ * 11th order odd polynomial for atan on [0, 1] (max error 2e-6 rad) plus
+ * octant folding; asin is atan2(x, sqrt(1 - x^2)) with the hardware sqrt.
+ */
+
+#include <math.h>
+#include <zephyr/kernel.h>
+
+#include <drivers/sensor/bno08x.h>
+
+#define BNO08X_PI_F	3.14159265f
+#define BNO08X_PI_2_F	1.57079633f
+
+/* Minimax coefficients of atan(z) / z in powers of z^2 */
+static inline float bno08x_atan_unit(float z)
+{
+	float z2 = z * z;
+
+	return z * (0.99997726f + z2 * (-0.33262347f + z2 * (0.19354346f +
+		    z2 * (-0.11643287f + z2 * (0.05265332f + z2 * -0.01172120f)))));
+}
+
+float bno08x_atan2f(float y, float x)
+{
+	float ax = fabsf(x);
+	float ay = fabsf(y);
+	float a;
+
+	if (ax == 0.0f && ay == 0.0f) {
+		return 0.0f;
+	}
+
+	a = (ay <= ax) ? bno08x_atan_unit(ay / ax) : BNO08X_PI_2_F - bno08x_atan_unit(ax / ay);
+	if (x < 0.0f) {
+		a = BNO08X_PI_F - a;
+	}
+
+	return (y < 0.0f) ? -a : a;
+}
+
+float bno08x_asinf(float x)
+{
+	x = CLAMP(x, -1.0f, 1.0f);
+
+	return bno08x_atan2f(x, sqrtf((1.0f - x) * (1.0f + x)));
+}
+
+void bno08x_quat_to_ypr(const float quat[4], float ypr[3])
+{
+	float i = quat[0], j = quat[1], k = quat[2], r = quat[3];
+
+	/* Same convention as q_to_ypr() in sh2/euler.c */
+	ypr[0] = bno08x_atan2f(2.0f * (i * j - r * k), 2.0f * (r * r + j * j) - 1.0f);
+	ypr[1] = bno08x_asinf(2.0f * (j * k + r * i));
+	ypr[2] = bno08x_atan2f(2.0f * (r * j - i * k), 2.0f * (r * r + k * k) - 1.0f);
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Gesture events from the BNO08X's own detectors.
+ *
+ * The tap, shake, flip, pickup and circle detectors run on the hub and only
+ * report when they trigger, so they cost nothing on the host while nothing
+ * happens. Their reports are not part of the batch rings; the sensor event
+ * callback hands them here and they are kept in a small queue until read
+ * with bno08x_gesture_read().
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "bno08x.h"
+
+LOG_MODULE_DECLARE(bno08x, CONFIG_SENSOR_LOG_LEVEL);
+
+BUILD_ASSERT(BNO08X_GESTURE_COUNT <= 8, "gesture set must fit the mask");
+
+/* Report of each enum bno08x_gesture */
+static const sh2_SensorId_t bno08x_gesture_ids[BNO08X_GESTURE_COUNT] = {
+	[BNO08X_GESTURE_TAP] = SH2_TAP_DETECTOR,
+	[BNO08X_GESTURE_SHAKE] = SH2_SHAKE_DETECTOR,
+	[BNO08X_GESTURE_FLIP] = SH2_FLIP_DETECTOR,
+	[BNO08X_GESTURE_PICKUP] = SH2_PICKUP_DETECTOR,
+	[BNO08X_GESTURE_CIRCLE] = SH2_CIRCLE_DETECTOR,
+};
+
+static void bno08x_gesture_configured(void *cookie, int status)
+{
+	if (status != SH2_OK) {
+		LOG_ERR("gesture report %u config failed: %d",
+			(unsigned int)(uintptr_t)cookie, status);
+	}
+}
+
+/* Queue the config of the detectors whose bit differs between the masks */
+static int bno08x_gesture_configure(uint8_t old_mask, uint8_t new_mask)
+{
+	sh2_SensorConfig_t config = { 0 };
+	int err;
+
+	for (int n = 0; n < BNO08X_GESTURE_COUNT; n++) {
+		if (!((old_mask ^ new_mask) & BIT(n))) {
+			continue;
+		}
+
+		config.reportInterval_us = (new_mask & BIT(n)) ?
+					   CONFIG_BNO08X_GESTURE_INTERVAL_US : 0;
+		err = sh2_setSensorConfigAsync(bno08x_gesture_ids[n], &config,
+					       bno08x_gesture_configured,
+					       (void *)(uintptr_t)bno08x_gesture_ids[n]);
+		if (err != SH2_OK) {
+			LOG_ERR("gesture report %u config not queued: %d",
+				bno08x_gesture_ids[n], err);
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+int bno08x_gesture_set(const struct device *dev, int32_t mask)
+{
+	struct bno08x_data *data = dev->data;
+	int err;
+
+	if (mask < 0 || mask >= BIT(BNO08X_GESTURE_COUNT)) {
+		return -EINVAL;
+	}
+
+	err = bno08x_gesture_configure(data->gestures, (uint8_t)mask);
+	if (err) {
+		return err;
+	}
+
+	data->gestures = (uint8_t)mask;
+	return 0;
+}
+
+void bno08x_gesture_replay(const struct device *dev)
+{
+	struct bno08x_data *data = dev->data;
+
+	bno08x_gesture_configure(0, data->gestures);
+}
+
+void bno08x_gesture_push(const struct device *dev, const sh2_SensorValue_t *value)
+{
+	struct bno08x_data *data = dev->data;
+	struct bno08x_gesture_event *event;
+	enum bno08x_gesture gesture;
+	uint16_t flags;
+
+	switch (value->sensorId) {
+	case SH2_TAP_DETECTOR:
+		gesture = BNO08X_GESTURE_TAP;
+		flags = value->un.tapDetector.flags;
+		break;
+	case SH2_SHAKE_DETECTOR:
+		gesture = BNO08X_GESTURE_SHAKE;
+		flags = value->un.shakeDetector.shake;
+		break;
+	case SH2_FLIP_DETECTOR:
+		gesture = BNO08X_GESTURE_FLIP;
+		flags = value->un.flipDetector.flip;
+		break;
+	case SH2_PICKUP_DETECTOR:
+		gesture = BNO08X_GESTURE_PICKUP;
+		flags = value->un.pickupDetector.pickup;
+		break;
+	case SH2_CIRCLE_DETECTOR:
+		gesture = BNO08X_GESTURE_CIRCLE;
+		flags = value->un.circleDetector.circle;
+		break;
+	default:
+		return;
+	}
+
+	/* A reader that has fallen behind loses the oldest events */
+	if (data->gesture_head - data->gesture_tail == CONFIG_BNO08X_GESTURE_QUEUE_LEN) {
+		data->gesture_tail++;
+	}
+
+	event = &data->gesture_queue[data->gesture_head % CONFIG_BNO08X_GESTURE_QUEUE_LEN];
+	event->timestamp_us = value->timestamp;
+	event->gesture = gesture;
+	event->flags = flags;
+	data->gesture_head++;
+
+	LOG_DBG("gesture %d flags 0x%x", gesture, flags);
+}
+
+int bno08x_gesture_read(const struct device *dev, struct bno08x_gesture_event *events,
+			size_t max)
+{
+	struct bno08x_data *data = dev->data;
+	size_t n = 0;
+
+	while (n < max && data->gesture_tail != data->gesture_head) {
+		events[n++] = data->gesture_queue[data->gesture_tail %
+						  CONFIG_BNO08X_GESTURE_QUEUE_LEN];
+		data->gesture_tail++;
+	}
+
+	return (int)n;
+}
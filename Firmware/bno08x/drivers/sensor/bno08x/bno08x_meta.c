@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Sensor metadata cache for the BNO08X.
+ *
+ * Each sensor's FRS metadata record holds the Q points of its reports and
+ * the report periods the hub supports. Reading them takes one FRS
+ * transaction per sensor, so with CONFIG_BNO08X_METADATA_SETTINGS the
+ * records are kept in Zephyr settings together with the hub firmware
+ * version and only read again after a firmware change.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+
+#include "bno08x.h"
+
+LOG_MODULE_DECLARE(bno08x, CONFIG_SENSOR_LOG_LEVEL);
+
+#define BNO08X_META_SETTINGS_KEY "bno08x/meta"
+
+/* SH2 sensor of each enum bno08x_sensor */
+static const sh2_SensorId_t bno08x_meta_ids[BNO08X_SENSOR_COUNT] = {
+	[BNO08X_SENSOR_ACCEL] = SH2_ACCELEROMETER,
+	[BNO08X_SENSOR_GYRO] = SH2_GYROSCOPE_CALIBRATED,
+	[BNO08X_SENSOR_MAGN] = SH2_MAGNETIC_FIELD_CALIBRATED,
+	[BNO08X_SENSOR_ROTATION_VEC] = SH2_ROTATION_VECTOR,
+	[BNO08X_SENSOR_RAW_ACCEL] = SH2_RAW_ACCELEROMETER,
+	[BNO08X_SENSOR_RAW_GYRO] = SH2_RAW_GYROSCOPE,
+	[BNO08X_SENSOR_RAW_MAGN] = SH2_RAW_MAGNETOMETER,
+};
+
+/* What is stored in settings */
+struct bno08x_meta_record {
+	/* Hub firmware the metadata was read from */
+	uint32_t sw_part_number;
+	uint32_t sw_build_number;
+	uint16_t sw_version_patch;
+	uint8_t sw_version_major;
+	uint8_t sw_version_minor;
+
+	struct bno08x_sensor_info info[BNO08X_SENSOR_COUNT];
+};
+
+static void bno08x_meta_version(struct bno08x_meta_record *rec)
+{
+	const sh2_ProductId_t *id = &productIds.entry[0];
+
+	rec->sw_part_number = id->swPartNumber;
+	rec->sw_build_number = id->swBuildNumber;
+	rec->sw_version_patch = id->swVersionPatch;
+	rec->sw_version_major = id->swVersionMajor;
+	rec->sw_version_minor = id->swVersionMinor;
+}
+
+#ifdef CONFIG_BNO08X_METADATA_SETTINGS
+static int bno08x_meta_load_cb(const char *key, size_t len, settings_read_cb read_cb,
+			       void *cb_arg, void *param)
+{
+	struct bno08x_meta_record *rec = param;
+	ssize_t rc;
+
+	if (len != sizeof(*rec)) {
+		return -EINVAL;
+	}
+
+	rc = read_cb(cb_arg, rec, len);
+	return (rc == sizeof(*rec)) ? 0 : -EIO;
+}
+
+static bool bno08x_meta_restore(struct bno08x_meta_record *rec)
+{
+	struct bno08x_meta_record version;
+	int err;
+
+	memset(rec, 0, sizeof(*rec));
+	err = settings_load_subtree_direct(BNO08X_META_SETTINGS_KEY, bno08x_meta_load_cb, rec);
+	if (err || rec->info[BNO08X_SENSOR_ACCEL].min_period_us == 0) {
+		return false;
+	}
+
+	/* Only compare the version fields */
+	memset(&version, 0, sizeof(version));
+	bno08x_meta_version(&version);
+	return memcmp(rec, &version, offsetof(struct bno08x_meta_record, info)) == 0;
+}
+#endif
+
+static int bno08x_meta_read(struct bno08x_meta_record *rec)
+{
+	sh2_SensorMetadata_t meta;
+	int err;
+
+	memset(rec, 0, sizeof(*rec));
+	bno08x_meta_version(rec);
+
+	for (int n = 0; n < BNO08X_SENSOR_COUNT; n++) {
+		struct bno08x_sensor_info *info = &rec->info[n];
+
+		err = sh2_getMetadata(bno08x_meta_ids[n], &meta);
+		if (err != SH2_OK) {
+			LOG_ERR("sh2_getMetadata(0x%02x) failed: %d", bno08x_meta_ids[n], err);
+			return -EIO;
+		}
+
+		info->min_period_us = meta.minPeriod_uS;
+		info->max_period_us = meta.maxPeriod_uS;
+		info->range = meta.range;
+		info->resolution = meta.resolution;
+		info->q_point = (uint8_t)meta.qPoint1;
+		info->q_point2 = (uint8_t)meta.qPoint2;
+	}
+
+	return 0;
+}
+
+int bno08x_meta_init(const struct device *dev)
+{
+	struct bno08x_data *data = dev->data;
+	struct bno08x_meta_record rec;
+	int err;
+
+#ifdef CONFIG_BNO08X_METADATA_SETTINGS
+	if (!bno08x_meta_restore(&rec)) {
+		err = bno08x_meta_read(&rec);
+		if (err) {
+			return err;
+		}
+
+		err = settings_save_one(BNO08X_META_SETTINGS_KEY, &rec, sizeof(rec));
+		if (err) {
+			LOG_ERR("metadata settings save failed: %d", err);
+		}
+	}
+#else
+	err = bno08x_meta_read(&rec);
+	if (err) {
+		return err;
+	}
+#endif
+
+	memcpy(data->meta, rec.info, sizeof(data->meta));
+	data->meta_valid = true;
+
+	/* Raw reports are ADC counts and never scaled */
+	for (int n = 0; n < BNO08X_SENSOR_RAW_ACCEL; n++) {
+		sh2_setQPoints(bno08x_meta_ids[n], rec.info[n].q_point, rec.info[n].q_point2);
+	}
+
+	return 0;
+}
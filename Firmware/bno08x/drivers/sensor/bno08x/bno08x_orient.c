@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Output frame of the BNO08X.
+ *
+ * The hub rotates every report it sends by its reorientation quaternion,
+ * which is either set directly or computed by a tare from the current
+ * pose. Each change is followed by a persist-tare command, so the hub
+ * keeps the frame in its own flash and starts up with it after a power
+ * cycle or a reset of its own, without help from the host.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "bno08x.h"
+
+LOG_MODULE_DECLARE(bno08x, CONFIG_SENSOR_LOG_LEVEL);
+
+static void bno08x_orient_done(void *cookie, int status)
+{
+	if (status != SH2_OK) {
+		LOG_ERR("%s failed: %d", (const char *)cookie, status);
+	}
+}
+
+static int bno08x_orient_persist(int err)
+{
+	if (err == SH2_OK) {
+		err = sh2_persistTareAsync(bno08x_orient_done, "persist tare");
+	}
+	if (err != SH2_OK) {
+		LOG_ERR("orientation change not queued: %d", err);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+int bno08x_reorient(const struct device *dev, const float quat[4])
+{
+	struct bno08x_data *data = dev->data;
+	sh2_Quaternion_t q = {
+		.x = quat[0], .y = quat[1], .z = quat[2], .w = quat[3],
+	};
+
+#ifdef CONFIG_BNO08X_INIT_ASYNC
+	if (!data->hub_ready) {
+		return -EBUSY;
+	}
+#else
+	ARG_UNUSED(data);
+#endif
+
+	return bno08x_orient_persist(sh2_setReorientationAsync(&q, bno08x_orient_done,
+							       "set reorientation"));
+}
+
+int bno08x_tare(const struct device *dev, bool heading_only)
+{
+	struct bno08x_data *data = dev->data;
+	uint8_t axes = heading_only ? SH2_TARE_Z : (SH2_TARE_X | SH2_TARE_Y | SH2_TARE_Z);
+
+#ifdef CONFIG_BNO08X_INIT_ASYNC
+	if (!data->hub_ready) {
+		return -EBUSY;
+	}
+#endif
+
+	/* The tare is taken from the rotation vector, which idle mode stops */
+	if (data->mode == BNO08X_MODE_IDLE) {
+		return -EAGAIN;
+	}
+
+	return bno08x_orient_persist(sh2_setTareNowAsync(axes, SH2_TARE_BASIS_ROTATION_VECTOR,
+							 bno08x_orient_done, "tare"));
+}
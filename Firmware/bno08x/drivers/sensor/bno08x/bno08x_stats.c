@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Transport health statistics for the BNO08X.
+ *
+ * Mirrors the SHTP and SH2 receive counters, the number of transfers missing
+ * from each SHTP channel's sequence numbers and the hub's own per-sensor
+ * event counts into a Zephyr stats group, so they can be read with
+ * "mcumgr stat read bno08x". The host side counters are copied on every
+ * sample fetch; the hub counts take a command round trip each, so they are
+ * only refreshed every CONFIG_BNO08X_STATS_HUB_COUNTS_INTERVAL seconds and
+ * queued as asynchronous operations that sh2_service() runs between reports.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/stats/stats.h>
+
+#include "bno08x.h"
+
+LOG_MODULE_DECLARE(bno08x, CONFIG_SENSOR_LOG_LEVEL);
+
+/* SHTP channels, as assigned by the SH2 layer */
+#define BNO08X_SHTP_CHAN_COMMAND	0
+#define BNO08X_SHTP_CHAN_EXECUTABLE	1
+#define BNO08X_SHTP_CHAN_CONTROL	2
+#define BNO08X_SHTP_CHAN_INPUT		3
+#define BNO08X_SHTP_CHAN_INPUT_WAKE	4
+#define BNO08X_SHTP_CHAN_INPUT_GIRV	5
+
+STATS_SECT_START(bno08x_stats)
+STATS_SECT_ENTRY32(rx_bad_chan)
+STATS_SECT_ENTRY32(rx_short_frag)
+STATS_SECT_ENTRY32(rx_too_large)
+STATS_SECT_ENTRY32(rx_interrupted)
+STATS_SECT_ENTRY32(rx_single_frag)
+STATS_SECT_ENTRY32(tx_discards)
+STATS_SECT_ENTRY32(tx_too_large)
+STATS_SECT_ENTRY32(exec_bad_payload)
+STATS_SECT_ENTRY32(empty_payloads)
+STATS_SECT_ENTRY32(unknown_report_ids)
+STATS_SECT_ENTRY32(seq_gap_command)
+STATS_SECT_ENTRY32(seq_gap_exec)
+STATS_SECT_ENTRY32(seq_gap_control)
+STATS_SECT_ENTRY32(seq_gap_input)
+STATS_SECT_ENTRY32(seq_gap_wake)
+STATS_SECT_ENTRY32(seq_gap_girv)
+STATS_SECT_ENTRY32(accel_offered)
+STATS_SECT_ENTRY32(accel_accepted)
+STATS_SECT_ENTRY32(accel_on)
+STATS_SECT_ENTRY32(accel_attempted)
+STATS_SECT_ENTRY32(gyro_offered)
+STATS_SECT_ENTRY32(gyro_accepted)
+STATS_SECT_ENTRY32(gyro_on)
+STATS_SECT_ENTRY32(gyro_attempted)
+STATS_SECT_ENTRY32(magn_offered)
+STATS_SECT_ENTRY32(magn_accepted)
+STATS_SECT_ENTRY32(magn_on)
+STATS_SECT_ENTRY32(magn_attempted)
+STATS_SECT_ENTRY32(rv_offered)
+STATS_SECT_ENTRY32(rv_accepted)
+STATS_SECT_ENTRY32(rv_on)
+STATS_SECT_ENTRY32(rv_attempted)
+STATS_SECT_END;
+
+STATS_NAME_START(bno08x_stats)
+STATS_NAME(bno08x_stats, rx_bad_chan)
+STATS_NAME(bno08x_stats, rx_short_frag)
+STATS_NAME(bno08x_stats, rx_too_large)
+STATS_NAME(bno08x_stats, rx_interrupted)
+STATS_NAME(bno08x_stats, rx_single_frag)
+STATS_NAME(bno08x_stats, tx_discards)
+STATS_NAME(bno08x_stats, tx_too_large)
+STATS_NAME(bno08x_stats, exec_bad_payload)
+STATS_NAME(bno08x_stats, empty_payloads)
+STATS_NAME(bno08x_stats, unknown_report_ids)
+STATS_NAME(bno08x_stats, seq_gap_command)
+STATS_NAME(bno08x_stats, seq_gap_exec)
+STATS_NAME(bno08x_stats, seq_gap_control)
+STATS_NAME(bno08x_stats, seq_gap_input)
+STATS_NAME(bno08x_stats, seq_gap_wake)
+STATS_NAME(bno08x_stats, seq_gap_girv)
+STATS_NAME(bno08x_stats, accel_offered)
+STATS_NAME(bno08x_stats, accel_accepted)
+STATS_NAME(bno08x_stats, accel_on)
+STATS_NAME(bno08x_stats, accel_attempted)
+STATS_NAME(bno08x_stats, gyro_offered)
+STATS_NAME(bno08x_stats, gyro_accepted)
+STATS_NAME(bno08x_stats, gyro_on)
+STATS_NAME(bno08x_stats, gyro_attempted)
+STATS_NAME(bno08x_stats, magn_offered)
+STATS_NAME(bno08x_stats, magn_accepted)
+STATS_NAME(bno08x_stats, magn_on)
+STATS_NAME(bno08x_stats, magn_attempted)
+STATS_NAME(bno08x_stats, rv_offered)
+STATS_NAME(bno08x_stats, rv_accepted)
+STATS_NAME(bno08x_stats, rv_on)
+STATS_NAME(bno08x_stats, rv_attempted)
+STATS_NAME_END(bno08x_stats);
+
+static STATS_SECT_DECL(bno08x_stats) bno08x_stats;
+
+#define BNO08X_STATS_SET_COUNTS(sensor, counts)					\
+	do {									\
+		STATS_SET(bno08x_stats, sensor##_offered, (counts).offered);	\
+		STATS_SET(bno08x_stats, sensor##_accepted, (counts).accepted);	\
+		STATS_SET(bno08x_stats, sensor##_on, (counts).on);		\
+		STATS_SET(bno08x_stats, sensor##_attempted, (counts).attempted);	\
+	} while (0)
+
+/* Sensors whose hub counts are published, per streaming mode. In raw mode
+ * the accel, gyro and magn entries count the raw reports and rv stays 0.
+ */
+static const sh2_SensorId_t bno08x_stats_fusion_ids[] = {
+	SH2_ACCELEROMETER, SH2_GYROSCOPE_CALIBRATED,
+	SH2_MAGNETIC_FIELD_CALIBRATED, SH2_ROTATION_VECTOR,
+};
+
+#ifdef CONFIG_BNO08X_RAW_MODE
+static const sh2_SensorId_t bno08x_stats_raw_ids[] = {
+	SH2_RAW_ACCELEROMETER, SH2_RAW_GYROSCOPE, SH2_RAW_MAGNETOMETER, 0,
+};
+#endif
+
+/* Hub counts refresh in progress. The sensors are read one at a time, each
+ * sh2_getCountsAsync() queued from the previous one's callback, and the
+ * counts published together once the last has answered.
+ */
+static struct {
+	const sh2_SensorId_t *ids;
+	sh2_Counts_t counts[ARRAY_SIZE(bno08x_stats_fusion_ids)];
+	int next;
+	bool busy;
+} bno08x_stats_refresh;
+
+static void bno08x_stats_next_counts(void);
+
+static void bno08x_stats_counts_done(void *cookie, int status)
+{
+	if (status != SH2_OK) {
+		LOG_WRN("sensor %u counts not available: %d",
+			bno08x_stats_refresh.ids[bno08x_stats_refresh.next], status);
+		bno08x_stats_refresh.busy = false;
+		return;
+	}
+
+	bno08x_stats_refresh.next++;
+	bno08x_stats_next_counts();
+}
+
+static void bno08x_stats_next_counts(void)
+{
+	const sh2_Counts_t *counts = bno08x_stats_refresh.counts;
+	int err;
+
+	while (bno08x_stats_refresh.next < ARRAY_SIZE(bno08x_stats_refresh.counts) &&
+	       bno08x_stats_refresh.ids[bno08x_stats_refresh.next] == 0) {
+		bno08x_stats_refresh.next++;
+	}
+
+	if (bno08x_stats_refresh.next == ARRAY_SIZE(bno08x_stats_refresh.counts)) {
+		BNO08X_STATS_SET_COUNTS(accel, counts[0]);
+		BNO08X_STATS_SET_COUNTS(gyro, counts[1]);
+		BNO08X_STATS_SET_COUNTS(magn, counts[2]);
+		BNO08X_STATS_SET_COUNTS(rv, counts[3]);
+		bno08x_stats_refresh.busy = false;
+		return;
+	}
+
+	err = sh2_getCountsAsync(bno08x_stats_refresh.ids[bno08x_stats_refresh.next],
+				 &bno08x_stats_refresh.counts[bno08x_stats_refresh.next],
+				 bno08x_stats_counts_done, NULL);
+	if (err != SH2_OK) {
+		LOG_WRN("hub counts not queued: %d", err);
+		bno08x_stats_refresh.busy = false;
+	}
+}
+
+/* Start a hub counts refresh, run from sh2_service() so fetches never wait
+ * for the command round trips.
+ */
+static void bno08x_stats_hub_counts(const struct device *dev)
+{
+	struct bno08x_data *data = dev->data;
+
+	if (bno08x_stats_refresh.busy) {
+		return;
+	}
+
+	bno08x_stats_refresh.ids = bno08x_stats_fusion_ids;
+#ifdef CONFIG_BNO08X_RAW_MODE
+	if (data->mode == BNO08X_MODE_RAW) {
+		bno08x_stats_refresh.ids = bno08x_stats_raw_ids;
+	}
+#endif
+	memset(bno08x_stats_refresh.counts, 0, sizeof(bno08x_stats_refresh.counts));
+	bno08x_stats_refresh.next = 0;
+	bno08x_stats_refresh.busy = true;
+
+	bno08x_stats_next_counts();
+}
+
+int bno08x_stats_init(const struct device *dev)
+{
+	struct bno08x_data *data = dev->data;
+	int err;
+
+	err = STATS_INIT_AND_REG(bno08x_stats, STATS_SIZE_32, "bno08x");
+	if (err) {
+		LOG_ERR("stats group registration failed: %d", err);
+		return err;
+	}
+
+	data->stats_next_counts = 0;
+	return 0;
+}
+
+void bno08x_stats_service(const struct device *dev)
+{
+	struct bno08x_data *data = dev->data;
+	sh2_Stats_t stats;
+	int64_t now;
+
+	if (sh2_getStats(&stats) != SH2_OK) {
+		return;
+	}
+
+	STATS_SET(bno08x_stats, rx_bad_chan, stats.shtp.rxBadChan);
+	STATS_SET(bno08x_stats, rx_short_frag, stats.shtp.rxShortFragments);
+	STATS_SET(bno08x_stats, rx_too_large, stats.shtp.rxTooLargePayloads);
+	STATS_SET(bno08x_stats, rx_interrupted, stats.shtp.rxInterruptedPayloads);
+	STATS_SET(bno08x_stats, rx_single_frag, stats.shtp.rxSingleFragments);
+	STATS_SET(bno08x_stats, tx_discards, stats.shtp.txDiscards);
+	STATS_SET(bno08x_stats, tx_too_large, stats.shtp.txTooLargePayloads);
+	STATS_SET(bno08x_stats, exec_bad_payload, stats.execBadPayload);
+	STATS_SET(bno08x_stats, empty_payloads, stats.emptyPayloads);
+	STATS_SET(bno08x_stats, unknown_report_ids, stats.unknownReportIds);
+	STATS_SET(bno08x_stats, seq_gap_command, stats.shtp.rxSeqGaps[BNO08X_SHTP_CHAN_COMMAND]);
+	STATS_SET(bno08x_stats, seq_gap_exec, stats.shtp.rxSeqGaps[BNO08X_SHTP_CHAN_EXECUTABLE]);
+	STATS_SET(bno08x_stats, seq_gap_control, stats.shtp.rxSeqGaps[BNO08X_SHTP_CHAN_CONTROL]);
+	STATS_SET(bno08x_stats, seq_gap_input, stats.shtp.rxSeqGaps[BNO08X_SHTP_CHAN_INPUT]);
+	STATS_SET(bno08x_stats, seq_gap_wake, stats.shtp.rxSeqGaps[BNO08X_SHTP_CHAN_INPUT_WAKE]);
+	STATS_SET(bno08x_stats, seq_gap_girv, stats.shtp.rxSeqGaps[BNO08X_SHTP_CHAN_INPUT_GIRV]);
+
+	if (CONFIG_BNO08X_STATS_HUB_COUNTS_INTERVAL == 0 || data->mode == BNO08X_MODE_IDLE) {
+		return;
+	}
+
+	now = k_uptime_get();
+	if (now < data->stats_next_counts) {
+		return;
+	}
+	data->stats_next_counts = now + CONFIG_BNO08X_STATS_HUB_COUNTS_INTERVAL * MSEC_PER_SEC;
+
+	bno08x_stats_hub_counts(dev);
+}
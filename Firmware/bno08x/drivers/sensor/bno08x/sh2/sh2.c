@@ -39,6 +39,7 @@
 #include "sh2_err.h"
 #include "shtp.h"
 #include "sh2_util.h"
+#include "sh2_batch.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -273,6 +274,15 @@ typedef union {
 // Max length of an FRS record, words.
 #define MAX_FRS_WORDS (72)
 
+// An operation queued with one of the ...Async functions
+typedef struct sh2_AsyncOp_s {
+    const sh2_Op_t *pOp;
+    sh2_OpData_t opData;
+    sh2_SensorConfig_t config;  // Caller's sensor config, copied
+    sh2_AsyncCallback_t *callback;
+    void *cookie;
+} sh2_AsyncOp_t;
+
 struct sh2_s {
     // Pointer to the SHTP HAL
     sh2_Hal_t *pHal;
@@ -292,6 +302,14 @@ struct sh2_s {
     uint8_t lastCmdId;
     uint8_t cmdSeq;
     uint8_t nextCmdSeq;
+
+    // Asynchronous operations, oldest at asyncHead.  While asyncActive,
+    // the oldest one is the operation in progress.
+    sh2_AsyncOp_t asyncQueue[SH2_ASYNC_QUEUE_LEN];
+    uint8_t asyncHead;
+    uint8_t asyncCount;
+    bool asyncActive;
+    uint32_t asyncStart_us;
     
     // Event callback and it's cookie
     sh2_EventCallback_t *eventCallback;
@@ -305,6 +323,13 @@ struct sh2_s {
     uint32_t frsData[MAX_FRS_WORDS];
     uint16_t frsDataLen;
 
+    // Batch decoding destination, if any
+    sh2_BatchSink_t *batchSink;
+
+    // Host timestamp extension to 64 bits
+    uint32_t lastHostInt;
+    uint32_t hostIntRollovers;
+
     // Stats
     uint32_t execBadPayload;
     uint32_t emptyPayloads;
@@ -488,6 +513,11 @@ static const sh2_ReportLen_t sh2ReportLens[] = {
     {.id = SENSORHUB_GET_FEATURE_RESP,       .len = 17},
 };
 
+// Report lengths indexed by report id, built from sh2ReportLens on first open.
+// Zero means the report id is unknown.
+static uint8_t sh2ReportLenById[256];
+static bool sh2ReportLenByIdValid = false;
+
 // ------------------------------------------------------------------------
 // Private functions
 
@@ -543,15 +573,18 @@ static void opOnReset(sh2_t *pSh2)
     }
 }
 
-static uint8_t getReportLen(uint8_t reportId)
+static void initReportLens(void)
 {
     for (unsigned n = 0; n < ARRAY_LEN(sh2ReportLens); n++) {
-        if (sh2ReportLens[n].id == reportId) {
-            return sh2ReportLens[n].len;
-        }
+        sh2ReportLenById[sh2ReportLens[n].id] = sh2ReportLens[n].len;
     }
 
-    return 0;
+    sh2ReportLenByIdValid = true;
+}
+
+static inline uint8_t getReportLen(uint8_t reportId)
+{
+    return sh2ReportLenById[reportId];
 }
 
 static void sensorhubControlHdlr(void *cookie, uint8_t *payload, uint16_t len, uint32_t timestamp)
@@ -628,11 +661,130 @@ static void sensorhubControlHdlr(void *cookie, uint8_t *payload, uint16_t len, u
 }
 
 
+// ------------------------------------------------------------------------
+// Asynchronous operations
+//
+// Queued operations are started one at a time from sh2_service(), before it
+// reads from the hub, so sensor reports keep flowing while they run.  Their
+// callbacks are called from sh2_service() or from a blocking API call that
+// had to wait for the operation in progress.
+
+// Remove the oldest queued operation and report its status.
+static void asyncFinish(sh2_t *pSh2, int status)
+{
+    sh2_AsyncOp_t *pAsync = &pSh2->asyncQueue[pSh2->asyncHead];
+    sh2_AsyncCallback_t *callback = pAsync->callback;
+    void *cookie = pAsync->cookie;
+
+    pSh2->asyncActive = false;
+    pSh2->asyncHead = (pSh2->asyncHead + 1) % SH2_ASYNC_QUEUE_LEN;
+    pSh2->asyncCount--;
+
+    // Called last, so the callback can queue further operations
+    if (callback != 0) {
+        callback(cookie, status);
+    }
+}
+
+// Finish the asynchronous operation in progress if it has completed or timed out.
+static void asyncCheck(sh2_t *pSh2)
+{
+    if (!pSh2->asyncActive) {
+        return;
+    }
+
+    if (pSh2->pOp != 0) {
+        uint32_t now_us = pSh2->pHal->getTimeUs(pSh2->pHal);
+
+        if ((pSh2->pOp->timeout_us == 0) ||
+            ((now_us - pSh2->asyncStart_us) < pSh2->pOp->timeout_us)) {
+            // Still waiting for the hub
+            return;
+        }
+
+        // Operation has timed out.  Clean up.
+        pSh2->pOp = 0;
+        pSh2->opStatus = SH2_ERR_TIMEOUT;
+    }
+
+    asyncFinish(pSh2, pSh2->opStatus);
+}
+
+// Start the oldest queued operation, if no operation is in progress.
+static void asyncStartNext(sh2_t *pSh2)
+{
+    sh2_AsyncOp_t *pAsync = &pSh2->asyncQueue[pSh2->asyncHead];
+    int rc;
+
+    if (pSh2->asyncActive || (pSh2->pOp != 0) || (pSh2->asyncCount == 0)) {
+        return;
+    }
+
+    pSh2->opData = pAsync->opData;
+    pSh2->asyncActive = true;
+    pSh2->asyncStart_us = pSh2->pHal->getTimeUs(pSh2->pHal);
+
+    rc = opStart(pSh2, pAsync->pOp);
+    if (rc != SH2_OK) {
+        asyncFinish(pSh2, rc);
+    }
+    else if (pSh2->pOp == 0) {
+        // Completed as soon as it was sent
+        asyncFinish(pSh2, pSh2->opStatus);
+    }
+}
+
+// Block until the asynchronous operation in progress, if any, has finished.
+static void asyncWait(sh2_t *pSh2)
+{
+    while (pSh2->asyncActive) {
+        if (pSh2->pShtp == 0) {
+            // SH2 interface closed unexpectedly
+            asyncFinish(pSh2, SH2_ERR);
+            break;
+        }
+        shtp_service(pSh2->pShtp);
+        asyncCheck(pSh2);
+    }
+}
+
+// Reserve a queue entry for an asynchronous operation.
+// Returns 0 if the queue is full.
+static sh2_AsyncOp_t *asyncQueue(sh2_t *pSh2, const sh2_Op_t *pOp,
+                                 sh2_AsyncCallback_t *callback, void *cookie)
+{
+    sh2_AsyncOp_t *pAsync;
+
+    if (pSh2->asyncCount >= SH2_ASYNC_QUEUE_LEN) {
+        return 0;
+    }
+
+    pAsync = &pSh2->asyncQueue[(pSh2->asyncHead + pSh2->asyncCount) % SH2_ASYNC_QUEUE_LEN];
+    memset(pAsync, 0, sizeof(*pAsync));
+    pAsync->pOp = pOp;
+    pAsync->callback = callback;
+    pAsync->cookie = cookie;
+    pSh2->asyncCount++;
+
+    return pAsync;
+}
+
+// Clear opData for a new blocking operation.
+// The asynchronous operation in progress, if any, still needs its opData.
+static void opDataReset(sh2_t *pSh2)
+{
+    asyncWait(pSh2);
+    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+}
+
 static int opProcess(sh2_t *pSh2, const sh2_Op_t *pOp)
 {
     int status = SH2_OK;
     uint32_t start_us = 0;
 
+    // Let an asynchronous operation in progress finish first
+    asyncWait(pSh2);
+
     start_us = pSh2->pHal->getTimeUs(pSh2->pHal);
     
     status = opStart(pSh2, pOp);
@@ -669,19 +821,17 @@ static int opProcess(sh2_t *pSh2, const sh2_Op_t *pOp)
 }
 
 // Produce 64-bit microsecond timestamp for a sensor event
-static uint64_t touSTimestamp(uint32_t hostInt, int32_t referenceDelta, uint16_t delay)
+static uint64_t touSTimestamp(sh2_t *pSh2, uint32_t hostInt, int32_t referenceDelta, uint16_t delay)
 {
-    static uint32_t lastHostInt = 0;
-    static uint32_t rollovers = 0;
     uint64_t timestamp;
 
     // Count times hostInt timestamps rolled over to produce upper bits
-    if (hostInt < lastHostInt) {
-        rollovers++;
+    if (hostInt < pSh2->lastHostInt) {
+        pSh2->hostIntRollovers++;
     }
-    lastHostInt = hostInt;
+    pSh2->lastHostInt = hostInt;
     
-    timestamp = ((uint64_t)rollovers << 32);
+    timestamp = ((uint64_t)pSh2->hostIntRollovers << 32);
     timestamp += hostInt + (referenceDelta + delay) * 100;
 
     return timestamp;
@@ -722,10 +872,21 @@ static void sensorhubInputHdlr(sh2_t *pSh2, uint8_t *payload, uint16_t len, uint
                 opRx(pSh2, payload+cursor, reportLen);
             }
             else {
-                // Sensor event.  Call callback
                 uint8_t *pReport = payload+cursor;
                 uint16_t delay = ((pReport[2] & 0xFC) << 6) + pReport[3];
-                event.timestamp_uS = touSTimestamp(timestamp, referenceDelta, delay);
+                uint64_t timestamp_uS = touSTimestamp(pSh2, timestamp, referenceDelta, delay);
+
+                // Decode straight into the batch sink if it takes this report.
+                if (pSh2->batchSink != 0) {
+                    if (sh2_batchPush(pSh2->batchSink, pReport, timestamp_uS)) {
+                        cursor += reportLen;
+                        continue;
+                    }
+                    pSh2->batchSink->passedOn++;
+                }
+
+                // Sensor event.  Call callback
+                event.timestamp_uS = timestamp_uS;
                 event.delay_uS = (referenceDelta + delay) * 100;
                 event.reportId = reportId;
                 memcpy(event.report, pReport, reportLen);
@@ -1861,6 +2022,10 @@ int sh2_open(sh2_Hal_t *pHal,
     // Clear everything in sh2 structure.
     memset(pSh2, 0, sizeof(sh2_t));
 
+    if (!sh2ReportLenByIdValid) {
+        initReportLens();
+    }
+
     // will go true after reset response from SH.
     pSh2->resetComplete = false;
     
@@ -1922,6 +2087,12 @@ void sh2_close(void)
         shtp_close(pSh2->pShtp);
     }
 
+    // Queued operations will not run
+    pSh2->pOp = 0;
+    while (pSh2->asyncCount != 0) {
+        asyncFinish(pSh2, SH2_ERR);
+    }
+
     // Clear everything in sh2 structure.
     memset(pSh2, 0, sizeof(sh2_t));
 }
@@ -1936,7 +2107,9 @@ void sh2_service(void)
     sh2_t *pSh2 = &_sh2;
 
     if (pSh2->pShtp != 0) {
+        asyncStartNext(pSh2);
         shtp_service(pSh2->pShtp);
+        asyncCheck(pSh2);
     }
 }
 
@@ -1957,6 +2130,39 @@ int sh2_setSensorCallback(sh2_SensorCallback_t *callback, void *cookie, const st
     return SH2_OK;
 }
 
+/**
+ * @brief Register a sink for batch decoding of sensor hub input.
+ *
+ * @param  sink Sink to fill, or 0 to restore the per-event path for all reports.
+ * @return SH2_OK (0), on success.  Negative value from sh2_err.h on error.
+ */
+int sh2_setBatchSink(sh2_BatchSink_t *sink)
+{
+    sh2_t *pSh2 = &_sh2;
+
+    pSh2->batchSink = sink;
+
+    return SH2_OK;
+}
+
+/**
+ * @brief Feed a sensor hub input channel payload through the SH2 input handler.
+ *
+ * @param  payload SHTP payload, without the SHTP header.
+ * @param  len Payload length in bytes.
+ * @param  timestamp Host timestamp of the payload [uS].
+ */
+void sh2_processInput(uint8_t *payload, uint16_t len, uint32_t timestamp)
+{
+    sh2_t *pSh2 = &_sh2;
+
+    if (!sh2ReportLenByIdValid) {
+        initReportLens();
+    }
+
+    sensorhubInputHdlr(pSh2, payload, len, timestamp);
+}
+
 /**
  * @brief Reset the sensor hub device by sending RESET (1) command on "device" channel.
  *
@@ -2020,7 +2226,7 @@ int sh2_getProdIds(sh2_ProductIds_t *prodIds)
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     pSh2->opData.getProdIds.pProdIds = prodIds;
 
@@ -2043,7 +2249,7 @@ int sh2_getSensorConfig(sh2_SensorId_t sensorId, sh2_SensorConfig_t *pConfig)
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     // Set up operation
     pSh2->opData.getSensorConfig.sensorId = sensorId;
@@ -2068,7 +2274,7 @@ int sh2_setSensorConfig(sh2_SensorId_t sensorId, const sh2_SensorConfig_t *pConf
     }
  
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     // Set up operation
     pSh2->opData.setSensorConfig.sensorId = sensorId;
@@ -2109,7 +2315,7 @@ int sh2_getMetadata(sh2_SensorId_t sensorId, sh2_SensorMetadata_t *pData)
     uint16_t recordId = sensorToRecordMap[i].recordId;
     
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     // Set up an FRS read operation
     pSh2->opData.getFrs.frsType = recordId;
@@ -2150,7 +2356,7 @@ int sh2_getFrs(uint16_t recordId, uint32_t *pData, uint16_t *words)
     }
     
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     // Store params for this op
     pSh2->opData.getFrs.frsType = recordId;
@@ -2181,7 +2387,7 @@ int sh2_setFrs(uint16_t recordId, uint32_t *pData, uint16_t words)
     }
     
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     pSh2->opData.setFrs.frsType = recordId;
     pSh2->opData.setFrs.pData = pData;
@@ -2207,7 +2413,7 @@ int sh2_getErrors(uint8_t severity, sh2_ErrorRecord_t *pErrors, uint16_t *numErr
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     pSh2->opData.getErrors.severity = severity;
     pSh2->opData.getErrors.pErrors = pErrors;
@@ -2232,7 +2438,7 @@ int sh2_getCounts(sh2_SensorId_t sensorId, sh2_Counts_t *pCounts)
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     pSh2->opData.getCounts.sensorId = sensorId;
     pSh2->opData.getCounts.pCounts = pCounts;
@@ -2240,6 +2446,30 @@ int sh2_getCounts(sh2_SensorId_t sensorId, sh2_Counts_t *pCounts)
     return opProcess(pSh2, &getCountsOp);
 }
 
+/**
+ * @brief Read the host side receive counters.
+ *
+ * Does not communicate with the sensor hub.
+ *
+ * @param  pStats Pointer to Stats structure that will receive data.
+ * @return SH2_OK (0), on success.  Negative value from sh2_err.h on error.
+ */
+int sh2_getStats(sh2_Stats_t *pStats)
+{
+    sh2_t *pSh2 = &_sh2;
+
+    if (pSh2->pShtp == 0) {
+        return SH2_ERR;  // sh2 API isn't open
+    }
+
+    pStats->execBadPayload = pSh2->execBadPayload;
+    pStats->emptyPayloads = pSh2->emptyPayloads;
+    pStats->unknownReportIds = pSh2->unknownReportIds;
+    shtp_getStats(pSh2->pShtp, &pStats->shtp);
+
+    return SH2_OK;
+}
+
 /**
  * @brief Clear counters related to a sensor.
  *
@@ -2255,7 +2485,7 @@ int sh2_clearCounts(sh2_SensorId_t sensorId)
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     
     pSh2->opData.sendCmd.req.command = SH2_CMD_COUNTS;
@@ -2282,7 +2512,7 @@ int sh2_setTareNow(uint8_t axes,    // SH2_TARE_X | SH2_TARE_Y | SH2_TARE_Z
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     
     pSh2->opData.sendCmd.req.command = SH2_CMD_TARE;
@@ -2307,7 +2537,7 @@ int sh2_clearTare(void)
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     
     pSh2->opData.sendCmd.req.command = SH2_CMD_TARE;
@@ -2330,7 +2560,7 @@ int sh2_persistTare(void)
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     
     pSh2->opData.sendCmd.req.command = SH2_CMD_TARE;
@@ -2354,7 +2584,7 @@ int sh2_setReorientation(sh2_Quaternion_t *orientation)
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     
     pSh2->opData.sendCmd.req.command = SH2_CMD_TARE;
@@ -2418,6 +2648,9 @@ int sh2_getOscType(sh2_OscType_t *pOscType)
         return SH2_ERR;  // sh2 API isn't open
     }
 
+    // clear opData
+    opDataReset(pSh2);
+
     pSh2->opData.getOscType.pOscType = pOscType;
 
     return opProcess(pSh2, &getOscTypeOp);
@@ -2437,6 +2670,9 @@ int sh2_setCalConfig(uint8_t sensors)
         return SH2_ERR;  // sh2 API isn't open
     }
 
+    // clear opData
+    opDataReset(pSh2);
+
     pSh2->opData.calConfig.sensors = sensors;
 
     return opProcess(pSh2, &setCalConfigOp);
@@ -2456,6 +2692,9 @@ int sh2_getCalConfig(uint8_t *pSensors)
         return SH2_ERR;  // sh2 API isn't open
     }
 
+    // clear opData
+    opDataReset(pSh2);
+
     pSh2->opData.getCalConfig.pSensors = pSensors;
 
     return opProcess(pSh2, &getCalConfigOp);
@@ -2476,7 +2715,7 @@ int sh2_setDcdAutoSave(bool enabled)
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     pSh2->opData.sendCmd.req.command = SH2_CMD_DCD_SAVE;
     pSh2->opData.sendCmd.req.p[0] = enabled ? 0 : 1;
@@ -2499,7 +2738,7 @@ int sh2_flush(sh2_SensorId_t sensorId)
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     pSh2->opData.forceFlush.sensorId = sensorId;
 
@@ -2537,7 +2776,7 @@ int sh2_startCal(uint32_t interval_us)
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     pSh2->opData.startCal.interval_us = interval_us;
 
@@ -2559,7 +2798,7 @@ int sh2_finishCal(sh2_CalStatus_t *status)
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     
     int retval = opProcess(pSh2, &finishCalOp);
     if (status != NULL) {
@@ -2584,7 +2823,7 @@ int sh2_setIZro(sh2_IZroMotionIntent_t intent)
     }
 
     // clear opData
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
 
     // set up opData for iZRO request
     pSh2->opData.sendCmd.req.command = SH2_CMD_INTERACTIVE_ZRO;
@@ -2604,7 +2843,7 @@ int sh2_reportWheelEncoder(uint8_t wheelIndex, uint32_t timestamp, int16_t wheel
 
     //No callback (am i doing this right?)
     pSh2->pOp = 0;
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     pSh2->opData.wheelRequest.wheelIndex = wheelIndex;
     pSh2->opData.wheelRequest.timestamp = timestamp;
     pSh2->opData.wheelRequest.wheelData = wheelData;
@@ -2620,8 +2859,212 @@ int sh2_saveDeadReckoningCalNow(void){
         return SH2_ERR;  // sh2 API isn't open
     }
 
-    memset(&pSh2->opData, 0, sizeof(sh2_OpData_t));
+    opDataReset(pSh2);
     pSh2->opData.sendCmd.req.command = SH2_CMD_DR_CAL_SAVE;
 
     return opProcess(pSh2, &sendCmdOp);
 }
+
+// ------------------------------------------------------------------------
+// Asynchronous API
+
+// Queue a command with no response, set up by the caller in opData.sendCmd.
+static sh2_AsyncOp_t *queueCmd(sh2_t *pSh2, uint8_t command,
+                               sh2_AsyncCallback_t *callback, void *cookie)
+{
+    sh2_AsyncOp_t *pAsync = asyncQueue(pSh2, &sendCmdOp, callback, cookie);
+
+    if (pAsync != 0) {
+        pAsync->opData.sendCmd.req.command = command;
+    }
+
+    return pAsync;
+}
+
+int sh2_setSensorConfigAsync(sh2_SensorId_t sensorId, const sh2_SensorConfig_t *pConfig,
+                             sh2_AsyncCallback_t *callback, void *cookie)
+{
+    sh2_t *pSh2 = &_sh2;
+    sh2_AsyncOp_t *pAsync;
+
+    if (pSh2->pShtp == 0) {
+        return SH2_ERR;  // sh2 API isn't open
+    }
+
+    pAsync = asyncQueue(pSh2, &setSensorConfigOp, callback, cookie);
+    if (pAsync == 0) {
+        return SH2_ERR_OP_IN_PROGRESS;
+    }
+
+    // The queue entry stays in place until the operation finishes
+    pAsync->config = *pConfig;
+    pAsync->opData.setSensorConfig.sensorId = sensorId;
+    pAsync->opData.setSensorConfig.pConfig = &pAsync->config;
+
+    return SH2_OK;
+}
+
+int sh2_setTareNowAsync(uint8_t axes, sh2_TareBasis_t basis,
+                        sh2_AsyncCallback_t *callback, void *cookie)
+{
+    sh2_t *pSh2 = &_sh2;
+    sh2_AsyncOp_t *pAsync;
+
+    if (pSh2->pShtp == 0) {
+        return SH2_ERR;  // sh2 API isn't open
+    }
+
+    pAsync = queueCmd(pSh2, SH2_CMD_TARE, callback, cookie);
+    if (pAsync == 0) {
+        return SH2_ERR_OP_IN_PROGRESS;
+    }
+
+    pAsync->opData.sendCmd.req.p[0] = SH2_TARE_TARE_NOW;
+    pAsync->opData.sendCmd.req.p[1] = axes;
+    pAsync->opData.sendCmd.req.p[2] = basis;
+
+    return SH2_OK;
+}
+
+int sh2_clearTareAsync(sh2_AsyncCallback_t *callback, void *cookie)
+{
+    sh2_t *pSh2 = &_sh2;
+    sh2_AsyncOp_t *pAsync;
+
+    if (pSh2->pShtp == 0) {
+        return SH2_ERR;  // sh2 API isn't open
+    }
+
+    pAsync = queueCmd(pSh2, SH2_CMD_TARE, callback, cookie);
+    if (pAsync == 0) {
+        return SH2_ERR_OP_IN_PROGRESS;
+    }
+
+    pAsync->opData.sendCmd.req.p[0] = SH2_TARE_SET_REORIENTATION;
+
+    return SH2_OK;
+}
+
+int sh2_persistTareAsync(sh2_AsyncCallback_t *callback, void *cookie)
+{
+    sh2_t *pSh2 = &_sh2;
+    sh2_AsyncOp_t *pAsync;
+
+    if (pSh2->pShtp == 0) {
+        return SH2_ERR;  // sh2 API isn't open
+    }
+
+    pAsync = queueCmd(pSh2, SH2_CMD_TARE, callback, cookie);
+    if (pAsync == 0) {
+        return SH2_ERR_OP_IN_PROGRESS;
+    }
+
+    pAsync->opData.sendCmd.req.p[0] = SH2_TARE_PERSIST_TARE;
+
+    return SH2_OK;
+}
+
+int sh2_setReorientationAsync(const sh2_Quaternion_t *orientation,
+                              sh2_AsyncCallback_t *callback, void *cookie)
+{
+    sh2_t *pSh2 = &_sh2;
+    sh2_AsyncOp_t *pAsync;
+
+    if (pSh2->pShtp == 0) {
+        return SH2_ERR;  // sh2 API isn't open
+    }
+
+    pAsync = queueCmd(pSh2, SH2_CMD_TARE, callback, cookie);
+    if (pAsync == 0) {
+        return SH2_ERR_OP_IN_PROGRESS;
+    }
+
+    uint8_t *p = pAsync->opData.sendCmd.req.p;
+
+    p[0] = SH2_TARE_SET_REORIENTATION;
+    writeu16(&p[1], toQ14(orientation->x));
+    writeu16(&p[3], toQ14(orientation->y));
+    writeu16(&p[5], toQ14(orientation->z));
+    writeu16(&p[7], toQ14(orientation->w));
+
+    return SH2_OK;
+}
+
+int sh2_setCalConfigAsync(uint8_t sensors, sh2_AsyncCallback_t *callback, void *cookie)
+{
+    sh2_t *pSh2 = &_sh2;
+    sh2_AsyncOp_t *pAsync;
+
+    if (pSh2->pShtp == 0) {
+        return SH2_ERR;  // sh2 API isn't open
+    }
+
+    pAsync = asyncQueue(pSh2, &setCalConfigOp, callback, cookie);
+    if (pAsync == 0) {
+        return SH2_ERR_OP_IN_PROGRESS;
+    }
+
+    pAsync->opData.calConfig.sensors = sensors;
+
+    return SH2_OK;
+}
+
+int sh2_setDcdAutoSaveAsync(bool enabled, sh2_AsyncCallback_t *callback, void *cookie)
+{
+    sh2_t *pSh2 = &_sh2;
+    sh2_AsyncOp_t *pAsync;
+
+    if (pSh2->pShtp == 0) {
+        return SH2_ERR;  // sh2 API isn't open
+    }
+
+    pAsync = queueCmd(pSh2, SH2_CMD_DCD_SAVE, callback, cookie);
+    if (pAsync == 0) {
+        return SH2_ERR_OP_IN_PROGRESS;
+    }
+
+    pAsync->opData.sendCmd.req.p[0] = enabled ? 0 : 1;
+
+    return SH2_OK;
+}
+
+int sh2_saveDcdNowAsync(sh2_AsyncCallback_t *callback, void *cookie)
+{
+    sh2_t *pSh2 = &_sh2;
+
+    if (pSh2->pShtp == 0) {
+        return SH2_ERR;  // sh2 API isn't open
+    }
+
+    if (asyncQueue(pSh2, &saveDcdNowOp, callback, cookie) == 0) {
+        return SH2_ERR_OP_IN_PROGRESS;
+    }
+
+    return SH2_OK;
+}
+
+int sh2_getCountsAsync(sh2_SensorId_t sensorId, sh2_Counts_t *pCounts,
+                       sh2_AsyncCallback_t *callback, void *cookie)
+{
+    sh2_t *pSh2 = &_sh2;
+    sh2_AsyncOp_t *pAsync;
+
+    if (pSh2->pShtp == 0) {
+        return SH2_ERR;  // sh2 API isn't open
+    }
+
+    pAsync = asyncQueue(pSh2, &getCountsOp, callback, cookie);
+    if (pAsync == 0) {
+        return SH2_ERR_OP_IN_PROGRESS;
+    }
+
+    pAsync->opData.getCounts.sensorId = sensorId;
+    pAsync->opData.getCounts.pCounts = pCounts;
+
+    return SH2_OK;
+}
+
+int sh2_asyncPending(void)
+{
+    return _sh2.asyncCount;
+}
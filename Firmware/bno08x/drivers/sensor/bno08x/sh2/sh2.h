@@ -32,6 +32,7 @@
 #include <zephyr/device.h>
 
 #include "sh2_hal.h"
+#include "shtp.h"
 
 /***************************************************************************************
  * Public type definitions
@@ -220,6 +221,18 @@ typedef struct sh2_Counts {
     uint32_t attempted; /**< @brief [events] */
 } sh2_Counts_t;
 
+/**
+ * @brief Host side receive counters
+ *
+ * Counted since sh2_open().
+ */
+typedef struct sh2_Stats {
+    uint32_t execBadPayload;    /**< @brief Malformed executable channel payloads */
+    uint32_t emptyPayloads;     /**< @brief Zero length sensor hub payloads */
+    uint32_t unknownReportIds;  /**< @brief Reports with an unrecognised id */
+    shtp_Stats_t shtp;          /**< @brief Transport counters */
+} sh2_Stats_t;
+
 /**
  * @brief Values for specifying tare basis
  *
@@ -441,6 +454,21 @@ typedef struct sh2_AsyncEvent {
 
 typedef void (sh2_EventCallback_t)(void * cookie, sh2_AsyncEvent_t *pEvent);
 
+/**
+ * @brief Completion callback of an asynchronous operation
+ *
+ * @param  cookie Value passed when the operation was queued.
+ * @param  status SH2_OK (0), on success.  Negative value from sh2_err.h on error.
+ */
+typedef void (sh2_AsyncCallback_t)(void * cookie, int status);
+
+// Number of asynchronous operations that can be queued
+#ifdef CONFIG_BNO08X_SH2_ASYNC_QUEUE_LEN
+#define SH2_ASYNC_QUEUE_LEN (CONFIG_BNO08X_SH2_ASYNC_QUEUE_LEN)
+#else
+#define SH2_ASYNC_QUEUE_LEN (8)
+#endif
+
 
 /***************************************************************************************
  * Public API
@@ -586,6 +614,16 @@ int sh2_getErrors(uint8_t severity, sh2_ErrorRecord_t *pErrors, uint16_t *numErr
  */
 int sh2_getCounts(sh2_SensorId_t sensorId, sh2_Counts_t *pCounts);
 
+/**
+ * @brief Read the host side receive counters.
+ *
+ * Does not communicate with the sensor hub.
+ *
+ * @param  pStats Pointer to Stats structure that will receive data.
+ * @return SH2_OK (0), on success.  Negative value from sh2_err.h on error.
+ */
+int sh2_getStats(sh2_Stats_t *pStats);
+
 /**
  * @brief Clear counters related to a sensor.
  *
@@ -743,4 +781,115 @@ int sh2_reportWheelEncoder(uint8_t wheelIndex, uint32_t timestamp, int16_t wheel
  */
 int sh2_saveDeadReckoningCalNow(void);
 
+/***************************************************************************************
+ * Asynchronous API
+ *
+ * These functions queue an operation and return without waiting for the hub.
+ * Queued operations are started one at a time by sh2_service(), between
+ * reads of sensor reports, and callback is called with the result from
+ * sh2_service() (or from a blocking call that has to wait for the operation
+ * in progress).  Like the rest of the API, they must be called from the
+ * thread that calls sh2_service().  callback may be 0.
+ **************************************************************************************/
+
+/**
+ * @brief Queue a sensor configuration change.
+ *
+ * @param  sensorId Which sensor to configure.
+ * @param  pConfig Sensor configuration, copied before this returns.
+ * @param  callback Called when the configuration has been sent.
+ * @param  cookie Passed to callback.
+ * @return SH2_OK (0), on success.  SH2_ERR_OP_IN_PROGRESS if the queue is full.
+ */
+int sh2_setSensorConfigAsync(sh2_SensorId_t sensorId, const sh2_SensorConfig_t *pConfig,
+                             sh2_AsyncCallback_t *callback, void *cookie);
+
+/**
+ * @brief Queue a tare operation on one or more axes.
+ *
+ * @param  axes Bit mask specifying which axes should be tared.
+ * @param  basis Which rotation vector to use as the basis for Tare adjustment.
+ * @param  callback Called when the command has been sent.
+ * @param  cookie Passed to callback.
+ * @return SH2_OK (0), on success.  SH2_ERR_OP_IN_PROGRESS if the queue is full.
+ */
+int sh2_setTareNowAsync(uint8_t axes, sh2_TareBasis_t basis,
+                        sh2_AsyncCallback_t *callback, void *cookie);
+
+/**
+ * @brief Queue clearing the previously applied tare operation.
+ *
+ * @param  callback Called when the command has been sent.
+ * @param  cookie Passed to callback.
+ * @return SH2_OK (0), on success.  SH2_ERR_OP_IN_PROGRESS if the queue is full.
+ */
+int sh2_clearTareAsync(sh2_AsyncCallback_t *callback, void *cookie);
+
+/**
+ * @brief Queue persisting the results of last tare operation to flash.
+ *
+ * @param  callback Called when the command has been sent.
+ * @param  cookie Passed to callback.
+ * @return SH2_OK (0), on success.  SH2_ERR_OP_IN_PROGRESS if the queue is full.
+ */
+int sh2_persistTareAsync(sh2_AsyncCallback_t *callback, void *cookie);
+
+/**
+ * @brief Queue setting the run-time sensor reorientation.
+ *
+ * @param  orientation Quaternion rotation vector to apply as new tare, copied
+ *         before this returns.
+ * @param  callback Called when the command has been sent.
+ * @param  cookie Passed to callback.
+ * @return SH2_OK (0), on success.  SH2_ERR_OP_IN_PROGRESS if the queue is full.
+ */
+int sh2_setReorientationAsync(const sh2_Quaternion_t *orientation,
+                              sh2_AsyncCallback_t *callback, void *cookie);
+
+/**
+ * @brief Queue a change of the dynamic calibration configuration.
+ *
+ * @param  sensors Bit mask of sensors to calibrate, SH2_CAL_ACCEL etc.
+ * @param  callback Called when the hub has answered.
+ * @param  cookie Passed to callback.
+ * @return SH2_OK (0), on success.  SH2_ERR_OP_IN_PROGRESS if the queue is full.
+ */
+int sh2_setCalConfigAsync(uint8_t sensors, sh2_AsyncCallback_t *callback, void *cookie);
+
+/**
+ * @brief Queue enabling or disabling periodic DCD auto-save.
+ *
+ * @param  enabled Enable or disable DCD auto-save.
+ * @param  callback Called when the command has been sent.
+ * @param  cookie Passed to callback.
+ * @return SH2_OK (0), on success.  SH2_ERR_OP_IN_PROGRESS if the queue is full.
+ */
+int sh2_setDcdAutoSaveAsync(bool enabled, sh2_AsyncCallback_t *callback, void *cookie);
+
+/**
+ * @brief Queue saving Dynamic Calibration Data to flash.
+ *
+ * @param  callback Called when the hub has answered.
+ * @param  cookie Passed to callback.
+ * @return SH2_OK (0), on success.  SH2_ERR_OP_IN_PROGRESS if the queue is full.
+ */
+int sh2_saveDcdNowAsync(sh2_AsyncCallback_t *callback, void *cookie);
+
+/**
+ * @brief Queue reading counters related to a sensor.
+ *
+ * @param  sensorId Which sensor to operate on.
+ * @param  pCounts Receives the counts, must stay valid until callback is called.
+ * @param  callback Called when the hub has answered.
+ * @param  cookie Passed to callback.
+ * @return SH2_OK (0), on success.  SH2_ERR_OP_IN_PROGRESS if the queue is full.
+ */
+int sh2_getCountsAsync(sh2_SensorId_t sensorId, sh2_Counts_t *pCounts,
+                       sh2_AsyncCallback_t *callback, void *cookie);
+
+/**
+ * @brief Number of asynchronous operations queued or in progress.
+ */
+int sh2_asyncPending(void);
+
 #endif
@@ -29,6 +29,11 @@
 
 const float scaleRadToDeg = 180.0f / 3.14159265358f;
 
+// Scale factors from sensor metadata, by sensor id.  Zero where none has
+// been set; the decoders then use the Q points from the reference manual.
+static float scaleQ1[SH2_MAX_SENSOR_ID + 1];
+static float scaleQ2[SH2_MAX_SENSOR_ID + 1];
+
 // ------------------------------------------------------------------------
 // Forward declarations
 
@@ -77,6 +82,30 @@ static int decodeWheelEncoder(sh2_SensorValue_t *value, const sh2_SensorEvent_t
 // ------------------------------------------------------------------------
 // Public API
 
+void sh2_setQPoints(sh2_SensorId_t sensorId, uint16_t qPoint1, uint16_t qPoint2)
+{
+    if (sensorId > SH2_MAX_SENSOR_ID) {
+        return;
+    }
+
+    scaleQ1[sensorId] = (qPoint1 < 31) ? SCALE_Q(qPoint1) : 0.0f;
+    scaleQ2[sensorId] = (qPoint2 < 31) ? SCALE_Q(qPoint2) : 0.0f;
+}
+
+float sh2_scaleQ1(sh2_SensorId_t sensorId, uint8_t qDefault)
+{
+    float scale = (sensorId <= SH2_MAX_SENSOR_ID) ? scaleQ1[sensorId] : 0.0f;
+
+    return (scale != 0.0f) ? scale : SCALE_Q(qDefault);
+}
+
+float sh2_scaleQ2(sh2_SensorId_t sensorId, uint8_t qDefault)
+{
+    float scale = (sensorId <= SH2_MAX_SENSOR_ID) ? scaleQ2[sensorId] : 0.0f;
+
+    return (scale != 0.0f) ? scale : SCALE_Q(qDefault);
+}
+
 int sh2_decodeSensorEvent(sh2_SensorValue_t *value, const sh2_SensorEvent_t *event)
 {
     // Fill out fields of *value based on *event, converting data from message representation
@@ -247,27 +276,33 @@ static int decodeRawAccelerometer(sh2_SensorValue_t *value, const sh2_SensorEven
 
 static int decodeAccelerometer(sh2_SensorValue_t *value, const sh2_SensorEvent_t *event)
 {
-    value->un.accelerometer.x = read16(&event->report[4]) * SCALE_Q(8);
-    value->un.accelerometer.y = read16(&event->report[6]) * SCALE_Q(8);
-    value->un.accelerometer.z = read16(&event->report[8]) * SCALE_Q(8);
+    float scale = sh2_scaleQ1(event->reportId, 8);
+
+    value->un.accelerometer.x = read16(&event->report[4]) * scale;
+    value->un.accelerometer.y = read16(&event->report[6]) * scale;
+    value->un.accelerometer.z = read16(&event->report[8]) * scale;
 
     return SH2_OK;
 }
 
 static int decodeLinearAcceleration(sh2_SensorValue_t *value, const sh2_SensorEvent_t *event)
 {
-    value->un.linearAcceleration.x = read16(&event->report[4]) * SCALE_Q(8);
-    value->un.linearAcceleration.y = read16(&event->report[6]) * SCALE_Q(8);
-    value->un.linearAcceleration.z = read16(&event->report[8]) * SCALE_Q(8);
+    float scale = sh2_scaleQ1(event->reportId, 8);
+
+    value->un.linearAcceleration.x = read16(&event->report[4]) * scale;
+    value->un.linearAcceleration.y = read16(&event->report[6]) * scale;
+    value->un.linearAcceleration.z = read16(&event->report[8]) * scale;
 
     return SH2_OK;
 }
 
 static int decodeGravity(sh2_SensorValue_t *value, const sh2_SensorEvent_t *event)
 {
-    value->un.gravity.x = read16(&event->report[4]) * SCALE_Q(8);
-    value->un.gravity.y = read16(&event->report[6]) * SCALE_Q(8);
-    value->un.gravity.z = read16(&event->report[8]) * SCALE_Q(8);
+    float scale = sh2_scaleQ1(event->reportId, 8);
+
+    value->un.gravity.x = read16(&event->report[4]) * scale;
+    value->un.gravity.y = read16(&event->report[6]) * scale;
+    value->un.gravity.z = read16(&event->report[8]) * scale;
 
     return SH2_OK;
 }
@@ -285,22 +320,27 @@ static int decodeRawGyroscope(sh2_SensorValue_t *value, const sh2_SensorEvent_t
 
 static int decodeGyroscopeCalibrated(sh2_SensorValue_t *value, const sh2_SensorEvent_t *event)
 {
-    value->un.gyroscope.x = read16(&event->report[4]) * SCALE_Q(9);
-    value->un.gyroscope.y = read16(&event->report[6]) * SCALE_Q(9);
-    value->un.gyroscope.z = read16(&event->report[8]) * SCALE_Q(9);
+    float scale = sh2_scaleQ1(event->reportId, 9);
+
+    value->un.gyroscope.x = read16(&event->report[4]) * scale;
+    value->un.gyroscope.y = read16(&event->report[6]) * scale;
+    value->un.gyroscope.z = read16(&event->report[8]) * scale;
 
     return SH2_OK;
 }
 
 static int decodeGyroscopeUncal(sh2_SensorValue_t *value, const sh2_SensorEvent_t *event)
 {
-    value->un.gyroscopeUncal.x = read16(&event->report[4]) * SCALE_Q(9);
-    value->un.gyroscopeUncal.y = read16(&event->report[6]) * SCALE_Q(9);
-    value->un.gyroscopeUncal.z = read16(&event->report[8]) * SCALE_Q(9);
+    float scale = sh2_scaleQ1(event->reportId, 9);
+    float scale2 = sh2_scaleQ2(event->reportId, 9);
 
-    value->un.gyroscopeUncal.biasX = read16(&event->report[10]) * SCALE_Q(9);
-    value->un.gyroscopeUncal.biasY = read16(&event->report[12]) * SCALE_Q(9);
-    value->un.gyroscopeUncal.biasZ = read16(&event->report[14]) * SCALE_Q(9);
+    value->un.gyroscopeUncal.x = read16(&event->report[4]) * scale;
+    value->un.gyroscopeUncal.y = read16(&event->report[6]) * scale;
+    value->un.gyroscopeUncal.z = read16(&event->report[8]) * scale;
+
+    value->un.gyroscopeUncal.biasX = read16(&event->report[10]) * scale2;
+    value->un.gyroscopeUncal.biasY = read16(&event->report[12]) * scale2;
+    value->un.gyroscopeUncal.biasZ = read16(&event->report[14]) * scale2;
 
     return SH2_OK;
 }
@@ -317,54 +357,67 @@ static int decodeRawMagnetometer(sh2_SensorValue_t *value, const sh2_SensorEvent
 
 static int decodeMagneticFieldCalibrated(sh2_SensorValue_t *value, const sh2_SensorEvent_t *event)
 {
-    value->un.magneticField.x = read16(&event->report[4]) * SCALE_Q(4);
-    value->un.magneticField.y = read16(&event->report[6]) * SCALE_Q(4);
-    value->un.magneticField.z = read16(&event->report[8]) * SCALE_Q(4);
+    float scale = sh2_scaleQ1(event->reportId, 4);
+
+    value->un.magneticField.x = read16(&event->report[4]) * scale;
+    value->un.magneticField.y = read16(&event->report[6]) * scale;
+    value->un.magneticField.z = read16(&event->report[8]) * scale;
 
     return SH2_OK;
 }
 
 static int decodeMagneticFieldUncal(sh2_SensorValue_t *value, const sh2_SensorEvent_t *event)
 {
-    value->un.magneticFieldUncal.x = read16(&event->report[4]) * SCALE_Q(4);
-    value->un.magneticFieldUncal.y = read16(&event->report[6]) * SCALE_Q(4);
-    value->un.magneticFieldUncal.z = read16(&event->report[8]) * SCALE_Q(4);
+    float scale = sh2_scaleQ1(event->reportId, 4);
+    float scale2 = sh2_scaleQ2(event->reportId, 4);
+
+    value->un.magneticFieldUncal.x = read16(&event->report[4]) * scale;
+    value->un.magneticFieldUncal.y = read16(&event->report[6]) * scale;
+    value->un.magneticFieldUncal.z = read16(&event->report[8]) * scale;
 
-    value->un.magneticFieldUncal.biasX = read16(&event->report[10]) * SCALE_Q(4);
-    value->un.magneticFieldUncal.biasY = read16(&event->report[12]) * SCALE_Q(4);
-    value->un.magneticFieldUncal.biasZ = read16(&event->report[14]) * SCALE_Q(4);
+    value->un.magneticFieldUncal.biasX = read16(&event->report[10]) * scale2;
+    value->un.magneticFieldUncal.biasY = read16(&event->report[12]) * scale2;
+    value->un.magneticFieldUncal.biasZ = read16(&event->report[14]) * scale2;
 
     return SH2_OK;
 }
 
 static int decodeRotationVector(sh2_SensorValue_t *value, const sh2_SensorEvent_t *event)
 {
-    value->un.rotationVector.i = read16(&event->report[4]) * SCALE_Q(14);
-    value->un.rotationVector.j = read16(&event->report[6]) * SCALE_Q(14);
-    value->un.rotationVector.k = read16(&event->report[8]) * SCALE_Q(14);
-    value->un.rotationVector.real = read16(&event->report[10]) * SCALE_Q(14);
-    value->un.rotationVector.accuracy = read16(&event->report[12]) * SCALE_Q(12);
+    float scale = sh2_scaleQ1(event->reportId, 14);
+    float scale2 = sh2_scaleQ2(event->reportId, 12);
+
+    value->un.rotationVector.i = read16(&event->report[4]) * scale;
+    value->un.rotationVector.j = read16(&event->report[6]) * scale;
+    value->un.rotationVector.k = read16(&event->report[8]) * scale;
+    value->un.rotationVector.real = read16(&event->report[10]) * scale;
+    value->un.rotationVector.accuracy = read16(&event->report[12]) * scale2;
 
     return SH2_OK;
 }
 
 static int decodeGameRotationVector(sh2_SensorValue_t *value, const sh2_SensorEvent_t *event)
 {
-    value->un.gameRotationVector.i = read16(&event->report[4]) * SCALE_Q(14);
-    value->un.gameRotationVector.j = read16(&event->report[6]) * SCALE_Q(14);
-    value->un.gameRotationVector.k = read16(&event->report[8]) * SCALE_Q(14);
-    value->un.gameRotationVector.real = read16(&event->report[10]) * SCALE_Q(14);
+    float scale = sh2_scaleQ1(event->reportId, 14);
+
+    value->un.gameRotationVector.i = read16(&event->report[4]) * scale;
+    value->un.gameRotationVector.j = read16(&event->report[6]) * scale;
+    value->un.gameRotationVector.k = read16(&event->report[8]) * scale;
+    value->un.gameRotationVector.real = read16(&event->report[10]) * scale;
 
     return SH2_OK;
 }
 
 static int decodeGeomagneticRotationVector(sh2_SensorValue_t *value, const sh2_SensorEvent_t *event)
 {
-    value->un.geoMagRotationVector.i = read16(&event->report[4]) * SCALE_Q(14);
-    value->un.geoMagRotationVector.j = read16(&event->report[6]) * SCALE_Q(14);
-    value->un.geoMagRotationVector.k = read16(&event->report[8]) * SCALE_Q(14);
-    value->un.geoMagRotationVector.real = read16(&event->report[10]) * SCALE_Q(14);
-    value->un.geoMagRotationVector.accuracy = read16(&event->report[12]) * SCALE_Q(12);
+    float scale = sh2_scaleQ1(event->reportId, 14);
+    float scale2 = sh2_scaleQ2(event->reportId, 12);
+
+    value->un.geoMagRotationVector.i = read16(&event->report[4]) * scale;
+    value->un.geoMagRotationVector.j = read16(&event->report[6]) * scale;
+    value->un.geoMagRotationVector.k = read16(&event->report[8]) * scale;
+    value->un.geoMagRotationVector.real = read16(&event->report[10]) * scale;
+    value->un.geoMagRotationVector.accuracy = read16(&event->report[12]) * scale2;
 
     return SH2_OK;
 }
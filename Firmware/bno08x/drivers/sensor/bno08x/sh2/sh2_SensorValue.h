@@ -542,4 +542,32 @@ typedef struct sh2_SensorValue {
 
 int sh2_decodeSensorEvent(sh2_SensorValue_t *value, const sh2_SensorEvent_t *event);
 
+/**
+ * @brief Decode a sensor's reports with the Q points from its metadata.
+ *
+ * Until this is called for a sensor, its reports are decoded with the
+ * Q points listed in the SH-2 Reference Manual.
+ *
+ * @param  sensorId Sensor to configure.
+ * @param  qPoint1 Q point of the sensor values (sh2_SensorMetadata_t.qPoint1).
+ * @param  qPoint2 Q point of accuracy or bias fields (sh2_SensorMetadata_t.qPoint2).
+ */
+void sh2_setQPoints(sh2_SensorId_t sensorId, uint16_t qPoint1, uint16_t qPoint2);
+
+/**
+ * @brief Scale factor of a sensor's values, 2^-qPoint1.
+ *
+ * @param  sensorId Sensor.
+ * @param  qDefault Q point to use if none was set with sh2_setQPoints().
+ */
+float sh2_scaleQ1(sh2_SensorId_t sensorId, uint8_t qDefault);
+
+/**
+ * @brief Scale factor of a sensor's accuracy or bias fields, 2^-qPoint2.
+ *
+ * @param  sensorId Sensor.
+ * @param  qDefault Q point to use if none was set with sh2_setQPoints().
+ */
+float sh2_scaleQ2(sh2_SensorId_t sensorId, uint8_t qDefault);
+
 #endif
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * One-pass batch decoding of sensor hub input reports into SoA rings
+ */
+
+#include "sh2_batch.h"
+#include "sh2_util.h"
+#include "sh2_SensorValue.h"
+
+#include <stddef.h>
+
+// ------------------------------------------------------------------------
+// Private types
+
+typedef enum {
+    BATCH_NONE = 0,
+    BATCH_VEC3,         // x, y, z at report offset 4
+    BATCH_QUAT,         // i, j, k, real at report offset 4
+    BATCH_QUAT_ACC,     // i, j, k, real, accuracy at report offset 4
+} batchKind_t;
+
+typedef struct {
+    uint8_t kind;       // batchKind_t
+    uint8_t qPoint;     // Q point of the sensor values, unless set from metadata
+    uint16_t ring;      // offset of the ring within sh2_BatchSink_t
+} batchDesc_t;
+
+#define VEC3(member, q)     { BATCH_VEC3, q, offsetof(sh2_BatchSink_t, member) }
+#define QUAT(member)        { BATCH_QUAT, 14, offsetof(sh2_BatchSink_t, member) }
+#define QUAT_ACC(member)    { BATCH_QUAT_ACC, 14, offsetof(sh2_BatchSink_t, member) }
+
+// ------------------------------------------------------------------------
+// Private data
+
+// Batch descriptors by report id.  Entries left zero are not batched.
+static const batchDesc_t batchDesc[256] = {
+    [SH2_ACCELEROMETER]             = VEC3(accelerometer, 8),
+    [SH2_GYROSCOPE_CALIBRATED]      = VEC3(gyroscope, 9),
+    [SH2_MAGNETIC_FIELD_CALIBRATED] = VEC3(magneticField, 4),
+    [SH2_LINEAR_ACCELERATION]       = VEC3(linearAcceleration, 8),
+    [SH2_GRAVITY]                   = VEC3(gravity, 8),
+    [SH2_ROTATION_VECTOR]           = QUAT_ACC(rotationVector),
+    [SH2_GAME_ROTATION_VECTOR]      = QUAT(gameRotationVector),
+    [SH2_RAW_ACCELEROMETER]         = VEC3(rawAccelerometer, 0),
+    [SH2_RAW_GYROSCOPE]             = VEC3(rawGyroscope, 0),
+    [SH2_RAW_MAGNETOMETER]          = VEC3(rawMagnetometer, 0),
+};
+
+// ------------------------------------------------------------------------
+// Private functions
+
+// Claim the next slot of a ring, dropping the oldest sample if it is full.
+static uint32_t claimSlot(uint32_t *head, uint32_t *tail, uint32_t *overruns)
+{
+    if ((*head - *tail) >= SH2_BATCH_RING_LEN) {
+        (*tail)++;
+        (*overruns)++;
+    }
+
+    return (*head)++ & SH2_BATCH_RING_MASK;
+}
+
+static void pushVec3(sh2_Vec3Ring_t *ring, const uint8_t *report, float scale, uint64_t t_uS)
+{
+    uint32_t n = claimSlot(&ring->head, &ring->tail, &ring->overruns);
+
+    ring->timestamp_uS[n] = t_uS;
+    ring->sequence[n] = report[1];
+    ring->status[n] = report[2] & 0x03;
+    ring->x[n] = read16(&report[4]) * scale;
+    ring->y[n] = read16(&report[6]) * scale;
+    ring->z[n] = read16(&report[8]) * scale;
+}
+
+static void pushQuat(sh2_QuatRing_t *ring, const uint8_t *report, bool withAccuracy, uint64_t t_uS)
+{
+    uint32_t n = claimSlot(&ring->head, &ring->tail, &ring->overruns);
+    float scale = sh2_scaleQ1(report[0], 14);
+
+    ring->timestamp_uS[n] = t_uS;
+    ring->sequence[n] = report[1];
+    ring->status[n] = report[2] & 0x03;
+    ring->i[n] = read16(&report[4]) * scale;
+    ring->j[n] = read16(&report[6]) * scale;
+    ring->k[n] = read16(&report[8]) * scale;
+    ring->real[n] = read16(&report[10]) * scale;
+    ring->accuracy[n] = withAccuracy ? read16(&report[12]) * sh2_scaleQ2(report[0], 12) : 0.0f;
+}
+
+// ------------------------------------------------------------------------
+// Public functions
+
+bool sh2_batchPush(sh2_BatchSink_t *sink, const uint8_t *report, uint64_t timestamp_uS)
+{
+    const batchDesc_t *desc = &batchDesc[report[0]];
+    void *ring = (uint8_t *)sink + desc->ring;
+
+    switch (desc->kind) {
+        case BATCH_VEC3:
+            pushVec3((sh2_Vec3Ring_t *)ring, report, sh2_scaleQ1(report[0], desc->qPoint), timestamp_uS);
+            break;
+        case BATCH_QUAT:
+            pushQuat((sh2_QuatRing_t *)ring, report, false, timestamp_uS);
+            break;
+        case BATCH_QUAT_ACC:
+            pushQuat((sh2_QuatRing_t *)ring, report, true, timestamp_uS);
+            break;
+        default:
+            return false;
+    }
+
+    sink->reports++;
+    return true;
+}
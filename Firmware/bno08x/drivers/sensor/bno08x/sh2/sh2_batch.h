@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file sh2_batch.h
+ * @brief One-pass batch decoding of sensor hub input payloads.
+ *
+ * The regular SH2 input path copies every report into an sh2_SensorEvent_t,
+ * hands it to the sensor callback and decodes it through
+ * sh2_decodeSensorEvent().  The batch path instead looks each report up in a
+ * table indexed by report id and writes the decoded values straight into
+ * per-sensor struct-of-arrays ring buffers held by an sh2_BatchSink_t.
+ *
+ * Reports without a ring in the sink (detectors, command responses, ...) are
+ * still delivered through the regular sensor callback.
+ *
+ * The rings are single-producer/single-consumer and are not locked.  The
+ * producer is sh2_service() (via the SHTP input handler); consumers must run
+ * in the same thread or be otherwise serialised against it.
+ */
+
+#ifndef SH2_BATCH_H
+#define SH2_BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sh2.h"
+
+// Number of samples held per sensor ring.  Must be a power of two.
+#define SH2_BATCH_RING_LEN (32)
+#define SH2_BATCH_RING_MASK (SH2_BATCH_RING_LEN - 1)
+
+/**
+ * @brief Three axis sensor ring (accelerometer, gyroscope, magnetometer)
+ */
+typedef struct sh2_Vec3Ring {
+    uint32_t head;       /**< @brief Next slot written by the producer */
+    uint32_t tail;       /**< @brief Next slot read by the consumer */
+    uint32_t overruns;   /**< @brief Samples dropped because the ring was full */
+    uint64_t timestamp_uS[SH2_BATCH_RING_LEN];
+    float x[SH2_BATCH_RING_LEN];
+    float y[SH2_BATCH_RING_LEN];
+    float z[SH2_BATCH_RING_LEN];
+    uint8_t status[SH2_BATCH_RING_LEN];
+    uint8_t sequence[SH2_BATCH_RING_LEN];
+} sh2_Vec3Ring_t;
+
+/**
+ * @brief Rotation vector ring
+ *
+ * accuracy is only meaningful for reports that carry one; it is zero otherwise.
+ */
+typedef struct sh2_QuatRing {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t overruns;
+    uint64_t timestamp_uS[SH2_BATCH_RING_LEN];
+    float i[SH2_BATCH_RING_LEN];
+    float j[SH2_BATCH_RING_LEN];
+    float k[SH2_BATCH_RING_LEN];
+    float real[SH2_BATCH_RING_LEN];
+    float accuracy[SH2_BATCH_RING_LEN];
+    uint8_t status[SH2_BATCH_RING_LEN];
+    uint8_t sequence[SH2_BATCH_RING_LEN];
+} sh2_QuatRing_t;
+
+/**
+ * @brief Destination for batch decoded reports
+ */
+typedef struct sh2_BatchSink {
+    sh2_Vec3Ring_t accelerometer;   /**< @brief SH2_ACCELEROMETER [m/s^2] */
+    sh2_Vec3Ring_t gyroscope;       /**< @brief SH2_GYROSCOPE_CALIBRATED [rad/s] */
+    sh2_Vec3Ring_t magneticField;   /**< @brief SH2_MAGNETIC_FIELD_CALIBRATED [uTesla] */
+    sh2_Vec3Ring_t linearAcceleration; /**< @brief SH2_LINEAR_ACCELERATION [m/s^2] */
+    sh2_Vec3Ring_t gravity;         /**< @brief SH2_GRAVITY [m/s^2] */
+    sh2_QuatRing_t rotationVector;  /**< @brief SH2_ROTATION_VECTOR */
+    sh2_QuatRing_t gameRotationVector; /**< @brief SH2_GAME_ROTATION_VECTOR */
+    sh2_Vec3Ring_t rawAccelerometer; /**< @brief SH2_RAW_ACCELEROMETER [ADC counts] */
+    sh2_Vec3Ring_t rawGyroscope;    /**< @brief SH2_RAW_GYROSCOPE [ADC counts] */
+    sh2_Vec3Ring_t rawMagnetometer; /**< @brief SH2_RAW_MAGNETOMETER [ADC counts] */
+
+    uint32_t reports;     /**< @brief Reports written into rings */
+    uint32_t passedOn;    /**< @brief Reports handed to the sensor callback */
+} sh2_BatchSink_t;
+
+/**
+ * @brief Register a sink for batch decoding of sensor hub input.
+ *
+ * While a sink is registered, reports it has a ring for are decoded straight
+ * into it and are no longer passed to the sensor callback.
+ *
+ * @param  sink Sink to fill, or 0 to restore the per-event path for all reports.
+ * @return SH2_OK (0), on success.  Negative value from sh2_err.h on error.
+ */
+int sh2_setBatchSink(sh2_BatchSink_t *sink);
+
+/**
+ * @brief Decode one report into a sink.
+ *
+ * @param  sink Destination rings.
+ * @param  report Pointer to the report, starting with its report id.
+ * @param  timestamp_uS Timestamp to store with the sample.
+ * @return true if the report was consumed, false if the sink has no ring for it.
+ */
+bool sh2_batchPush(sh2_BatchSink_t *sink, const uint8_t *report, uint64_t timestamp_uS);
+
+/**
+ * @brief Feed a sensor hub input channel payload through the SH2 input handler.
+ *
+ * The payload is processed exactly as if it had arrived from the hub on the
+ * normal input channel.  Intended for replay and benchmarking.
+ *
+ * @param  payload SHTP payload, without the SHTP header.
+ * @param  len Payload length in bytes.
+ * @param  timestamp Host timestamp of the payload [uS].
+ */
+void sh2_processInput(uint8_t *payload, uint16_t len, uint32_t timestamp);
+
+/**
+ * @brief Number of samples waiting in a ring.
+ */
+static inline uint32_t sh2_batchAvailable(uint32_t head, uint32_t tail)
+{
+    return head - tail;
+}
+
+/**
+ * @brief Index of the most recently written sample in a ring.
+ *
+ * Only valid if at least one sample has ever been written (head != 0).
+ */
+static inline uint32_t sh2_batchLatest(uint32_t head)
+{
+    return (head - 1) & SH2_BATCH_RING_MASK;
+}
+
+#endif
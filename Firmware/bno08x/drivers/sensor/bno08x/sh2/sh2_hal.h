@@ -30,7 +30,15 @@
 #define SH2_HAL_MAX_PAYLOAD_OUT  (128)
 
 #define SH2_HAL_MAX_TRANSFER_IN  (1024)
+
+// Payloads that arrive in a single transfer are delivered straight from the
+// transfer buffer.  The payload buffer is only used to reassemble payloads
+// the hub splits across several transfers.
+#ifdef CONFIG_BNO08X_SHTP_REASSEMBLY_SIZE
+#define SH2_HAL_MAX_PAYLOAD_IN   (CONFIG_BNO08X_SHTP_REASSEMBLY_SIZE)
+#else
 #define SH2_HAL_MAX_PAYLOAD_IN   (1024)
+#endif
 
 typedef struct sh2_Hal_s sh2_Hal_t;
 
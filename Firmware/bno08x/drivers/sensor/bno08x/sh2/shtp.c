@@ -28,12 +28,12 @@
 // Private types
 
 #define SHTP_INSTANCES (1)  // Number of SHTP devices supported
-#define SHTP_MAX_CHANS (8)  // Max channels per SHTP device
 #define SHTP_HDR_LEN (4)
 
 typedef struct shtp_Channel_s {
     uint8_t nextOutSeq;
     uint8_t nextInSeq;
+    uint32_t rxSeqGaps;
     shtp_Callback_t *callback;
     void *cookie;
 } shtp_Channel_t;
@@ -67,6 +67,7 @@ typedef struct shtp_s {
     uint32_t rxShortFragments;
     uint32_t rxTooLargePayloads;
     uint32_t rxInterruptedPayloads;
+    uint32_t rxSingleFragments;
     
     uint32_t badTxChan;
     uint32_t txDiscards;
@@ -200,13 +201,6 @@ static void rxAssemble(shtp_t *pShtp, uint8_t *in, uint16_t len, uint32_t t_us)
     chan = in[2];
     seq = in[3];
 
-    if (seq != pShtp->chan[chan].nextInSeq){
-        if (pShtp->eventCallback) {
-            pShtp->eventCallback(pShtp->eventCookie,
-                                 SHTP_BAD_SN);
-        }
-    }
-    
     if (payloadLen < SHTP_HDR_LEN) {
         pShtp->rxShortFragments++;
         if (pShtp->eventCallback) {
@@ -225,6 +219,16 @@ static void rxAssemble(shtp_t *pShtp, uint8_t *in, uint16_t len, uint32_t t_us)
         return;
     }
 
+    // Checked only once the channel is known to be valid
+    if (seq != pShtp->chan[chan].nextInSeq){
+        // Sequence numbers are 8 bit, so the gap wraps with them
+        pShtp->chan[chan].rxSeqGaps += (uint8_t)(seq - pShtp->chan[chan].nextInSeq);
+        if (pShtp->eventCallback) {
+            pShtp->eventCallback(pShtp->eventCookie,
+                                 SHTP_BAD_SN);
+        }
+    }
+
     // Discard earlier assembly in progress if the received data doesn't match it.
     if (pShtp->inRemaining) {
         // Check this against previously received data.
@@ -251,8 +255,20 @@ static void rxAssemble(shtp_t *pShtp, uint8_t *in, uint16_t len, uint32_t t_us)
     // Remember next sequence number we expect for this channel.
     pShtp->chan[chan].nextInSeq = seq + 1;
 
+    if ((pShtp->inRemaining == 0) && (len >= payloadLen)) {
+        // Whole payload in a single transfer: deliver it straight from the
+        // transfer buffer, no reassembly needed.
+        pShtp->rxSingleFragments++;
+        if (pShtp->chan[chan].callback != 0) {
+            pShtp->chan[chan].callback(pShtp->chan[chan].cookie,
+                                       in+SHTP_HDR_LEN, payloadLen-SHTP_HDR_LEN,
+                                       t_us);
+        }
+        return;
+    }
+
     if (pShtp->inRemaining == 0) {
-        if (payloadLen > sizeof(pShtp->inPayload)) {
+        if (payloadLen-SHTP_HDR_LEN > sizeof(pShtp->inPayload)) {
             // Error: This payload won't fit! Discard it.
             pShtp->rxTooLargePayloads++;
             
@@ -408,3 +424,20 @@ void shtp_service(void *pInstance)
         rxAssemble(pShtp, pShtp->inTransfer, len, t_us);
     }
 }
+
+// Copy the session's counters.
+void shtp_getStats(void *pInstance, shtp_Stats_t *pStats)
+{
+    shtp_t *pShtp = (shtp_t *)pInstance;
+
+    pStats->rxBadChan = pShtp->rxBadChan;
+    pStats->rxShortFragments = pShtp->rxShortFragments;
+    pStats->rxTooLargePayloads = pShtp->rxTooLargePayloads;
+    pStats->rxInterruptedPayloads = pShtp->rxInterruptedPayloads;
+    pStats->rxSingleFragments = pShtp->rxSingleFragments;
+    pStats->txDiscards = pShtp->txDiscards;
+    pStats->txTooLargePayloads = pShtp->txTooLargePayloads;
+    for (int n = 0; n < SHTP_MAX_CHANS; n++) {
+        pStats->rxSeqGaps[n] = pShtp->chan[n].rxSeqGaps;
+    }
+}
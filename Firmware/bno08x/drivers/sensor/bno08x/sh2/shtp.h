@@ -37,6 +37,21 @@ typedef enum shtp_Event_e {
     SHTP_INTERRUPTED_PAYLOAD = 7,
 } shtp_Event_t;
 
+#define SHTP_MAX_CHANS (8)  // Max channels per SHTP device
+
+// Receive and transmit counters of an SHTP session, since it was opened
+typedef struct shtp_Stats_s {
+    uint32_t rxBadChan;
+    uint32_t rxShortFragments;
+    uint32_t rxTooLargePayloads;
+    uint32_t rxInterruptedPayloads;
+    uint32_t rxSingleFragments;
+    uint32_t txDiscards;
+    uint32_t txTooLargePayloads;
+    // Transfers missing from the sequence numbers, per channel
+    uint32_t rxSeqGaps[SHTP_MAX_CHANS];
+} shtp_Stats_t;
+
 typedef void shtp_Callback_t(void * cookie, uint8_t *payload, uint16_t len, uint32_t timestamp);
 typedef void shtp_EventCallback_t(void *cookie, shtp_Event_t shtpEvent);
 
@@ -66,5 +81,8 @@ int shtp_send(void *pShtp,
 // Check for received data and process it.
 void shtp_service(void *pShtp);
 
+// Copy the session's counters.
+void shtp_getStats(void *pShtp, shtp_Stats_t *pStats);
+
 // #ifdef SHTP_H
 #endif
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Extended public API for the CEVA BNO08x sensor hub driver
+ */
+
+#ifndef ZEPHYR_INCLUDE_DRIVERS_SENSOR_BNO08X_H_
+#define ZEPHYR_INCLUDE_DRIVERS_SENSOR_BNO08X_H_
+
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum bno08x_channel {
+
+	/** Quaternion */
+	SENSOR_CHAN_ROTATION_VEC_I = SENSOR_CHAN_PRIV_START,
+	SENSOR_CHAN_ROTATION_VEC_J,
+	SENSOR_CHAN_ROTATION_VEC_K,
+	SENSOR_CHAN_ROTATION_VEC_IJKR,
+	SENSOR_CHAN_ROTATION_VEC_REAL,
+	SENSOR_CHAN_ROTATION_VEC_ACCURACY,
+
+	/**
+	 * Time the latest rotation vector sample was taken, in seconds of
+	 * kernel uptime (val1 seconds, val2 microseconds). Includes the
+	 * report delay the hub states for the sample.
+	 */
+	SENSOR_CHAN_ROTATION_VEC_TIMESTAMP,
+
+	/**
+	 * Calibration accuracy of the latest samples, packed in val1 with
+	 * two bits per sensor, see BNO08X_CAL_STATUS_GET().
+	 */
+	SENSOR_CHAN_CALIBRATION_STATUS,
+
+	/**
+	 * Latest motion state from the hub's motion detectors,
+	 * enum bno08x_stability in val1.
+	 */
+	SENSOR_CHAN_STABILITY,
+
+	/**
+	 * Yaw, pitch and roll of the latest rotation vector sample in
+	 * degrees, as val[0..2]. Requires CONFIG_BNO08X_EULER.
+	 */
+	SENSOR_CHAN_YPR,
+};
+
+/** Values of SENSOR_CHAN_STABILITY, as the hub's stability classifier */
+enum bno08x_stability {
+	BNO08X_STABILITY_UNKNOWN,
+	/** Lying on a surface, no vibration */
+	BNO08X_STABILITY_ON_TABLE,
+	/** Not moving, but held */
+	BNO08X_STABILITY_STATIONARY,
+	/** Resting on a surface with some vibration */
+	BNO08X_STABILITY_STABLE,
+	/** Moving; also reported on a stability exit or significant motion */
+	BNO08X_STABILITY_MOTION,
+};
+
+/* Bit positions of the per-sensor accuracy in SENSOR_CHAN_CALIBRATION_STATUS */
+#define BNO08X_CAL_STATUS_ACCEL_POS		0
+#define BNO08X_CAL_STATUS_GYRO_POS		2
+#define BNO08X_CAL_STATUS_MAGN_POS		4
+#define BNO08X_CAL_STATUS_ROTATION_VEC_POS	6
+
+/**
+ * @brief Accuracy of one sensor: 0 unreliable, 1 low, 2 medium, 3 high.
+ *
+ * @param status Packed value from SENSOR_CHAN_CALIBRATION_STATUS
+ * @param sensor ACCEL, GYRO, MAGN or ROTATION_VEC
+ */
+#define BNO08X_CAL_STATUS_GET(status, sensor) \
+	(((status) >> BNO08X_CAL_STATUS_##sensor##_POS) & 0x3)
+
+enum bno08x_attribute {
+	/** Set of reports the hub streams, enum bno08x_mode in val1 */
+	SENSOR_ATTR_BNO08X_MODE = SENSOR_ATTR_PRIV_START,
+	/**
+	 * Armed gesture detectors, BIT(enum bno08x_gesture) mask in val1.
+	 * Requires CONFIG_BNO08X_GESTURES.
+	 */
+	SENSOR_ATTR_BNO08X_GESTURES,
+};
+
+enum bno08x_mode {
+	/** Hub fusion: rotation vector plus calibrated accel, gyro and magn */
+	BNO08X_MODE_FUSION,
+	/**
+	 * Raw accelerometer, gyroscope and magnetometer ADC counts at
+	 * CONFIG_BNO08X_RAW_INTERVAL_US, for fusion on the host CPU. Read the
+	 * samples with bno08x_raw_read(); the fusion channels are not updated.
+	 */
+	BNO08X_MODE_RAW,
+	/**
+	 * Data reports stopped; only the stability detector and significant
+	 * motion stay armed, so the hub interrupts only when the device starts
+	 * moving. Wait for that with bno08x_wait_int().
+	 */
+	BNO08X_MODE_IDLE,
+};
+
+/** Sensors with metadata, see bno08x_sensor_info_get() */
+enum bno08x_sensor {
+	BNO08X_SENSOR_ACCEL,
+	BNO08X_SENSOR_GYRO,
+	BNO08X_SENSOR_MAGN,
+	BNO08X_SENSOR_ROTATION_VEC,
+	BNO08X_SENSOR_RAW_ACCEL,
+	BNO08X_SENSOR_RAW_GYRO,
+	BNO08X_SENSOR_RAW_MAGN,
+	BNO08X_SENSOR_COUNT,
+};
+
+/** Sensor properties from the hub's metadata record */
+struct bno08x_sensor_info {
+	/** Shortest report interval the hub supports */
+	uint32_t min_period_us;
+	/** Longest report interval, 0 if unlimited */
+	uint32_t max_period_us;
+	/** Full scale range, fixed point with q_point fractional bits */
+	uint32_t range;
+	/** Resolution, fixed point with q_point fractional bits */
+	uint32_t resolution;
+	/** Fractional bits of the report values */
+	uint8_t q_point;
+	/** Fractional bits of the accuracy or bias fields */
+	uint8_t q_point2;
+};
+
+/**
+ * @brief Get a sensor's metadata.
+ *
+ * Read from the hub, or from settings, during hub bring-up; requires
+ * CONFIG_BNO08X_METADATA. The driver decodes reports with these Q points.
+ *
+ * @param dev BNO08x device
+ * @param sensor Sensor to query
+ * @param info Destination
+ * @return 0 on success, -ENODATA if the metadata could not be read
+ */
+int bno08x_sensor_info_get(const struct device *dev, enum bno08x_sensor sensor,
+			   struct bno08x_sensor_info *info);
+
+/** One rotation vector sample with the latest accelerometer, gyroscope and magnetometer */
+struct bno08x_sample {
+	/** Rotation vector sample time in kernel uptime microseconds */
+	uint64_t timestamp_us;
+	/** i, j, k, real */
+	float quat[4];
+	/** m/s^2 */
+	float accel[3];
+	/** rad/s */
+	float gyro[3];
+	/** uT */
+	float magn[3];
+};
+
+/**
+ * @brief Take the fusion samples received since the last call.
+ *
+ * Unlike the sensor channels, which only hold the latest sample, this
+ * returns every rotation vector report. Must be called from the thread that
+ * calls sensor_sample_fetch(); requires CONFIG_BNO08X_BATCH_DECODE.
+ *
+ * @param dev BNO08x device
+ * @param samples Destination
+ * @param max Capacity of @p samples
+ * @return Number of samples written, or negative errno
+ */
+int bno08x_sample_read(const struct device *dev, struct bno08x_sample *samples, int max);
+
+/** Gesture detectors of the hub, see SENSOR_ATTR_BNO08X_GESTURES */
+enum bno08x_gesture {
+	BNO08X_GESTURE_TAP,
+	BNO08X_GESTURE_SHAKE,
+	BNO08X_GESTURE_FLIP,
+	BNO08X_GESTURE_PICKUP,
+	BNO08X_GESTURE_CIRCLE,
+	BNO08X_GESTURE_COUNT,
+};
+
+/** A gesture detected by the hub */
+struct bno08x_gesture_event {
+	/** Time of detection, kernel uptime microseconds */
+	uint64_t timestamp_us;
+	/** enum bno08x_gesture */
+	uint8_t gesture;
+	/**
+	 * Detector output as reported by the hub: axes and direction, plus
+	 * double tap, for a tap; axes for a shake; the pickup flags for a
+	 * pickup. See the SH-2 reference manual.
+	 */
+	uint16_t flags;
+};
+
+/**
+ * @brief Take gesture events detected since the last call, oldest first.
+ *
+ * Events are collected during sensor_sample_fetch(); call from the same
+ * thread. Requires CONFIG_BNO08X_GESTURES.
+ *
+ * @param dev BNO08x device
+ * @param events Destination
+ * @param max Number of entries in events
+ * @return Number of events written
+ */
+int bno08x_gesture_read(const struct device *dev, struct bno08x_gesture_event *events,
+			size_t max);
+
+/**
+ * @brief Rotate all hub outputs into another frame.
+ *
+ * The rotation is queued to the hub together with a persist-tare command,
+ * so the hub keeps it across resets and power cycles. It replaces any
+ * earlier rotation or tare. Must be called from the thread that calls
+ * sensor_sample_fetch(); requires CONFIG_BNO08X_ORIENTATION.
+ *
+ * @param dev BNO08x device
+ * @param quat Rotation of the output frame relative to the sensor frame,
+ *             as i, j, k, real; all zero clears the rotation
+ * @return 0 if queued, -EBUSY before hub bring-up has finished, -EIO if
+ *         the SH2 operation queue is full
+ */
+int bno08x_reorient(const struct device *dev, const float quat[4]);
+
+/**
+ * @brief Take the current orientation as the reference orientation.
+ *
+ * The hub computes a new rotation from the latest rotation vector so that
+ * the orientation reads as the identity (or zero heading) from now on, and
+ * stores it like bno08x_reorient().
+ *
+ * @param dev BNO08x device
+ * @param heading_only Only reset the heading, around the vertical axis
+ * @return 0 if queued, -EAGAIN in BNO08X_MODE_IDLE, -EBUSY before hub
+ *         bring-up has finished, -EIO if the SH2 operation queue is full
+ */
+int bno08x_tare(const struct device *dev, bool heading_only);
+
+/** An outage of the sample stream after the hub reset itself */
+struct bno08x_gap {
+	/** Time of the last sample before the reset, kernel uptime microseconds */
+	uint64_t start_us;
+	/** Time from start_us to the first sample after the hub was reconfigured */
+	uint32_t duration_us;
+};
+
+/**
+ * @brief Take the most recent outage of the sample stream.
+ *
+ * The driver reconfigures the hub when it resets on its own and measures
+ * how long the samples of the current mode stopped for. Must be called
+ * from the thread that calls sensor_sample_fetch().
+ *
+ * @param dev BNO08x device
+ * @param gap Destination
+ * @return 0 if the stream has resumed after an outage since the last call,
+ *         -ENODATA otherwise
+ */
+int bno08x_gap_read(const struct device *dev, struct bno08x_gap *gap);
+
+/**
+ * @brief Single precision atan2 with an absolute error below 1e-5 rad.
+ */
+float bno08x_atan2f(float y, float x);
+
+/**
+ * @brief Single precision asin with an absolute error below 1e-5 rad;
+ * the argument is clamped to [-1, 1].
+ */
+float bno08x_asinf(float x);
+
+/**
+ * @brief Yaw, pitch and roll of a rotation vector.
+ *
+ * Uses the same axis convention as the SH2 reference code (sh2/euler.c),
+ * in single precision. Requires CONFIG_BNO08X_EULER.
+ *
+ * @param quat Quaternion in i, j, k, real order
+ * @param ypr Yaw, pitch and roll in radians
+ */
+void bno08x_quat_to_ypr(const float quat[4], float ypr[3]);
+
+/** One raw gyroscope sample with the latest accelerometer and magnetometer */
+struct bno08x_raw_sample {
+	/** Gyroscope sample time in kernel uptime microseconds */
+	uint64_t timestamp_us;
+	int16_t accel[3];
+	int16_t gyro[3];
+	int16_t magn[3];
+};
+
+/**
+ * @brief Take the raw samples received since the last call.
+ *
+ * Must be called from the thread that calls sensor_sample_fetch(). Samples
+ * that were not read before the driver's ring filled up are dropped.
+ *
+ * @param dev BNO08x device
+ * @param samples Destination
+ * @param max Capacity of @p samples
+ * @return Number of samples written, or negative errno
+ */
+int bno08x_raw_read(const struct device *dev, struct bno08x_raw_sample *samples, int max);
+
+/**
+ * @brief Wait for the hub to signal pending data on its interrupt line.
+ *
+ * Lets a caller sleep between sparse reports, as in BNO08X_MODE_IDLE,
+ * instead of blocking in sensor_sample_fetch().
+ *
+ * @param dev BNO08x device
+ * @param timeout How long to wait
+ * @return 0 if data is pending, -EAGAIN on timeout
+ */
+int bno08x_wait_int(const struct device *dev, k_timeout_t timeout);
+
+/**
+ * @brief Wait for the sensor hub to finish its bring-up.
+ *
+ * With CONFIG_BNO08X_INIT_ASYNC the hub is reset and configured on a
+ * background thread after device init. Returns immediately otherwise.
+ *
+ * @param dev BNO08x device
+ * @param timeout How long to wait
+ * @retval 0 Hub ready
+ * @retval -EAGAIN Timed out
+ * @retval <0 Bring-up failed with this error
+ */
+int bno08x_wait_ready(const struct device *dev, k_timeout_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_DRIVERS_SENSOR_BNO08X_H_ */
@@ -0,0 +1,672 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Benchmark central for the MetaBow firmware on nrf52_bsim.
+ *
+ * Connects to the first connectable advertiser, receives its stream over
+ * NUS, the L2CAP channel or the MetaBow service and prints one BENCH line
+ * with throughput, loss and latency. The peripheral's emulated microphone
+ * puts bits 20:5 of the capture uptime into each sample, and both devices
+ * run on the simulation clock, so the age of a sample on arrival is its
+ * one way latency. IMU samples carry device timebase timestamps, mapped to
+ * uptime with the offset between the audio timestamps and sample values.
+ *
+ * Test arguments: mode <nus|l2cap|svc> duration <s> warmup <s>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/l2cap.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <bluetooth/services/nus.h>
+
+#include "bs_types.h"
+#include "bs_tracing.h"
+#include "bstests.h"
+
+#include "frame.h"
+#include "metabow_svc.h"
+
+/* CONFIG_METABOW_L2CAP_PSM of the firmware */
+#define BENCH_PSM		0x80
+#define BENCH_SDU_MTU		502
+/* MAX_SAMPLE_RATE of the firmware */
+#define BENCH_PCM_RATE		16000
+/* Emulated microphone: sample value is capture uptime [us] >> 5 */
+#define BENCH_TIME_SHIFT	5
+#define BENCH_TIME_MASK		0xffff
+/* Latency histogram: 100 us buckets, the last one collects the rest */
+#define BENCH_BUCKET_US		100
+#define BENCH_BUCKETS		2000
+/* Byte stream reassembly, several of the largest frames */
+#define BENCH_STREAM_BUF_SIZE	4096
+/* Section prefix of the svc audio characteristic */
+#define BENCH_SVC_TS_SIZE	4
+/* IMU section prefix: flags, calibration status, timestamp */
+#define BENCH_IMU_FLAG_VALID	BIT(0)
+/* Time to connect and subscribe before the test counts as failed [s] */
+#define BENCH_SETUP_S		30
+
+enum bench_mode {
+	BENCH_MODE_NUS,
+	BENCH_MODE_L2CAP,
+	BENCH_MODE_SVC,
+};
+
+static const char *const mode_names[] = {
+	[BENCH_MODE_NUS] = "nus",
+	[BENCH_MODE_L2CAP] = "l2cap",
+	[BENCH_MODE_SVC] = "svc",
+};
+
+struct bench_hist {
+	uint32_t count;
+	uint32_t bucket[BENCH_BUCKETS];
+};
+
+struct bench_stats {
+	/* Transport payload: notification values or SDUs */
+	uint64_t rx_bytes;
+	/* PCM and IMU section payload */
+	uint64_t data_bytes;
+	uint32_t frames;
+	uint32_t frames_lost;
+	uint32_t crc_errors;
+	uint64_t audio_samples;
+	int64_t audio_first_us;
+	int64_t audio_last_us;
+	struct bench_hist audio_latency;
+	struct bench_hist imu_latency;
+};
+
+static enum bench_mode mode = BENCH_MODE_NUS;
+static uint32_t duration_s = 10;
+static uint32_t warmup_s = 3;
+
+static struct bt_conn *conn;
+static K_SEM_DEFINE(connected_sem, 0, 1);
+static K_SEM_DEFINE(step_sem, 0, 1);
+
+static struct k_spinlock stats_lock;
+static struct bench_stats stats;
+static bool measuring;
+
+/* Uptime minus device timebase, learned from audio */
+static int64_t timebase_offset_us;
+static bool timebase_known;
+
+static uint8_t stream_buf[BENCH_STREAM_BUF_SIZE];
+static size_t stream_len;
+static bool seq_known;
+static uint16_t seq_next;
+
+extern enum bst_result_t bst_result;
+
+#define FAIL(...)					\
+	do {						\
+		bst_result = Failed;			\
+		bs_trace_error_time_line(__VA_ARGS__);	\
+	} while (0)
+
+#define PASS(...)					\
+	do {						\
+		bst_result = Passed;			\
+		bs_trace_info_time(1, __VA_ARGS__);	\
+	} while (0)
+
+static inline int64_t now_us(void)
+{
+	return (int64_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+/**
+ * @brief Capture uptime of an emulated microphone sample received now
+ */
+static int64_t capture_us(int64_t now, uint16_t value)
+{
+	const uint32_t age = (((uint32_t)(now >> BENCH_TIME_SHIFT) - value) & BENCH_TIME_MASK)
+			     << BENCH_TIME_SHIFT;
+
+	return now - age;
+}
+
+static void hist_add(struct bench_hist *h, int64_t latency_us)
+{
+	const uint32_t n = CLAMP(latency_us / BENCH_BUCKET_US, 0, BENCH_BUCKETS - 1);
+
+	h->bucket[n]++;
+	h->count++;
+}
+
+static uint32_t hist_percentile(const struct bench_hist *h, uint32_t pct)
+{
+	const uint32_t rank = ((uint64_t)h->count * pct + 99) / 100;
+	uint32_t seen = 0;
+
+	if (h->count == 0) {
+		return 0;
+	}
+
+	for (uint32_t n = 0; n < BENCH_BUCKETS; n++) {
+		seen += h->bucket[n];
+		if (seen >= rank) {
+			return (n + 1) * BENCH_BUCKET_US;
+		}
+	}
+
+	return BENCH_BUCKETS * BENCH_BUCKET_US;
+}
+
+/**
+ * @brief Account for a run of PCM samples
+ * @param pcm Little endian i16 samples
+ * @param samples Number of samples
+ * @param timestamp_us Device timebase of the first sample
+ */
+static void rx_audio(const uint8_t *pcm, size_t samples, uint32_t timestamp_us)
+{
+	const int64_t now = now_us();
+	int64_t first, last;
+	k_spinlock_key_t key;
+
+	if (samples == 0) {
+		return;
+	}
+
+	first = capture_us(now, sys_get_le16(pcm));
+	last = capture_us(now, sys_get_le16(pcm + 2 * (samples - 1)));
+
+	timebase_offset_us = first - timestamp_us;
+	timebase_known = true;
+
+	key = k_spin_lock(&stats_lock);
+	if (measuring) {
+		if (stats.audio_samples == 0) {
+			stats.audio_first_us = first;
+		}
+		stats.audio_last_us = last;
+		stats.audio_samples += samples;
+		stats.data_bytes += 2 * samples;
+		hist_add(&stats.audio_latency, now - last);
+	}
+	k_spin_unlock(&stats_lock, key);
+}
+
+/**
+ * @brief Account for an IMU section
+ * @param data Section payload, starting with the IMU prefix
+ * @param len Payload length
+ */
+static void rx_imu(const uint8_t *data, size_t len)
+{
+	const int64_t now = now_us();
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&stats_lock);
+	if (measuring) {
+		stats.data_bytes += len;
+		if (len >= FRAME_IMU_PREFIX_SIZE && (data[0] & BENCH_IMU_FLAG_VALID) &&
+		    timebase_known) {
+			hist_add(&stats.imu_latency,
+				 now - (sys_get_le32(data + 2) + timebase_offset_us));
+		}
+	}
+	k_spin_unlock(&stats_lock, key);
+}
+
+static void rx_bytes(size_t len)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	if (measuring) {
+		stats.rx_bytes += len;
+	}
+	k_spin_unlock(&stats_lock, key);
+}
+
+/**
+ * @brief Walk the sections of a checked v2 frame
+ */
+static void rx_frame(const uint8_t *frame, size_t len)
+{
+	const uint16_t seq = sys_get_le16(frame + 4);
+	const uint32_t timestamp_us = sys_get_le32(frame + 8);
+	size_t pos = FRAME_HEADER_SIZE;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&stats_lock);
+	if (measuring) {
+		stats.frames++;
+		if (seq_known) {
+			stats.frames_lost += (uint16_t)(seq - seq_next);
+		}
+	}
+	k_spin_unlock(&stats_lock, key);
+	seq_next = seq + 1;
+	seq_known = true;
+
+	if (frame[2] != FRAME_TYPE_STREAM) {
+		return;
+	}
+
+	while (pos + FRAME_SECTION_HEADER_SIZE <= len - FRAME_CRC_SIZE) {
+		const uint8_t type = frame[pos];
+		const uint16_t section_len = sys_get_le16(frame + pos + 1);
+		const uint8_t *payload = frame + pos + FRAME_SECTION_HEADER_SIZE;
+
+		pos += FRAME_SECTION_HEADER_SIZE + section_len;
+		if (pos > len - FRAME_CRC_SIZE) {
+			break;
+		}
+
+		switch (type) {
+		case FRAME_SECTION_PCM:
+			rx_audio(payload, section_len / 2, timestamp_us);
+			break;
+		case FRAME_SECTION_IMU:
+		case FRAME_SECTION_IMU_COMPACT:
+			rx_imu(payload, section_len);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Reassemble v2 frames from notifications or SDUs
+ */
+static void rx_stream(const uint8_t *data, size_t len)
+{
+	size_t start = 0;
+
+	rx_bytes(len);
+
+	if (len > sizeof(stream_buf) - stream_len) {
+		/* No frame is that long, whatever is held is garbage */
+		stream_len = 0;
+		len = MIN(len, sizeof(stream_buf));
+	}
+	memcpy(stream_buf + stream_len, data, len);
+	stream_len += len;
+
+	while (stream_len - start >= FRAME_HEADER_SIZE) {
+		const uint8_t *frame = stream_buf + start;
+		uint16_t frame_len;
+
+		if (frame[0] != FRAME_MAGIC || frame[1] != FRAME_VERSION) {
+			start++;
+			continue;
+		}
+
+		frame_len = sys_get_le16(frame + 6);
+		if (frame_len < FRAME_OVERHEAD || frame_len > sizeof(stream_buf)) {
+			start++;
+			continue;
+		}
+		if (stream_len - start < frame_len) {
+			break;
+		}
+
+		if (crc16_itu_t(0xffff, frame, frame_len - FRAME_CRC_SIZE) !=
+		    sys_get_le16(frame + frame_len - FRAME_CRC_SIZE)) {
+			k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+			if (measuring) {
+				stats.crc_errors++;
+			}
+			k_spin_unlock(&stats_lock, key);
+			start++;
+			continue;
+		}
+
+		rx_frame(frame, frame_len);
+		start += frame_len;
+	}
+
+	stream_len -= start;
+	memmove(stream_buf, stream_buf + start, stream_len);
+}
+
+static uint8_t notify_stream(struct bt_conn *c, struct bt_gatt_subscribe_params *params,
+			     const void *data, uint16_t length)
+{
+	if (data) {
+		rx_stream(data, length);
+	}
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static uint8_t notify_svc_audio(struct bt_conn *c, struct bt_gatt_subscribe_params *params,
+				const void *data, uint16_t length)
+{
+	if (data && length >= BENCH_SVC_TS_SIZE) {
+		rx_bytes(length);
+		rx_audio((const uint8_t *)data + BENCH_SVC_TS_SIZE,
+			 (length - BENCH_SVC_TS_SIZE) / 2, sys_get_le32(data));
+	}
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static uint8_t notify_svc_imu(struct bt_conn *c, struct bt_gatt_subscribe_params *params,
+			      const void *data, uint16_t length)
+{
+	const uint8_t *p = data;
+	size_t pos = 0;
+
+	if (!data) {
+		return BT_GATT_ITER_CONTINUE;
+	}
+
+	rx_bytes(length);
+	while (pos + FRAME_SECTION_HEADER_SIZE <= length) {
+		const uint8_t type = p[pos];
+		const uint16_t section_len = sys_get_le16(p + pos + 1);
+
+		if (pos + FRAME_SECTION_HEADER_SIZE + section_len > length) {
+			break;
+		}
+		if (type == FRAME_SECTION_IMU || type == FRAME_SECTION_IMU_COMPACT) {
+			rx_imu(p + pos + FRAME_SECTION_HEADER_SIZE, section_len);
+		}
+		pos += FRAME_SECTION_HEADER_SIZE + section_len;
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static struct bt_gatt_discover_params discover_params;
+static uint16_t discovered_handle;
+
+static uint8_t discover_func(struct bt_conn *c, const struct bt_gatt_attr *attr,
+			     struct bt_gatt_discover_params *params)
+{
+	if (attr) {
+		discovered_handle = ((struct bt_gatt_chrc *)attr->user_data)->value_handle;
+	}
+	k_sem_give(&step_sem);
+	return BT_GATT_ITER_STOP;
+}
+
+/**
+ * @brief Find a characteristic and subscribe to its notifications
+ *
+ * Every stream characteristic of the firmware has its CCC right after the
+ * value, which saves discovering descriptors.
+ */
+static int subscribe(const struct bt_uuid *uuid, struct bt_gatt_subscribe_params *params,
+		     bt_gatt_notify_func_t func)
+{
+	int err;
+
+	discovered_handle = 0;
+	discover_params.uuid = uuid;
+	discover_params.func = discover_func;
+	discover_params.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+	discover_params.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+	discover_params.type = BT_GATT_DISCOVER_CHARACTERISTIC;
+
+	err = bt_gatt_discover(conn, &discover_params);
+	if (err) {
+		return err;
+	}
+	k_sem_take(&step_sem, K_FOREVER);
+	if (discovered_handle == 0) {
+		return -ENOENT;
+	}
+
+	params->notify = func;
+	params->value = BT_GATT_CCC_NOTIFY;
+	params->value_handle = discovered_handle;
+	params->ccc_handle = discovered_handle + 1;
+	atomic_set_bit(params->flags, BT_GATT_SUBSCRIBE_FLAG_VOLATILE);
+
+	return bt_gatt_subscribe(conn, params);
+}
+
+NET_BUF_POOL_FIXED_DEFINE(sdu_pool, 4, BT_L2CAP_SDU_BUF_SIZE(BENCH_SDU_MTU), 8, NULL);
+
+static struct net_buf *l2cap_alloc_buf(struct bt_l2cap_chan *chan)
+{
+	return net_buf_alloc(&sdu_pool, K_FOREVER);
+}
+
+static int l2cap_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+	rx_stream(buf->data, buf->len);
+	return 0;
+}
+
+static void l2cap_connected(struct bt_l2cap_chan *chan)
+{
+	k_sem_give(&step_sem);
+}
+
+static const struct bt_l2cap_chan_ops l2cap_ops = {
+	.alloc_buf = l2cap_alloc_buf,
+	.recv = l2cap_recv,
+	.connected = l2cap_connected,
+};
+
+static struct bt_l2cap_le_chan l2cap_chan = {
+	.chan.ops = &l2cap_ops,
+	.rx.mtu = BENCH_SDU_MTU,
+};
+
+static void mtu_exchanged(struct bt_conn *c, uint8_t err,
+			  struct bt_gatt_exchange_params *params)
+{
+	k_sem_give(&step_sem);
+}
+
+static struct bt_gatt_exchange_params exchange_params = {
+	.func = mtu_exchanged,
+};
+
+static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+			 struct net_buf_simple *ad)
+{
+	int err;
+
+	if (conn || (type != BT_GAP_ADV_TYPE_ADV_IND && type != BT_GAP_ADV_TYPE_ADV_DIRECT_IND)) {
+		return;
+	}
+
+	if (bt_le_scan_stop()) {
+		return;
+	}
+
+	err = bt_conn_le_create(addr, BT_CONN_LE_CREATE_CONN, BT_LE_CONN_PARAM_DEFAULT, &conn);
+	if (err) {
+		FAIL("Create connection failed (err %d)\n", err);
+	}
+}
+
+static void connected(struct bt_conn *c, uint8_t err)
+{
+	if (err) {
+		FAIL("Connection failed (err 0x%02x)\n", err);
+		return;
+	}
+	k_sem_give(&connected_sem);
+}
+
+static void disconnected(struct bt_conn *c, uint8_t reason)
+{
+	if (bst_result != Passed) {
+		FAIL("Disconnected (reason 0x%02x)\n", reason);
+	}
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
+
+static void print_result(const struct bench_stats *s, uint32_t elapsed_us)
+{
+	const uint64_t span_us = s->audio_last_us - s->audio_first_us;
+	const uint64_t expected = s->audio_samples ?
+		span_us * BENCH_PCM_RATE / USEC_PER_SEC + 1 : 0;
+	const uint32_t loss_ppm = (expected > s->audio_samples) ?
+		(expected - s->audio_samples) * 1000000ULL / expected : 0;
+	char lost[12] = "n/a";
+
+	/* The service sends sections without frame headers */
+	if (mode != BENCH_MODE_SVC) {
+		snprintk(lost, sizeof(lost), "%u", s->frames_lost);
+	}
+
+	printk("BENCH mode=%s rx_kbps=%u goodput_kbps=%u audio_loss_ppm=%u "
+	       "frames=%u frames_lost=%s crc_errors=%u "
+	       "audio_p50_us=%u audio_p90_us=%u audio_p99_us=%u "
+	       "imu_p50_us=%u imu_p90_us=%u imu_p99_us=%u imu_samples=%u\n",
+	       mode_names[mode],
+	       (uint32_t)(s->rx_bytes * 8000 / elapsed_us),
+	       (uint32_t)(s->data_bytes * 8000 / elapsed_us),
+	       loss_ppm,
+	       s->frames, lost, s->crc_errors,
+	       hist_percentile(&s->audio_latency, 50), hist_percentile(&s->audio_latency, 90),
+	       hist_percentile(&s->audio_latency, 99),
+	       hist_percentile(&s->imu_latency, 50), hist_percentile(&s->imu_latency, 90),
+	       hist_percentile(&s->imu_latency, 99), s->imu_latency.count);
+}
+
+static void test_main(void)
+{
+	static struct bt_gatt_subscribe_params sub_a, sub_b;
+	static struct bench_stats result;
+	k_spinlock_key_t key;
+	int64_t start;
+	int err;
+
+	err = bt_enable(NULL);
+	if (err) {
+		FAIL("Bluetooth init failed (err %d)\n", err);
+		return;
+	}
+
+	err = bt_le_scan_start(BT_LE_SCAN_PASSIVE, device_found);
+	if (err) {
+		FAIL("Scanning failed to start (err %d)\n", err);
+		return;
+	}
+	k_sem_take(&connected_sem, K_FOREVER);
+
+	err = bt_gatt_exchange_mtu(conn, &exchange_params);
+	if (err == 0) {
+		k_sem_take(&step_sem, K_FOREVER);
+	}
+
+	switch (mode) {
+	case BENCH_MODE_NUS:
+		err = subscribe(BT_UUID_NUS_TX, &sub_a, notify_stream);
+		break;
+	case BENCH_MODE_L2CAP:
+		err = bt_l2cap_chan_connect(conn, &l2cap_chan.chan, BENCH_PSM);
+		if (err == 0) {
+			k_sem_take(&step_sem, K_FOREVER);
+		}
+		break;
+	case BENCH_MODE_SVC:
+		err = subscribe(BT_UUID_DECLARE_128(BT_UUID_METABOW_VAL(1 + METABOW_SVC_AUDIO)),
+				&sub_a, notify_svc_audio);
+		if (err == 0) {
+			err = subscribe(BT_UUID_DECLARE_128(BT_UUID_METABOW_VAL(1 + METABOW_SVC_IMU)),
+					&sub_b, notify_svc_imu);
+		}
+		break;
+	}
+	if (err) {
+		FAIL("Could not start the %s stream (err %d)\n", mode_names[mode], err);
+		return;
+	}
+
+	/* Let PHY, data length and connection parameters settle */
+	k_sleep(K_SECONDS(warmup_s));
+
+	key = k_spin_lock(&stats_lock);
+	memset(&stats, 0, sizeof(stats));
+	measuring = true;
+	start = now_us();
+	k_spin_unlock(&stats_lock, key);
+
+	k_sleep(K_SECONDS(duration_s));
+
+	key = k_spin_lock(&stats_lock);
+	measuring = false;
+	result = stats;
+	k_spin_unlock(&stats_lock, key);
+
+	print_result(&result, (uint32_t)(now_us() - start));
+	PASS("Benchmark done\n");
+}
+
+static void test_args(int argc, char *argv[])
+{
+	for (int i = 0; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "mode") == 0) {
+			for (int m = 0; m < ARRAY_SIZE(mode_names); m++) {
+				if (strcmp(argv[i + 1], mode_names[m]) == 0) {
+					mode = m;
+				}
+			}
+		} else if (strcmp(argv[i], "duration") == 0) {
+			duration_s = strtoul(argv[i + 1], NULL, 10);
+		} else if (strcmp(argv[i], "warmup") == 0) {
+			warmup_s = strtoul(argv[i + 1], NULL, 10);
+		}
+	}
+}
+
+static void test_init(void)
+{
+	bst_ticker_set_next_tick_absolute((uint64_t)(BENCH_SETUP_S + warmup_s + duration_s) *
+					  USEC_PER_SEC);
+	bst_result = In_progress;
+}
+
+static void test_tick(bs_time_t HW_device_time)
+{
+	if (bst_result != Passed) {
+		FAIL("Benchmark timed out\n");
+	}
+}
+
+static const struct bst_test_instance test_defs[] = {
+	{
+		.test_id = "central",
+		.test_descr = "Connect to a MetaBow and measure its stream",
+		.test_args_f = test_args,
+		.test_post_init_f = test_init,
+		.test_tick_f = test_tick,
+		.test_main_f = test_main,
+	},
+	BSTEST_END_MARKER
+};
+
+static struct bst_test_list *test_install(struct bst_test_list *tests)
+{
+	return bst_add_tests(tests, test_defs);
+}
+
+bst_test_install_t test_installers[] = {
+	test_install,
+	NULL
+};
+
+int main(void)
+{
+	bst_main();
+	return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * LED functions of the DK library for boards without LEDs. The state is
+ * only kept and logged at debug level.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <dk_buttons_and_leds.h>
+
+LOG_MODULE_REGISTER(dk_leds_emul, LOG_LEVEL_INF);
+
+static uint32_t leds;
+
+int dk_leds_init(void)
+{
+	leds = 0;
+	return 0;
+}
+
+int dk_set_leds_state(uint32_t leds_on_mask, uint32_t leds_off_mask)
+{
+	const uint32_t state = (leds | leds_on_mask) & ~leds_off_mask;
+
+	if (state != leds) {
+		LOG_DBG("LEDs 0x%02x", state);
+		leds = state;
+	}
+
+	return 0;
+}
+
+int dk_set_leds(uint32_t leds_mask)
+{
+	return dk_set_leds_state(leds_mask, DK_ALL_LEDS_MSK & ~leds_mask);
+}
+
+int dk_set_led(uint8_t led_idx, uint32_t val)
+{
+	return val ? dk_set_led_on(led_idx) : dk_set_led_off(led_idx);
+}
+
+int dk_set_led_on(uint8_t led_idx)
+{
+	return dk_set_leds_state(BIT(led_idx), DK_NO_LEDS_MSK);
+}
+
+int dk_set_led_off(uint8_t led_idx)
+{
+	return dk_set_leds_state(DK_NO_LEDS_MSK, BIT(led_idx));
+}
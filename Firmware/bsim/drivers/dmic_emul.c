@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2024 Diodes Delight
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Emulated PDM microphone for simulated boards.
+ *
+ * Blocks are allocated from the configured slab and handed to dmic_read()
+ * when the last of their samples falls due, timed from the number of
+ * samples captured since the start trigger so the rate does not drift.
+ * Sample values are (uint16_t)(capture uptime [us] >> 5): with a 32 us
+ * step they wrap after about 2 s, long enough to tell the capture time of
+ * anything received within that.
+ */
+
+#define DT_DRV_COMPAT metabow_dmic_emul
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/audio/dmic.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(dmic_emul, CONFIG_AUDIO_DMIC_LOG_LEVEL);
+
+#define DMIC_EMUL_QUEUE_LEN	8
+#define DMIC_EMUL_TIME_SHIFT	5
+
+struct dmic_emul_data {
+	enum dmic_state state;
+	struct k_mem_slab *slab;
+	size_t block_size;
+	uint32_t pcm_rate;
+	/* Uptime of the first sample after the start trigger [us] */
+	uint64_t start_us;
+	/* Samples captured since then */
+	uint64_t samples;
+	uint32_t overruns;
+	struct k_timer timer;
+	struct k_msgq queue;
+	void *queue_buf[DMIC_EMUL_QUEUE_LEN];
+};
+
+static uint64_t dmic_emul_sample_us(const struct dmic_emul_data *data, uint64_t n)
+{
+	return data->start_us + n * USEC_PER_SEC / data->pcm_rate;
+}
+
+static void dmic_emul_schedule(struct dmic_emul_data *data)
+{
+	const size_t block_samples = data->block_size / sizeof(int16_t);
+	const uint64_t due_us = dmic_emul_sample_us(data, data->samples + block_samples);
+
+	k_timer_start(&data->timer, K_TIMEOUT_ABS_US(due_us), K_NO_WAIT);
+}
+
+static void dmic_emul_capture(struct k_timer *timer)
+{
+	struct dmic_emul_data *data = CONTAINER_OF(timer, struct dmic_emul_data, timer);
+	const size_t block_samples = data->block_size / sizeof(int16_t);
+	int16_t *block;
+
+	if (data->state != DMIC_STATE_ACTIVE) {
+		return;
+	}
+
+	if (k_mem_slab_alloc(data->slab, (void **)&block, K_NO_WAIT) == 0) {
+		for (size_t i = 0; i < block_samples; i++) {
+			const uint64_t t_us = dmic_emul_sample_us(data, data->samples + i);
+
+			block[i] = (int16_t)(uint16_t)(t_us >> DMIC_EMUL_TIME_SHIFT);
+		}
+
+		if (k_msgq_put(&data->queue, &block, K_NO_WAIT) != 0) {
+			k_mem_slab_free(data->slab, (void **)&block);
+			data->overruns++;
+		}
+	} else {
+		data->overruns++;
+	}
+
+	data->samples += block_samples;
+	dmic_emul_schedule(data);
+}
+
+static void dmic_emul_flush(struct dmic_emul_data *data)
+{
+	void *block;
+
+	while (k_msgq_get(&data->queue, &block, K_NO_WAIT) == 0) {
+		k_mem_slab_free(data->slab, &block);
+	}
+}
+
+static int dmic_emul_configure(const struct device *dev, struct dmic_cfg *config)
+{
+	struct dmic_emul_data *data = dev->data;
+	struct pcm_stream_cfg *stream = &config->streams[0];
+
+	if (data->state == DMIC_STATE_ACTIVE) {
+		return -EBUSY;
+	}
+
+	if (config->channel.req_num_chan != 1 || stream->pcm_width != 16 ||
+	    stream->pcm_rate == 0 || stream->mem_slab == NULL ||
+	    stream->block_size < sizeof(int16_t)) {
+		LOG_ERR("Only one 16 bit channel is emulated");
+		return -EINVAL;
+	}
+
+	data->slab = stream->mem_slab;
+	data->block_size = stream->block_size;
+	data->pcm_rate = stream->pcm_rate;
+	config->channel.act_num_chan = 1;
+	config->channel.act_chan_map_lo = config->channel.req_chan_map_lo;
+	data->state = DMIC_STATE_CONFIGURED;
+
+	return 0;
+}
+
+static int dmic_emul_trigger(const struct device *dev, enum dmic_trigger cmd)
+{
+	struct dmic_emul_data *data = dev->data;
+
+	switch (cmd) {
+	case DMIC_TRIGGER_START:
+	case DMIC_TRIGGER_RELEASE:
+		if (data->state == DMIC_STATE_ACTIVE) {
+			return 0;
+		}
+		if (data->state != DMIC_STATE_CONFIGURED) {
+			return -EIO;
+		}
+		data->start_us = k_ticks_to_us_floor64(k_uptime_ticks());
+		data->samples = 0;
+		data->state = DMIC_STATE_ACTIVE;
+		dmic_emul_schedule(data);
+		break;
+	case DMIC_TRIGGER_STOP:
+	case DMIC_TRIGGER_PAUSE:
+		if (data->state == DMIC_STATE_ACTIVE) {
+			data->state = DMIC_STATE_CONFIGURED;
+			k_timer_stop(&data->timer);
+		}
+		if (data->overruns) {
+			LOG_WRN("%u blocks dropped, slab or queue full", data->overruns);
+			data->overruns = 0;
+		}
+		break;
+	case DMIC_TRIGGER_RESET:
+		k_timer_stop(&data->timer);
+		dmic_emul_flush(data);
+		data->state = DMIC_STATE_INITIALIZED;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int dmic_emul_read(const struct device *dev, uint8_t stream, void **buffer,
+			  size_t *size, int32_t timeout)
+{
+	struct dmic_emul_data *data = dev->data;
+	int ret;
+
+	if (data->state != DMIC_STATE_ACTIVE && data->state != DMIC_STATE_CONFIGURED) {
+		return -EIO;
+	}
+
+	ret = k_msgq_get(&data->queue, buffer, SYS_TIMEOUT_MS(timeout));
+	if (ret != 0) {
+		return (ret == -ENOMSG) ? -EAGAIN : ret;
+	}
+
+	*size = data->block_size;
+	return 0;
+}
+
+static int dmic_emul_init(const struct device *dev)
+{
+	struct dmic_emul_data *data = dev->data;
+
+	k_msgq_init(&data->queue, (char *)data->queue_buf, sizeof(void *),
+		    DMIC_EMUL_QUEUE_LEN);
+	k_timer_init(&data->timer, dmic_emul_capture, NULL);
+	data->state = DMIC_STATE_INITIALIZED;
+
+	return 0;
+}
+
+static const struct _dmic_ops dmic_emul_ops = {
+	.configure = dmic_emul_configure,
+	.trigger = dmic_emul_trigger,
+	.read = dmic_emul_read,
+};
+
+#define DMIC_EMUL_DEFINE(inst)						\
+	static struct dmic_emul_data dmic_emul_data_##inst;		\
+									\
+	DEVICE_DT_INST_DEFINE(inst, dmic_emul_init, NULL,		\
+			      &dmic_emul_data_##inst, NULL,		\
+			      POST_KERNEL, CONFIG_AUDIO_DMIC_INIT_PRIORITY,	\
+			      &dmic_emul_ops);
+
+DT_INST_FOREACH_STATUS_OKAY(DMIC_EMUL_DEFINE)
@@ -0,0 +1,106 @@
+#!/usr/bin/env bash
+# Copyright (c) 2024 Diodes Delight
+# SPDX-License-Identifier: Apache-2.0
+#
+# Build the firmware and the benchmark central for nrf52_bsim, run one
+# simulation per stream transport and print the BENCH results as a table.
+# Needs west with ZEPHYR_BASE set, and BSIM_OUT_PATH / BSIM_COMPONENTS_PATH
+# pointing at a BabbleSim build (see README.md).
+#
+# Usage: run_benchmark.sh [-d seconds] [-w seconds] [-o results.csv] [mode...]
+# Modes: nus l2cap svc (default: all)
+
+set -euo pipefail
+
+duration=10
+warmup=3
+csv=""
+while getopts "d:w:o:" opt; do
+	case "$opt" in
+	d) duration="$OPTARG" ;;
+	w) warmup="$OPTARG" ;;
+	o) csv="$OPTARG" ;;
+	*) sed -n '10,11p' "$0"; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+if [ $# -gt 0 ]; then
+	modes=("$@")
+else
+	modes=(nus l2cap svc)
+fi
+
+: "${BSIM_OUT_PATH:?BSIM_OUT_PATH must point at the BabbleSim build}"
+: "${BSIM_COMPONENTS_PATH:?BSIM_COMPONENTS_PATH must point at the BabbleSim components}"
+
+here="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+firmware="$(dirname "$here")"
+build="${BUILD_DIR:-$here/build}"
+bin="$BSIM_OUT_PATH/bin"
+
+west build -b nrf52_bsim -d "$build/metabow" "$firmware" -- \
+	-DCONF_FILE="$here/prj.conf" \
+	-DDTC_OVERLAY_FILE="$here/nrf52_bsim.overlay" \
+	-DZEPHYR_EXTRA_MODULES="$here"
+west build -b nrf52_bsim -d "$build/central" "$here/central"
+
+cp "$build/metabow/zephyr/zephyr.exe" "$bin/bs_nrf52_bsim_metabow"
+cp "$build/central/zephyr/zephyr.exe" "$bin/bs_nrf52_bsim_metabow_central"
+
+# Connecting and subscribing, then warmup and measurement [us]
+sim_length=$(( (10 + warmup + duration) * 1000000 ))
+results="$build/results.txt"
+: > "$results"
+
+for mode in "${modes[@]}"; do
+	sim_id="metabow_bench_$mode"
+	log="$build/central_$mode.log"
+
+	echo "Simulating $mode for $((sim_length / 1000000)) s" >&2
+	(
+		cd "$bin"
+		./bs_nrf52_bsim_metabow -s="$sim_id" -d=0 > "$build/metabow_$mode.log" 2>&1 &
+		./bs_nrf52_bsim_metabow_central -s="$sim_id" -d=1 -testid=central \
+			-argstest mode "$mode" duration "$duration" warmup "$warmup" > "$log" 2>&1 &
+		./bs_2G4_phy_v1 -s="$sim_id" -D=2 -sim_length="$sim_length" > /dev/null 2>&1
+		wait
+	) || true
+
+	if ! grep -o 'BENCH .*' "$log" >> "$results"; then
+		echo "No result for $mode, see $log" >&2
+	fi
+done
+
+# One column per key, in the order of the first result
+awk '
+{
+	row++
+	for (i = 2; i <= NF; i++) {
+		split($i, kv, "=")
+		if (row == 1) {
+			keys[++nkeys] = kv[1]
+		}
+		val[row, kv[1]] = kv[2]
+	}
+}
+END {
+	if (row == 0) {
+		exit 1
+	}
+	for (k = 1; k <= nkeys; k++) {
+		line = line (k > 1 ? "," : "") keys[k]
+	}
+	print line
+	for (r = 1; r <= row; r++) {
+		line = ""
+		for (k = 1; k <= nkeys; k++) {
+			line = line (k > 1 ? "," : "") val[r, keys[k]]
+		}
+		print line
+	}
+}' "$results" > "$build/results.csv"
+
+if [ -n "$csv" ]; then
+	cp "$build/results.csv" "$csv"
+fi
+column -s, -t < "$build/results.csv"
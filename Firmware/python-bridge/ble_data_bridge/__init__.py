@@ -3,6 +3,10 @@ import asyncio
 import argparse
 import time
 import struct
+from imu_codec import decode_compact, COMPACT_SIZE
+from imu_delta import DeltaDecoder
+import frame_v2
+import l2cap_stream
 from pythonosc import udp_client
 # import pyaudio
 
@@ -22,6 +26,12 @@ class BLEUARTConnection:
         #         rate=16000,
         #         output=True)
         self.buffer = ''
+        self.idle = None
+        self.delta = DeltaDecoder()
+        # Protocol v2 (CONFIG_METABOW_FRAME_V2) is used once a frame checks out
+        self.frames = frame_v2.FrameParser()
+        self.framed = False
+        self.lost = 0
 
     def __del__(self):
         self.binary_file.close()
@@ -32,22 +42,153 @@ class BLEUARTConnection:
     async def start(self):
         await self.client.start_notify(self.tx_char, self.rx_callback)
         print('Listening to notifications on the TX characteristic')
+        await self.send('rates')
+
+    # Packet layout: 90 PCM samples, 13 IMU floats, IMU flags,
+    # battery SoC, audio timestamp, IMU timestamp, IMU calibration status
+    # (all little endian).
+    # Timestamps are device timebase microseconds: audio sample n of the
+    # stream is at n * 1e6 / 16000, and the IMU timestamp is on the same clock.
+    PCM_LEN = 90*2
+    IMU_LEN = 13*4
+    PACKET_FORMAT = '<%dx13fBfIIB' % PCM_LEN
+    # CONFIG_METABOW_IMU_YPR: yaw, pitch and roll in degrees appended
+    YPR_PACKET_FORMAT = '<%dx13fBfIIB3f' % PCM_LEN
+    # CONFIG_METABOW_IMU_COMPACT: the 13 floats become one compact sample
+    COMPACT_PACKET_FORMAT = '<%dx%dsBfIIB' % (PCM_LEN, COMPACT_SIZE)
+    # CONFIG_METABOW_IMU_DELTA: IMU flags, battery, audio timestamp and
+    # calibration status, then a variable length batch of delta coded samples
+    DELTA_HEADER_FORMAT = '<%dxBfIB' % PCM_LEN
+    CAL_SENSORS = ('accel', 'gyro', 'mag', 'rotation')
+    # IMU flag bits
+    IMU_FLAG_VALID = 0x01
+    IMU_FLAG_DEVICE_FILTER = 0x02
+    IMU_FLAG_HEARTBEAT = 0x04
+    IMU_FLAG_GAP = 0x08
 
     def rx_callback(self, sender: int, data: bytearray):
         print(len(data))
-        imu_data_len = 13*4
-        flag_size = 1
-        for i in range(0, len(data)-imu_data_len-flag_size, 2):
-            self.binary_file.write(data[i:i+2])
-        if data[len(data)-1] == 1:
-            motion_floats = [struct.unpack('f', data[i:i+4])[0] for i in range(len(data)-imu_data_len-flag_size, len(data)-flag_size, 4)]
+        if self.rx_stream(data):
+            return
+        if self.handle_line(data):
+            return
+        ypr = None
+        if len(data) == struct.calcsize(self.PACKET_FORMAT):
+            fields = struct.unpack(self.PACKET_FORMAT, data)
+            imu_flag, battery, audio_ts, imu_ts, cal_status = fields[13:18]
+            samples = [(imu_ts, list(fields[0:13]))]
+        elif len(data) == struct.calcsize(self.YPR_PACKET_FORMAT):
+            fields = struct.unpack(self.YPR_PACKET_FORMAT, data)
+            imu_flag, battery, audio_ts, imu_ts, cal_status = fields[13:18]
+            samples = [(imu_ts, list(fields[0:13]))]
+            ypr = list(fields[18:21])
+        elif len(data) == struct.calcsize(self.COMPACT_PACKET_FORMAT):
+            fields = struct.unpack(self.COMPACT_PACKET_FORMAT, data)
+            imu_flag, battery, audio_ts, imu_ts, cal_status = fields[1:6]
+            samples = [(imu_ts, decode_compact(fields[0])[0])]
+        elif len(data) > struct.calcsize(self.DELTA_HEADER_FORMAT):
+            header_len = struct.calcsize(self.DELTA_HEADER_FORMAT)
+            imu_flag, battery, audio_ts, cal_status = struct.unpack(self.DELTA_HEADER_FORMAT, data[:header_len])
+            samples = [(ts, motion) for ts, motion, _ in self.delta.decode(data[header_len:])]
+        else:
+            return
+        # The device is lying still and only sends a heartbeat without audio
+        idle = bool(imu_flag & self.IMU_FLAG_HEARTBEAT)
+        self.publish(idle, None if idle else data[:self.PCM_LEN],
+                     imu_flag, audio_ts, cal_status, samples, ypr)
+
+    def rx_stream(self, data):
+        """Feed v2 stream bytes, from NUS or the L2CAP channel.
+
+        Returns False until the first valid frame, so v1 packets are left
+        to the caller.
+        """
+        frames = self.frames.feed(data)
+        if frames:
+            self.framed = True
+        for frame in frames:
+            self.handle_frame(frame)
+        return self.framed
+
+    def handle_line(self, data):
+        """Forward a line of device output; False if it is not one."""
+        # Reply to the rates command: sensor, shortest and longest report interval [us]
+        if data.startswith(b'rate '):
+            name, min_us, max_us = data.decode().split()[1:4]
+            self.osc.send_message("/rate", [name, int(min_us), int(max_us)])
+            return True
+        # Hub gesture detector: name, detector flags (hex), device timestamp [us]
+        if data.startswith(b'gesture '):
+            name, flags, ts = data.decode().split()[1:4]
+            self.osc.send_message("/gesture", [name, int(flags, 16), int(ts)])
+            return True
+        # Flow control: audio blocks and IMU samples shed, notifications refused
+        if data.startswith(b'drops '):
+            self.osc.send_message("/drops", [int(n) for n in data.decode().split()[1:4]])
+            return True
+        # The IMU stream stopped while the hub recovered from a reset [us]
+        if data.startswith(b'gap '):
+            self.osc.send_message("/motion/gap_us", int(data.decode().split()[1]))
+            return True
+        return False
+
+    # v2 IMU section prefix: IMU flags, calibration status, IMU timestamp
+    IMU_PREFIX_FORMAT = '<BBI'
+    IMU_PREFIX_LEN = struct.calcsize(IMU_PREFIX_FORMAT)
+
+    def handle_frame(self, frame):
+        if self.frames.lost != self.lost:
+            self.lost = self.frames.lost
+            self.osc.send_message("/frames/lost", self.lost)
+        sections = frame.sections
+        if frame.type == frame_v2.TYPE_CONTROL:
+            text = sections.get(frame_v2.SECTION_TEXT, b'')
+            if not self.handle_line(text):
+                print(text.decode(errors='replace'))
+            return
+
+        imu_flag = cal_status = 0
+        samples = []
+        ypr = None
+        if frame_v2.SECTION_IMU in sections:
+            data = sections[frame_v2.SECTION_IMU]
+            imu_flag, cal_status, imu_ts = struct.unpack_from(self.IMU_PREFIX_FORMAT, data)
+            samples = [(imu_ts, list(struct.unpack_from('<13f', data, self.IMU_PREFIX_LEN)))]
+        elif frame_v2.SECTION_IMU_COMPACT in sections:
+            data = sections[frame_v2.SECTION_IMU_COMPACT]
+            imu_flag, cal_status, imu_ts = struct.unpack_from(self.IMU_PREFIX_FORMAT, data)
+            samples = [(imu_ts, decode_compact(data[self.IMU_PREFIX_LEN:])[0])]
+        elif frame_v2.SECTION_IMU_DELTA in sections:
+            data = sections[frame_v2.SECTION_IMU_DELTA]
+            imu_flag, cal_status = data[0], data[1]
+            samples = [(ts, motion) for ts, motion, _ in self.delta.decode(data[2:])]
+        if frame_v2.SECTION_YPR in sections:
+            ypr = list(struct.unpack('<3f', sections[frame_v2.SECTION_YPR]))
+        self.publish(frame.type == frame_v2.TYPE_HEARTBEAT, sections.get(frame_v2.SECTION_PCM),
+                     imu_flag, frame.timestamp_us, cal_status, samples, ypr)
+
+    def publish(self, idle, pcm, imu_flag, audio_ts, cal_status, samples, ypr):
+        if idle != self.idle:
+            self.idle = idle
+            self.osc.send_message("/idle", int(idle))
+        if pcm:
+            self.binary_file.write(pcm)
+        if not imu_flag & self.IMU_FLAG_VALID:
+            return
+        if imu_flag & self.IMU_FLAG_GAP:
+            # Samples before this one are from before the hub reset
+            self.osc.send_message("/motion/gap", 1)
+        if ypr is not None:
+            self.osc.send_message("/motion/ypr", ypr)
+        for imu_ts, motion_floats in samples:
             print(motion_floats)
             self.osc.send_message("/motion", motion_floats)
-            
-    
-
-            
-        
+            # Offset of the IMU sample from the first audio sample of this block [us]
+            self.osc.send_message("/motion/offset_us", (imu_ts - audio_ts + 2**31) % 2**32 - 2**31)
+            # Calibration accuracy per sensor: 0 unreliable .. 3 high
+            self.osc.send_message("/motion/accuracy", [(cal_status >> (2*n)) & 3 for n in range(len(self.CAL_SENSORS))])
+            # 1 when the orientation comes from the device's own filter on raw data
+            self.osc.send_message("/motion/raw", int(bool(imu_flag & self.IMU_FLAG_DEVICE_FILTER)))
 
     async def send(self, message):
         await self.client.write_gatt_char(self.rx_char, bytearray(message.encode('utf8')))
@@ -82,7 +223,7 @@ def get_uart_characteristics(client):
     return (rx, tx)
 
 
-async def rxtx(address_or_device):
+async def rxtx(address_or_device, setup=(), l2cap_psm=None, random_address=True):
     async with BleakClient(address_or_device) as client:
         while not client.is_connected:
             print('Waiting for connection to device')
@@ -93,6 +234,21 @@ async def rxtx(address_or_device):
 
         uart_connection = BLEUARTConnection(client, rx, tx)
         await uart_connection.start()
+        for command in setup:
+            await uart_connection.send(command)
+
+        if l2cap_psm is not None:
+            # The device sends the stream here instead of NUS from now on
+            sock = l2cap_stream.connect(client.address, l2cap_psm, random_address)
+            print('Receiving the stream on L2CAP PSM 0x%02x' % l2cap_psm)
+            loop = asyncio.get_running_loop()
+            while True:
+                sdu = await loop.sock_recv(sock, l2cap_stream.RECV_MTU)
+                if not sdu:
+                    print('L2CAP channel closed, back to NUS')
+                    sock.close()
+                    break
+                uart_connection.rx_stream(sdu)
 
         while True:
             await asyncio.sleep(1)
@@ -120,6 +276,15 @@ if __name__ == '__main__':
     parser.add_argument('--address')
     parser.add_argument('--name')
     parser.add_argument('--scan', default=False, action='store_true')
+    parser.add_argument('--orient', metavar='AXES',
+                        help='set the IMU output frame, e.g. "+y -x +z" or "off"; kept by the device')
+    parser.add_argument('--tare', default=False, action='store_true',
+                        help='take the current orientation as the reference; kept by the device')
+    parser.add_argument('--l2cap', metavar='PSM', nargs='?', const=l2cap_stream.DEFAULT_PSM,
+                        type=lambda x: int(x, 0),
+                        help='receive the stream on an L2CAP channel (Linux, v2 firmware)')
+    parser.add_argument('--public-address', default=False, action='store_true',
+                        help='the device has a public rather than a random static address')
 
     args = parser.parse_args()
 
@@ -143,5 +308,10 @@ if __name__ == '__main__':
 
             target = device
 
-        loop.run_until_complete(rxtx(target))
+        setup = []
+        if args.orient:
+            setup.append('orient ' + args.orient)
+        if args.tare:
+            setup.append('tare')
+        loop.run_until_complete(rxtx(target, setup, args.l2cap, not args.public_address))
 
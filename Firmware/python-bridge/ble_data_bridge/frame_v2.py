@@ -0,0 +1,97 @@
+"""Parser for protocol v2 frames (Firmware/src/frame.h).
+
+Notifications are fed in as they arrive; a frame may span several of them.
+After lost or corrupt bytes the parser skips ahead to the next header whose
+length and CRC check out, and sequence number gaps count the lost frames.
+"""
+import binascii
+import struct
+from collections import namedtuple
+
+MAGIC = 0xA5
+VERSION = 2
+HEADER_FORMAT = '<BBBBHHI'
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+SECTION_HEADER_FORMAT = '<BH'
+SECTION_HEADER_SIZE = struct.calcsize(SECTION_HEADER_FORMAT)
+CRC_SIZE = 2
+# Larger than any frame the device sends
+MAX_FRAME_SIZE = 1024
+
+TYPE_STREAM = 1
+TYPE_HEARTBEAT = 2
+TYPE_CONTROL = 3
+
+SECTION_PCM = 1
+SECTION_IMU = 2
+SECTION_IMU_COMPACT = 3
+SECTION_IMU_DELTA = 4
+SECTION_YPR = 5
+SECTION_BATTERY = 6
+SECTION_TEXT = 7
+
+# sections: {section type: payload}
+Frame = namedtuple('Frame', 'type seq timestamp_us sections')
+
+
+def _sections(body, count):
+    sections = {}
+    pos = 0
+    for _ in range(count):
+        if pos + SECTION_HEADER_SIZE > len(body):
+            return None
+        stype, length = struct.unpack_from(SECTION_HEADER_FORMAT, body, pos)
+        pos += SECTION_HEADER_SIZE
+        if pos + length > len(body):
+            return None
+        sections[stype] = bytes(body[pos:pos + length])
+        pos += length
+    return sections if pos == len(body) else None
+
+
+class FrameParser:
+    def __init__(self):
+        self.buffer = bytearray()
+        self.seq = None
+        # Frames missing from the sequence, and frames dropped for a bad CRC
+        self.lost = 0
+        self.crc_errors = 0
+
+    def feed(self, data):
+        """Add received bytes; returns the frames they complete."""
+        self.buffer += data
+        frames = []
+        while True:
+            start = self.buffer.find(bytes((MAGIC, VERSION)))
+            if start < 0:
+                # A trailing magic byte may be followed by the version
+                keep = 1 if self.buffer[-1:] == bytes((MAGIC,)) else 0
+                del self.buffer[:len(self.buffer) - keep]
+                return frames
+            del self.buffer[:start]
+            if len(self.buffer) < HEADER_SIZE:
+                return frames
+
+            _, _, ftype, count, seq, length, timestamp_us = \
+                struct.unpack_from(HEADER_FORMAT, self.buffer)
+            if not HEADER_SIZE + CRC_SIZE <= length <= MAX_FRAME_SIZE:
+                del self.buffer[:1]
+                continue
+            if len(self.buffer) < length:
+                return frames
+
+            crc, = struct.unpack_from('<H', self.buffer, length - CRC_SIZE)
+            if binascii.crc_hqx(bytes(self.buffer[:length - CRC_SIZE]), 0xFFFF) != crc:
+                self.crc_errors += 1
+                del self.buffer[:1]
+                continue
+            sections = _sections(self.buffer[HEADER_SIZE:length - CRC_SIZE], count)
+            if sections is None:
+                del self.buffer[:1]
+                continue
+
+            if self.seq is not None:
+                self.lost += (seq - self.seq - 1) & 0xFFFF
+            self.seq = seq
+            frames.append(Frame(ftype, seq, timestamp_us, sections))
+            del self.buffer[:length]
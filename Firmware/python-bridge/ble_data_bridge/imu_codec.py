@@ -0,0 +1,65 @@
+"""Decoder for the compact IMU sample encoding (Firmware/src/imu_codec.h).
+
+All scaling is by powers of two and the dropped quaternion component is a
+single correctly rounded sqrt, so the decoded values are exact in IEEE
+double and identical on every host.
+"""
+import math
+import struct
+
+COMPACT_SIZE = 24
+COMPACT_FORMAT = '<I9hH'
+
+QUAT_FIELD_BITS = 10
+QUAT_FIELD_SCALE = 2.0 ** -9
+
+# Quaternion exponent of quantized samples (imu_compact_quantize)
+QUAT_EXP = 14
+
+STATUS_ACCURACY_MASK = 0x3
+STATUS_DEVICE_FILTER = 0x4
+
+
+def _field(word, shift):
+    n = (word >> shift) & ((1 << QUAT_FIELD_BITS) - 1)
+    if n >= 1 << (QUAT_FIELD_BITS - 1):
+        n -= 1 << QUAT_FIELD_BITS
+    return n
+
+
+def decode_quat(word):
+    """Return the quaternion as [i, j, k, real]."""
+    largest = word >> 30
+    small = [_field(word, shift) * QUAT_FIELD_SCALE for shift in (20, 10, 0)]
+    dropped = math.sqrt(max(0.0, 1.0 - sum(c * c for c in small)))
+    small.insert(largest, dropped)
+    return small
+
+
+def decode_scale(scale):
+    """Split a scale word into the (accel, gyro, magn) exponents and status."""
+    return (scale & 0xF, (scale >> 4) & 0xF, (scale >> 8) & 0xF), scale >> 12
+
+
+def dequantize(values, exps):
+    """Scale 13 quantized channels (imu_compact_quantize) back to floats."""
+    motion = [math.ldexp(n, -QUAT_EXP) for n in values[0:4]]
+    for stream in range(3):
+        motion += [math.ldexp(n, -exps[stream]) for n in values[4 + 3 * stream:7 + 3 * stream]]
+    return motion
+
+
+def decode_compact(data):
+    """Decode one compact sample.
+
+    Returns (motion, status): motion is the same 13 values as the float
+    packet (quaternion i, j, k, real, accel xyz, gyro xyz, magn xyz) and
+    status is the 4 bit status nibble.
+    """
+    fields = struct.unpack(COMPACT_FORMAT, bytes(data[:COMPACT_SIZE]))
+    word, vectors, scale = fields[0], fields[1:10], fields[10]
+    exps, status = decode_scale(scale)
+    motion = decode_quat(word)
+    for stream in range(3):
+        motion += [math.ldexp(n, -exps[stream]) for n in vectors[3 * stream:3 * stream + 3]]
+    return motion, status
@@ -0,0 +1,72 @@
+"""Decoder for delta coded IMU sample batches (Firmware/src/imu_delta.h).
+
+The decoder keeps the last sample of the previous batch. After a lost
+packet (sequence gap) it drops batches until the next keyframe.
+"""
+import struct
+
+from imu_codec import decode_scale, dequantize
+
+CHANNELS = 13
+KEYFRAME_FLAG = 0x80
+
+
+def _varint(data, pos):
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def _zigzag(n):
+    return (n >> 1) ^ -(n & 1)
+
+
+class DeltaDecoder:
+    def __init__(self):
+        self.seq = None
+        self.prev = None
+
+    def decode(self, data):
+        """Decode one batch.
+
+        Returns a list of (timestamp_us, motion, status) tuples, motion being
+        the 13 values of the float packet. Empty if the batch carries no
+        samples or cannot be decoded yet.
+        """
+        data = bytes(data)
+        seq, count = data[0], data[1]
+        if self.seq is not None and seq != (self.seq + 1) & 0xFF:
+            self.prev = None
+        self.seq = seq
+
+        key = bool(count & KEYFRAME_FLAG)
+        count &= ~KEYFRAME_FLAG
+        if count == 0:
+            return []
+        if not key and self.prev is None:
+            return []
+
+        scale, ts = struct.unpack_from('<HI', data, 2)
+        exps, status = decode_scale(scale)
+        pos = 8
+        samples = []
+        for n in range(count):
+            if n > 0:
+                dt, pos = _varint(data, pos)
+                ts = (ts + dt) & 0xFFFFFFFF
+            if n == 0 and key:
+                values = list(struct.unpack_from('<%dh' % CHANNELS, data, pos))
+                pos += 2 * CHANNELS
+            else:
+                values = []
+                for c in range(CHANNELS):
+                    delta, pos = _varint(data, pos)
+                    values.append(self.prev[c] + _zigzag(delta))
+            self.prev = values
+            samples.append((ts, dequantize(values, exps), status))
+        return samples
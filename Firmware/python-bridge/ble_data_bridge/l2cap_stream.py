@@ -0,0 +1,57 @@
+"""Receiver for the L2CAP stream channel (Firmware/src/l2cap_stream.h).
+
+Linux only: the channel is opened with a BlueZ L2CAP socket. Python's
+socket module cannot pass an LE address type, so connect() goes through
+libc with a sockaddr_l2 built here. The Bluetooth connection made by bleak
+for NUS is reused by the kernel.
+"""
+import ctypes
+import os
+import socket
+import struct
+
+AF_BLUETOOTH = 31
+BTPROTO_L2CAP = 0
+SOL_BLUETOOTH = 274
+BT_RCVMTU = 13
+BDADDR_LE_PUBLIC = 1
+BDADDR_LE_RANDOM = 2
+
+DEFAULT_PSM = 0x80
+# Larger than any SDU the device sends
+RECV_MTU = 1024
+
+
+class SockaddrL2(ctypes.Structure):
+    _fields_ = [
+        ('l2_family', ctypes.c_ushort),
+        ('l2_psm', ctypes.c_ushort),
+        ('l2_bdaddr', ctypes.c_uint8 * 6),
+        ('l2_cid', ctypes.c_ushort),
+        ('l2_bdaddr_type', ctypes.c_uint8),
+    ]
+
+
+def connect(address, psm=DEFAULT_PSM, random_address=True):
+    """Open the stream channel to the device at address ("xx:xx:..").
+
+    Returns a non-blocking SOCK_SEQPACKET socket; each read is one SDU.
+    """
+    sock = socket.socket(AF_BLUETOOTH, socket.SOCK_SEQPACKET, BTPROTO_L2CAP)
+    sock.setsockopt(SOL_BLUETOOTH, BT_RCVMTU, struct.pack('<H', RECV_MTU))
+
+    addr = SockaddrL2()
+    addr.l2_family = AF_BLUETOOTH
+    addr.l2_psm = psm
+    # bdaddr_t is little endian, the text form big endian
+    addr.l2_bdaddr[:] = bytes.fromhex(address.replace(':', ''))[::-1]
+    addr.l2_bdaddr_type = BDADDR_LE_RANDOM if random_address else BDADDR_LE_PUBLIC
+
+    libc = ctypes.CDLL(None, use_errno=True)
+    if libc.connect(sock.fileno(), ctypes.byref(addr), ctypes.sizeof(addr)) != 0:
+        err = ctypes.get_errno()
+        sock.close()
+        raise OSError(err, os.strerror(err))
+
+    sock.setblocking(False)
+    return sock
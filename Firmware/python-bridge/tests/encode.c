@@ -0,0 +1,181 @@
+/*
+ * Host driver for the firmware stream encoders, used by test_roundtrip.py.
+ *
+ * Reads one command per line on stdin and answers with one line on stdout,
+ * encoded bytes as hex:
+ *
+ *   compact <accel_exp> <gyro_exp> <magn_exp> <status> <13 floats>
+ *   quantize <accel_exp> <gyro_exp> <magn_exp> <13 floats>   -> 13 integers
+ *   delta_reset                                              -> ok
+ *   delta <scale_word> <count> (<timestamp_us> <13 integers>) x count
+ *   frame <type> <timestamp_us> <sections> (<type> <reserve> <hex|->) x sections
+ *
+ * A frame section reserves <reserve> bytes and is trimmed to its payload,
+ * the way the firmware sizes sections it fills in place.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame.h"
+#include "imu_codec.h"
+#include "imu_delta.h"
+
+#define LINE_MAX_SIZE   8192
+#define FRAME_MAX_SIZE  1024
+
+static long next_int(void)
+{
+    const char *tok = strtok(NULL, " \n");
+
+    return tok ? strtol(tok, NULL, 0) : 0;
+}
+
+static float next_float(void)
+{
+    const char *tok = strtok(NULL, " \n");
+
+    return tok ? strtof(tok, NULL) : 0.0f;
+}
+
+static void next_scale(struct imu_compact_scale *scale)
+{
+    scale->accel_exp = (uint8_t)next_int();
+    scale->gyro_exp = (uint8_t)next_int();
+    scale->magn_exp = (uint8_t)next_int();
+}
+
+static void print_hex(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        printf("%02x", data[i]);
+    }
+    printf("\n");
+}
+
+static size_t parse_hex(const char *hex, uint8_t *out)
+{
+    size_t len = 0;
+
+    if (strcmp(hex, "-") == 0) {
+        return 0;
+    }
+
+    for (; hex[0] && hex[1]; hex += 2) {
+        unsigned int byte;
+
+        sscanf(hex, "%2x", &byte);
+        out[len++] = (uint8_t)byte;
+    }
+
+    return len;
+}
+
+static void cmd_compact(void)
+{
+    struct imu_compact_scale scale;
+    float imu_data[13];
+    uint8_t out[IMU_COMPACT_SIZE];
+    uint8_t status;
+
+    next_scale(&scale);
+    status = (uint8_t)next_int();
+    for (int i = 0; i < 13; i++) {
+        imu_data[i] = next_float();
+    }
+
+    imu_compact_encode(imu_data, &scale, status, out);
+    print_hex(out, sizeof(out));
+}
+
+static void cmd_quantize(void)
+{
+    struct imu_compact_scale scale;
+    float imu_data[13];
+    int16_t out[13];
+
+    next_scale(&scale);
+    for (int i = 0; i < 13; i++) {
+        imu_data[i] = next_float();
+    }
+
+    imu_compact_quantize(imu_data, &scale, out);
+    for (int i = 0; i < 13; i++) {
+        printf("%s%d", i ? " " : "", out[i]);
+    }
+    printf("\n");
+}
+
+static void cmd_delta(void)
+{
+    struct imu_delta_sample samples[IMU_DELTA_MAX_SAMPLES];
+    uint8_t out[IMU_DELTA_MAX_SIZE];
+    uint16_t scale_word = (uint16_t)next_int();
+    int count = (int)next_int();
+
+    for (int n = 0; n < count && n < IMU_DELTA_MAX_SAMPLES; n++) {
+        samples[n].timestamp_us = (uint32_t)next_int();
+        for (int c = 0; c < IMU_DELTA_CHANNELS; c++) {
+            samples[n].value[c] = (int16_t)next_int();
+        }
+    }
+
+    print_hex(out, imu_delta_encode(samples, count, scale_word, out));
+}
+
+static void cmd_frame(void)
+{
+    static uint8_t buf[FRAME_MAX_SIZE];
+    static uint8_t payload[FRAME_MAX_SIZE];
+    struct frame_writer w;
+    enum frame_type type = (enum frame_type)next_int();
+    uint32_t timestamp_us = (uint32_t)next_int();
+    int sections = (int)next_int();
+
+    frame_begin(&w, buf, sizeof(buf), type, timestamp_us);
+    for (int n = 0; n < sections; n++) {
+        enum frame_section stype = (enum frame_section)next_int();
+        size_t reserve = (size_t)next_int();
+        size_t len = parse_hex(strtok(NULL, " \n"), payload);
+        uint8_t *p = frame_section(&w, stype, reserve);
+
+        if (p == NULL) {
+            printf("error\n");
+            return;
+        }
+        memcpy(p, payload, len);
+        frame_trim(&w, len);
+    }
+
+    print_hex(buf, frame_end(&w));
+}
+
+int main(void)
+{
+    static char line[LINE_MAX_SIZE];
+
+    while (fgets(line, sizeof(line), stdin)) {
+        const char *cmd = strtok(line, " \n");
+
+        if (cmd == NULL) {
+            continue;
+        } else if (strcmp(cmd, "compact") == 0) {
+            cmd_compact();
+        } else if (strcmp(cmd, "quantize") == 0) {
+            cmd_quantize();
+        } else if (strcmp(cmd, "delta_reset") == 0) {
+            imu_delta_reset();
+            printf("ok\n");
+        } else if (strcmp(cmd, "delta") == 0) {
+            cmd_delta();
+        } else if (strcmp(cmd, "frame") == 0) {
+            cmd_frame();
+        } else {
+            printf("error\n");
+        }
+        // Answer each line as it comes, the test waits for it
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,299 @@
+"""Round trip of the stream encoding: firmware encoder to bridge parser.
+
+Builds Firmware/src/frame.c, imu_codec.c and imu_delta.c for the host (with
+stand-ins for the Zephyr headers they use, in zephyr_shim/) around the
+encode.c driver, encodes known samples and frames with them and checks that
+frame_v2.py, imu_codec.py and imu_delta.py read back the same values.
+
+Run from Firmware/python-bridge:
+
+    python -m unittest discover tests
+
+Needs a C compiler, $CC or cc; the tests are skipped without one.
+"""
+import math
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+FIRMWARE_SRC = os.path.join(HERE, '..', '..', 'src')
+sys.path.insert(0, os.path.join(HERE, '..', 'ble_data_bridge'))
+
+import frame_v2  # noqa: E402
+from imu_codec import decode_compact, decode_scale, dequantize, QUAT_FIELD_SCALE  # noqa: E402
+from imu_delta import DeltaDecoder  # noqa: E402
+
+FIRMWARE_SOURCES = ('frame.c', 'imu_codec.c', 'imu_delta.c')
+
+# Scale exponents of imu_codec.h: fusion mode, and raw mode counts
+FUSION_EXPS = (8, 9, 4)
+RAW_EXPS = (0, 9, 0)
+
+
+def f32(value):
+    """Round to the float the firmware holds."""
+    return struct.unpack('<f', struct.pack('<f', value))[0]
+
+
+def scale_word(exps, status):
+    return exps[0] | (exps[1] << 4) | (exps[2] << 8) | (status << 12)
+
+
+class Encoder:
+    """The firmware encoders, built for the host and driven over a pipe."""
+
+    def __init__(self, workdir):
+        cc = os.environ.get('CC', 'cc')
+        if shutil.which(cc) is None:
+            raise unittest.SkipTest('no C compiler (%s)' % cc)
+        exe = os.path.join(workdir, 'encode')
+        sources = [os.path.join(HERE, 'encode.c')]
+        sources += [os.path.join(FIRMWARE_SRC, name) for name in FIRMWARE_SOURCES]
+        subprocess.run([cc, '-std=c11', '-O2', '-Wall', '-Werror',
+                        '-I', os.path.join(HERE, 'zephyr_shim'), '-I', FIRMWARE_SRC,
+                        '-o', exe] + sources + ['-lm'], check=True)
+        self.proc = subprocess.Popen([exe], stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                     universal_newlines=True)
+
+    def close(self):
+        self.proc.stdin.close()
+        self.proc.wait()
+
+    def _call(self, *args):
+        self.proc.stdin.write(' '.join(str(a) for a in args) + '\n')
+        self.proc.stdin.flush()
+        reply = self.proc.stdout.readline().strip()
+        if reply == 'error':
+            raise ValueError('encoder rejected %r' % (args,))
+        return reply
+
+    def compact(self, imu_data, exps, status):
+        return bytes.fromhex(self._call('compact', *exps, status,
+                                        *(float.hex(v) for v in imu_data)))
+
+    def quantize(self, imu_data, exps):
+        reply = self._call('quantize', *exps, *(float.hex(v) for v in imu_data))
+        return [int(n) for n in reply.split()]
+
+    def delta_reset(self):
+        self._call('delta_reset')
+
+    def delta(self, samples, word):
+        args = []
+        for timestamp_us, values in samples:
+            args += [timestamp_us] + list(values)
+        return bytes.fromhex(self._call('delta', word, len(samples), *args))
+
+    def frame(self, ftype, timestamp_us, sections):
+        """sections: (type, payload, bytes reserved before trimming)"""
+        args = []
+        for stype, payload, reserve in sections:
+            args += [stype, reserve, payload.hex() or '-']
+        return bytes.fromhex(self._call('frame', ftype, timestamp_us, len(sections), *args))
+
+
+encoder = None
+workdir = None
+
+
+def setUpModule():
+    global encoder, workdir
+    workdir = tempfile.mkdtemp()
+    try:
+        encoder = Encoder(workdir)
+    except BaseException:
+        shutil.rmtree(workdir)
+        raise
+
+
+def tearDownModule():
+    encoder.close()
+    shutil.rmtree(workdir)
+
+
+def random_sample(rng, exps):
+    """13 floats as the firmware packs them: quaternion, accel, gyro, magn."""
+    quat = [rng.gauss(0.0, 1.0) for _ in range(4)]
+    norm = math.sqrt(sum(c * c for c in quat))
+    limits = [2.0 ** (15 - e) for e in exps]
+    sample = [c / norm for c in quat]
+    for limit in limits:
+        # Mostly in range, sometimes past it to check saturation
+        sample += [rng.uniform(-1.1, 1.1) * limit for _ in range(3)]
+    return [f32(v) for v in sample]
+
+
+class CompactTest(unittest.TestCase):
+    def check(self, imu_data, exps, status):
+        motion, decoded_status = decode_compact(encoder.compact(imu_data, exps, status))
+        self.assertEqual(decoded_status, status)
+
+        # Vectors: exactly the firmware's quantized values, scaled back
+        quantized = encoder.quantize(imu_data, exps)
+        self.assertEqual(motion[4:], dequantize(quantized, exps)[4:])
+        for n in range(4, 13):
+            step = 2.0 ** -exps[(n - 4) // 3]
+            if abs(imu_data[n]) < 32767 * step:
+                self.assertLessEqual(abs(motion[n] - imu_data[n]), step / 2)
+
+        # Quaternion: same rotation, within the 10 bit field resolution
+        quat = imu_data[0:4]
+        sign = math.copysign(1.0, sum(a * b for a, b in zip(motion[0:4], quat)))
+        for a, b in zip(motion[0:4], quat):
+            self.assertAlmostEqual(sign * a, b, delta=4 * QUAT_FIELD_SCALE)
+
+    def test_random_samples(self):
+        rng = random.Random(1)
+        for n in range(200):
+            exps = RAW_EXPS if n % 4 == 3 else FUSION_EXPS
+            self.check(random_sample(rng, exps), exps, n % 16)
+
+    def test_axis_quaternions(self):
+        zero = [0.0] * 9
+        for largest in range(4):
+            for sign in (1.0, -1.0):
+                quat = [0.0] * 4
+                quat[largest] = sign
+                self.check(quat + zero, FUSION_EXPS, 0)
+
+    def test_no_orientation_is_identity(self):
+        motion, _ = decode_compact(encoder.compact([0.0] * 13, FUSION_EXPS, 0))
+        self.assertEqual(motion[0:4], [0.0, 0.0, 0.0, 1.0])
+
+
+class DeltaTest(unittest.TestCase):
+    def setUp(self):
+        encoder.delta_reset()
+        self.rng = random.Random(2)
+        self.values = [0] * 13
+        self.timestamp_us = 0xFFFF0000
+
+    def next_sample(self):
+        rng = self.rng
+        if rng.random() < 0.05:
+            # Full scale jump, the longest varints
+            self.values = [rng.choice((-32768, 32767)) for _ in range(13)]
+        else:
+            self.values = [max(-32768, min(32767, v + rng.randint(-300, 300)))
+                           for v in self.values]
+        # Wraps the 32 bit timebase partway through
+        self.timestamp_us = (self.timestamp_us + rng.choice((2500, 2500, 2501, 70000))) \
+            & 0xFFFFFFFF
+        return self.timestamp_us, list(self.values)
+
+    def batch(self, word, count=None):
+        count = self.rng.randint(1, 6) if count is None else count
+        samples = [self.next_sample() for _ in range(count)]
+        return samples, encoder.delta(samples, word)
+
+    def expected(self, samples, word):
+        exps, status = decode_scale(word)
+        return [(ts, dequantize(values, exps), status) for ts, values in samples]
+
+    def test_batches(self):
+        decoder = DeltaDecoder()
+        words = [scale_word(FUSION_EXPS, 3)] * 40 + [scale_word(RAW_EXPS, 7)] * 10
+        keys = []
+        first_seq = None
+        for n, word in enumerate(words):
+            samples, packet = self.batch(word)
+            keys.append(bool(packet[1] & 0x80))
+            first_seq = packet[0] if first_seq is None else first_seq
+            self.assertEqual(packet[0], (first_seq + n) & 0xFF)
+            self.assertEqual(decoder.decode(packet), self.expected(samples, word))
+        # First batch, every 32nd after it and on a scale change
+        self.assertEqual([n for n, key in enumerate(keys) if key], [0, 32, 40])
+
+    def test_empty_batch(self):
+        decoder = DeltaDecoder()
+        word = scale_word(FUSION_EXPS, 0)
+        samples, packet = self.batch(word)
+        self.assertEqual(decoder.decode(packet), self.expected(samples, word))
+        self.assertEqual(decoder.decode(encoder.delta([], word)), [])
+        samples, packet = self.batch(word)
+        self.assertEqual(decoder.decode(packet), self.expected(samples, word))
+
+    def test_resync_after_lost_batch(self):
+        decoder = DeltaDecoder()
+        word = scale_word(FUSION_EXPS, 0)
+        decoder.decode(self.batch(word)[1])
+        self.batch(word)
+        # Deltas against the lost batch cannot be decoded
+        self.assertEqual(decoder.decode(self.batch(word)[1]), [])
+        encoder.delta_reset()
+        samples, packet = self.batch(word)
+        self.assertEqual(decoder.decode(packet), self.expected(samples, word))
+
+
+class FrameTest(unittest.TestCase):
+    def frames(self):
+        rng = random.Random(3)
+        pcm = bytes(rng.randrange(256) for _ in range(320))
+        compact = encoder.compact(random_sample(rng, FUSION_EXPS), FUSION_EXPS, 3)
+        imu = bytes((1, 3)) + struct.pack('<I', 123456) + compact
+        ypr = struct.pack('<3f', 10.5, -3.25, 90.0)
+        return [
+            (frame_v2.TYPE_STREAM, 1000,
+             [(frame_v2.SECTION_PCM, pcm, len(pcm)),
+              (frame_v2.SECTION_IMU_COMPACT, imu, len(imu)),
+              (frame_v2.SECTION_YPR, ypr, len(ypr))]),
+            (frame_v2.TYPE_HEARTBEAT, 0xFFFFFFFF,
+             [(frame_v2.SECTION_BATTERY, struct.pack('<f', 87.5), 4)]),
+            # Trimmed from the space reserved for the longest line
+            (frame_v2.TYPE_CONTROL, 2000, [(frame_v2.SECTION_TEXT, b'rates 2500 100000', 200)]),
+            (frame_v2.TYPE_STREAM, 3000, [(frame_v2.SECTION_PCM, b'', 0)]),
+            (frame_v2.TYPE_HEARTBEAT, 4000, []),
+        ]
+
+    def encode(self, frames):
+        return [encoder.frame(*frame) for frame in frames]
+
+    def check(self, parsed, frames):
+        self.assertEqual(len(parsed), len(frames))
+        for got, (ftype, timestamp_us, sections) in zip(parsed, frames):
+            self.assertEqual(got.type, ftype)
+            self.assertEqual(got.timestamp_us, timestamp_us)
+            self.assertEqual(got.sections, {stype: payload for stype, payload, _ in sections})
+        for a, b in zip(parsed, parsed[1:]):
+            self.assertEqual(b.seq, (a.seq + 1) & 0xFFFF)
+
+    def test_frames_split_across_notifications(self):
+        frames = self.frames()
+        stream = b''.join(self.encode(frames))
+        rng = random.Random(4)
+        parser = frame_v2.FrameParser()
+        parsed = []
+        pos = 0
+        while pos < len(stream):
+            size = rng.randint(1, 244)
+            parsed += parser.feed(stream[pos:pos + size])
+            pos += size
+        self.check(parsed, frames)
+        self.assertEqual((parser.lost, parser.crc_errors), (0, 0))
+
+    def test_resync_after_corruption_and_loss(self):
+        frames = self.frames()
+        encoded = self.encode(frames)
+        corrupt = bytearray(encoded[1])
+        corrupt[len(corrupt) // 2] ^= 0x40
+        # Second frame corrupted, third lost entirely, fourth truncated
+        stream = encoded[0] + bytes(corrupt) + encoded[3][:-5] + encoded[4]
+        parser = frame_v2.FrameParser()
+        parsed = parser.feed(stream)
+        self.assertEqual([frame.seq for frame in parsed],
+                         [parsed[0].seq, (parsed[0].seq + 4) & 0xFFFF])
+        for got, (ftype, timestamp_us, _) in zip(parsed, [frames[0], frames[4]]):
+            self.assertEqual((got.type, got.timestamp_us), (ftype, timestamp_us))
+        self.assertEqual(parser.lost, 3)
+        # The truncated frame's length runs into the next one, failing its CRC too
+        self.assertEqual(parser.crc_errors, 2)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,14 @@
+#ifndef ZEPHYR_SHIM_KERNEL_H
+#define ZEPHYR_SHIM_KERNEL_H
+
+#include <zephyr/types.h>
+
+typedef long atomic_t;
+
+// Returns the value before the increment, like Zephyr's
+static inline atomic_t atomic_inc(atomic_t *target)
+{
+    return (*target)++;
+}
+
+#endif /* ZEPHYR_SHIM_KERNEL_H */
@@ -0,0 +1,20 @@
+#ifndef ZEPHYR_SHIM_SYS_CRC_H
+#define ZEPHYR_SHIM_SYS_CRC_H
+
+#include <stddef.h>
+#include <zephyr/types.h>
+
+// CRC-16/CCITT, poly 0x1021, MSB first, no final XOR, as in Zephyr
+static inline uint16_t crc16_itu_t(uint16_t seed, const uint8_t *src, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        seed ^= (uint16_t)(src[i] << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            seed = (seed & 0x8000) ? (uint16_t)((seed << 1) ^ 0x1021) : (uint16_t)(seed << 1);
+        }
+    }
+
+    return seed;
+}
+
+#endif /* ZEPHYR_SHIM_SYS_CRC_H */
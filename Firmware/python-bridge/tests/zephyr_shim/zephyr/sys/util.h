@@ -0,0 +1,11 @@
+#ifndef ZEPHYR_SHIM_SYS_UTIL_H
+#define ZEPHYR_SHIM_SYS_UTIL_H
+
+#define BIT(n)              (1UL << (n))
+#define BIT_MASK(n)         (BIT(n) - 1UL)
+#define MIN(a, b)           (((a) < (b)) ? (a) : (b))
+#define MAX(a, b)           (((a) > (b)) ? (a) : (b))
+#define CLAMP(val, low, high) (((val) <= (low)) ? (low) : MIN(val, high))
+#define ARRAY_SIZE(array)   (sizeof(array) / sizeof((array)[0]))
+
+#endif /* ZEPHYR_SHIM_SYS_UTIL_H */
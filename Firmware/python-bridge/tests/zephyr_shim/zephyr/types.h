@@ -0,0 +1,12 @@
+/*
+ * Host stand-ins for the few Zephyr headers the stream encoders use, so
+ * frame.c, imu_codec.c and imu_delta.c build unchanged for the round trip
+ * test.
+ */
+#ifndef ZEPHYR_SHIM_TYPES_H
+#define ZEPHYR_SHIM_TYPES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#endif /* ZEPHYR_SHIM_TYPES_H */
@@ -207,9 +207,11 @@ int battery_monitor_init(void)
     
     k_mutex_init(&battery_mutex);
     
-    // Get ADC device
+    // Get ADC device, absent on simulated boards
+#if DT_NODE_HAS_STATUS(DT_NODELABEL(adc), okay)
     adc_dev = DEVICE_DT_GET(DT_NODELABEL(adc));
-    if (!device_is_ready(adc_dev)) {
+#endif
+    if (!adc_dev || !device_is_ready(adc_dev)) {
         LOG_ERR("ADC device not ready");
         return -ENODEV;
     }
@@ -226,8 +228,13 @@ int battery_monitor_init(void)
     
     battery_initialized = true;
     
-    // Perform initial reading after a short delay to ensure system stability
-    k_work_reschedule(&battery_work, K_MSEC(1000));
+    // Take the first reading right away so the SoC is valid as soon as
+    // init returns, then continue periodically
+    ret = battery_read_adc();
+    if (ret < 0) {
+        LOG_WRN("Initial battery reading failed: %d", ret);
+    }
+    k_work_reschedule(&battery_work, K_MSEC(BATTERY_SAMPLE_INTERVAL_MS));
     
     LOG_INF("Battery monitor initialized successfully");
     
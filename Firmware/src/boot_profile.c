@@ -0,0 +1,96 @@
+#include "boot_profile.h"
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(boot_profile, LOG_LEVEL_INF);
+
+static K_EVENT_DEFINE(boot_events);
+static atomic_t summary_logged;
+
+// Time each phase was reached, in microseconds since kernel start
+static uint32_t phase_us[BOOT_PHASE_COUNT];
+
+static const char *const phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_PHASE_MAIN] = "main",
+    [BOOT_PHASE_DMIC_READY] = "dmic ready",
+    [BOOT_PHASE_BATTERY_READY] = "battery ready",
+    [BOOT_PHASE_BT_READY] = "bt ready",
+    [BOOT_PHASE_SETTINGS_LOADED] = "settings loaded",
+    [BOOT_PHASE_ADVERTISING] = "advertising",
+    [BOOT_PHASE_IMU_READY] = "imu ready",
+    [BOOT_PHASE_FIRST_AUDIO] = "first audio",
+    [BOOT_PHASE_FIRST_IMU] = "first imu",
+};
+
+/**
+ * @brief Log all phase times once every phase has been reached
+ */
+static void boot_profile_log(void)
+{
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        LOG_INF("%-16s %6u us", phase_names[i], phase_us[i]);
+    }
+}
+
+/**
+ * @brief Mark a boot phase as complete
+ *
+ * Only the first call for a phase records a time; later calls are ignored.
+ * @param phase Completed phase
+ */
+void boot_profile_mark(enum boot_phase phase)
+{
+    uint32_t now_us = (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+
+    if (phase >= BOOT_PHASE_COUNT || boot_profile_reached(phase)) {
+        return;
+    }
+
+    phase_us[phase] = now_us;
+    k_event_post(&boot_events, BOOT_PHASE_BIT(phase));
+
+    LOG_DBG("boot phase %s at %u us", phase_names[phase], now_us);
+
+    if ((boot_profile_wait(BOOT_PHASE_ALL, K_NO_WAIT) == 0) &&
+        atomic_cas(&summary_logged, 0, 1)) {
+        boot_profile_log();
+    }
+}
+
+/**
+ * @brief Get the time a boot phase was reached
+ * @param phase Phase to query
+ * @return Microseconds since kernel start, or 0 if not reached yet
+ */
+uint32_t boot_profile_get_us(enum boot_phase phase)
+{
+    if (phase >= BOOT_PHASE_COUNT || !boot_profile_reached(phase)) {
+        return 0;
+    }
+
+    return phase_us[phase];
+}
+
+/**
+ * @brief Check whether a boot phase has been reached
+ * @param phase Phase to query
+ * @return true if the phase has been marked
+ */
+bool boot_profile_reached(enum boot_phase phase)
+{
+    return (k_event_wait(&boot_events, BOOT_PHASE_BIT(phase), false, K_NO_WAIT) != 0);
+}
+
+/**
+ * @brief Wait until all given boot phases have been reached
+ * @param phases Mask of BOOT_PHASE_BIT() values
+ * @param timeout How long to wait
+ * @return 0 on success, -EAGAIN on timeout
+ */
+int boot_profile_wait(uint32_t phases, k_timeout_t timeout)
+{
+    if (k_event_wait_all(&boot_events, phases, false, timeout) == 0) {
+        return -EAGAIN;
+    }
+
+    return 0;
+}
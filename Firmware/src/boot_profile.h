@@ -0,0 +1,37 @@
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <zephyr/kernel.h>
+
+/*
+ * Boot phase timestamps and readiness events.
+ *
+ * Each phase is marked once, when it completes. Marking a phase records the
+ * time since kernel start and posts the phase's bit on an event object so
+ * other threads can wait for it instead of sleeping. Time spent in the
+ * bootloader before the kernel starts is not included.
+ */
+
+enum boot_phase {
+    BOOT_PHASE_MAIN,             // main() entered, drivers initialized
+    BOOT_PHASE_DMIC_READY,       // DMIC configured
+    BOOT_PHASE_BATTERY_READY,    // First battery reading taken
+    BOOT_PHASE_BT_READY,         // Bluetooth enabled
+    BOOT_PHASE_SETTINGS_LOADED,  // Settings (bonds, calibration) loaded
+    BOOT_PHASE_ADVERTISING,      // Advertising started
+    BOOT_PHASE_IMU_READY,        // Sensor hub up and reporting
+    BOOT_PHASE_FIRST_AUDIO,      // First audio block read
+    BOOT_PHASE_FIRST_IMU,        // First IMU sample queued
+    BOOT_PHASE_COUNT
+};
+
+#define BOOT_PHASE_BIT(phase) BIT(phase)
+#define BOOT_PHASE_ALL        BIT_MASK(BOOT_PHASE_COUNT)
+
+// Function prototypes
+void boot_profile_mark(enum boot_phase phase);
+uint32_t boot_profile_get_us(enum boot_phase phase);
+bool boot_profile_reached(enum boot_phase phase);
+int boot_profile_wait(uint32_t phases, k_timeout_t timeout);
+
+#endif /* BOOT_PROFILE_H */
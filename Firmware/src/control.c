@@ -0,0 +1,391 @@
+#include "control.h"
+#include "flow.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(control, LOG_LEVEL_INF);
+
+static atomic_t imu_mode = ATOMIC_INIT(BNO08X_MODE_FUSION);
+#ifdef CONFIG_METABOW_GESTURES
+static atomic_t gestures = ATOMIC_INIT(CONFIG_METABOW_GESTURES_DEFAULT);
+#else
+static atomic_t gestures;
+#endif
+
+static const struct device *imu_dev;
+static control_reply_t reply_cb;
+static control_reply_t event_cb;
+static struct k_work rates_work;
+static struct k_work drops_work;
+
+// Latest orientation request, taken by the IMU thread
+static struct k_spinlock orient_lock;
+static struct control_orient orient_req;
+
+static const char *const sensor_names[BNO08X_SENSOR_COUNT] = {
+    [BNO08X_SENSOR_ACCEL] = "accel",
+    [BNO08X_SENSOR_GYRO] = "gyro",
+    [BNO08X_SENSOR_MAGN] = "magn",
+    [BNO08X_SENSOR_ROTATION_VEC] = "rotation",
+    [BNO08X_SENSOR_RAW_ACCEL] = "raw_accel",
+    [BNO08X_SENSOR_RAW_GYRO] = "raw_gyro",
+    [BNO08X_SENSOR_RAW_MAGN] = "raw_magn",
+};
+
+static const char *const gesture_names[BNO08X_GESTURE_COUNT] = {
+    [BNO08X_GESTURE_TAP] = "tap",
+    [BNO08X_GESTURE_SHAKE] = "shake",
+    [BNO08X_GESTURE_FLIP] = "flip",
+    [BNO08X_GESTURE_PICKUP] = "pickup",
+    [BNO08X_GESTURE_CIRCLE] = "circle",
+};
+
+/**
+ * @brief Send the supported report intervals, from the system work queue
+ * rather than the Bluetooth RX context
+ */
+static void rates_work_handler(struct k_work *work)
+{
+    struct bno08x_sensor_info info;
+    char line[CONTROL_REPLY_MAX_LEN];
+    int len;
+
+    for (int n = 0; n < BNO08X_SENSOR_COUNT; n++) {
+        if (bno08x_sensor_info_get(imu_dev, n, &info) != 0) {
+            continue;
+        }
+
+        len = snprintf(line, sizeof(line), "rate %s %u %u\n", sensor_names[n],
+                       (unsigned int)info.min_period_us, (unsigned int)info.max_period_us);
+        reply_cb(line, MIN((size_t)len, sizeof(line) - 1));
+    }
+}
+
+/**
+ * @brief Send the flow control drop counters, from the system work queue
+ */
+static void drops_work_handler(struct k_work *work)
+{
+    uint32_t drops[FLOW_DROP_COUNT];
+    char line[CONTROL_REPLY_MAX_LEN];
+    int len;
+
+    flow_get_drops(drops);
+    len = snprintf(line, sizeof(line), "drops %u %u %u\n",
+                   (unsigned int)drops[FLOW_DROP_AUDIO], (unsigned int)drops[FLOW_DROP_IMU],
+                   (unsigned int)drops[FLOW_DROP_FAILED]);
+    reply_cb(line, MIN((size_t)len, sizeof(line) - 1));
+}
+
+/**
+ * @brief Handle a "mode" command
+ * @param arg Command argument
+ * @return 0 on success, -EINVAL for an unknown mode
+ */
+static int handle_mode(const char *arg)
+{
+    if (strcmp(arg, "fusion") == 0) {
+        atomic_set(&imu_mode, BNO08X_MODE_FUSION);
+    } else if (strcmp(arg, "raw") == 0) {
+        atomic_set(&imu_mode, BNO08X_MODE_RAW);
+    } else {
+        return -EINVAL;
+    }
+
+    LOG_INF("IMU mode requested: %s", arg);
+    return 0;
+}
+
+/**
+ * @brief Handle a "gestures" command
+ * @param arg Space separated gesture names, or "off"
+ * @return 0 on success, -EINVAL for an unknown gesture, -ENOTSUP if gesture
+ *         events are not built in
+ */
+static int handle_gestures(char *arg)
+{
+    uint8_t mask = 0;
+    char *save;
+
+    if (!IS_ENABLED(CONFIG_METABOW_GESTURES)) {
+        return -ENOTSUP;
+    }
+
+    if (strcmp(arg, "off") != 0) {
+        for (char *name = strtok_r(arg, " ", &save); name != NULL;
+             name = strtok_r(NULL, " ", &save)) {
+            int n;
+
+            for (n = 0; n < BNO08X_GESTURE_COUNT; n++) {
+                if (strcmp(name, gesture_names[n]) == 0) {
+                    break;
+                }
+            }
+            if (n == BNO08X_GESTURE_COUNT) {
+                return -EINVAL;
+            }
+            mask |= BIT(n);
+        }
+    }
+
+    atomic_set(&gestures, mask);
+    LOG_INF("Gestures requested: 0x%02x", mask);
+    return 0;
+}
+
+/**
+ * @brief Convert an axis mapping to the rotation that produces it
+ * @param m Rows are the output axes, as signed sensor axes
+ * @param quat Rotation of the output frame as i, j, k, real
+ */
+static void axes_to_quat(const int8_t m[3][3], float quat[4])
+{
+    // Rotation matrix to quaternion, branch on the largest diagonal term.
+    // m maps sensor components to output components, which is the inverse
+    // of rotating the sensor frame onto the output frame.
+    float trace = m[0][0] + m[1][1] + m[2][2];
+    float s;
+
+    if (trace > 0.0f) {
+        s = 2.0f * sqrtf(1.0f + trace);
+        quat[3] = 0.25f * s;
+        quat[0] = (m[2][1] - m[1][2]) / s;
+        quat[1] = (m[0][2] - m[2][0]) / s;
+        quat[2] = (m[1][0] - m[0][1]) / s;
+    } else if (m[0][0] >= m[1][1] && m[0][0] >= m[2][2]) {
+        s = 2.0f * sqrtf(1.0f + m[0][0] - m[1][1] - m[2][2]);
+        quat[3] = (m[2][1] - m[1][2]) / s;
+        quat[0] = 0.25f * s;
+        quat[1] = (m[0][1] + m[1][0]) / s;
+        quat[2] = (m[0][2] + m[2][0]) / s;
+    } else if (m[1][1] >= m[2][2]) {
+        s = 2.0f * sqrtf(1.0f + m[1][1] - m[0][0] - m[2][2]);
+        quat[3] = (m[0][2] - m[2][0]) / s;
+        quat[0] = (m[0][1] + m[1][0]) / s;
+        quat[1] = 0.25f * s;
+        quat[2] = (m[1][2] + m[2][1]) / s;
+    } else {
+        s = 2.0f * sqrtf(1.0f + m[2][2] - m[0][0] - m[1][1]);
+        quat[3] = (m[1][0] - m[0][1]) / s;
+        quat[0] = (m[0][2] + m[2][0]) / s;
+        quat[1] = (m[1][2] + m[2][1]) / s;
+        quat[2] = 0.25f * s;
+    }
+
+    for (int n = 0; n < 3; n++) {
+        quat[n] = -quat[n];
+    }
+}
+
+/**
+ * @brief Record an orientation request for the IMU thread
+ */
+static void orient_request(const struct control_orient *req)
+{
+    k_spinlock_key_t key = k_spin_lock(&orient_lock);
+
+    orient_req = *req;
+    k_spin_unlock(&orient_lock, key);
+}
+
+/**
+ * @brief Handle an "orient" command
+ * @param arg Three signed sensor axes, or "off"
+ * @return 0 on success, -EINVAL for a malformed mapping or one that mirrors
+ */
+static int handle_orient(char *arg)
+{
+    struct control_orient req = { .op = CONTROL_ORIENT_SET };
+    int8_t m[3][3] = { 0 };
+    char *save;
+    char *tok = strtok_r(arg, " ", &save);
+    int det;
+
+    if (tok != NULL && strcmp(tok, "off") == 0) {
+        // All zero clears the hub's rotation
+        orient_request(&req);
+        return 0;
+    }
+
+    for (int row = 0; row < 3; row++, tok = strtok_r(NULL, " ", &save)) {
+        int8_t sign = 1;
+
+        if (tok == NULL) {
+            return -EINVAL;
+        }
+        if (*tok == '+' || *tok == '-') {
+            sign = (*tok == '-') ? -1 : 1;
+            tok++;
+        }
+        if (tok[0] < 'x' || tok[0] > 'z' || tok[1] != '\0') {
+            return -EINVAL;
+        }
+        m[row][tok[0] - 'x'] = sign;
+    }
+    if (tok != NULL) {
+        return -EINVAL;
+    }
+
+    det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+          m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+          m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    if (det != 1) {
+        // Repeated axis, or a mirror image the hub cannot produce
+        return -EINVAL;
+    }
+
+    axes_to_quat(m, req.quat);
+    orient_request(&req);
+    LOG_INF("IMU frame requested");
+    return 0;
+}
+
+/**
+ * @brief Set up command handling
+ * @param imu IMU device queried by the "rates" command
+ * @param reply Sends command output to the host
+ * @param event Sends unsolicited lines to the host
+ */
+void control_init(const struct device *imu, control_reply_t reply, control_reply_t event)
+{
+    imu_dev = imu;
+    reply_cb = reply;
+    event_cb = event;
+    k_work_init(&rates_work, rates_work_handler);
+    k_work_init(&drops_work, drops_work_handler);
+}
+
+/**
+ * @brief Parse and apply a command received from the host
+ * @param data Command text, not NUL terminated; trailing CR/LF is ignored
+ * @param len Length of data
+ * @return 0 on success, -EINVAL for a malformed or unknown command
+ */
+int control_handle_command(const uint8_t *data, uint16_t len)
+{
+    char cmd[CONTROL_CMD_MAX_LEN + 1];
+
+    while (len > 0 && (data[len - 1] == '\n' || data[len - 1] == '\r')) {
+        len--;
+    }
+
+    if (len == 0 || len > CONTROL_CMD_MAX_LEN) {
+        return -EINVAL;
+    }
+
+    memcpy(cmd, data, len);
+    cmd[len] = '\0';
+
+    if (strncmp(cmd, "mode ", 5) == 0) {
+        return handle_mode(cmd + 5);
+    }
+
+    if (strncmp(cmd, "gestures ", 9) == 0) {
+        return handle_gestures(cmd + 9);
+    }
+
+    if (strncmp(cmd, "orient ", 7) == 0) {
+        return handle_orient(cmd + 7);
+    }
+
+    if (strcmp(cmd, "tare") == 0 || strcmp(cmd, "tare heading") == 0) {
+        struct control_orient req = {
+            .op = (cmd[4] == '\0') ? CONTROL_ORIENT_TARE : CONTROL_ORIENT_TARE_HEADING,
+        };
+
+        orient_request(&req);
+        return 0;
+    }
+
+    if (strcmp(cmd, "rates") == 0) {
+        if (reply_cb == NULL) {
+            return -ENOTSUP;
+        }
+        k_work_submit(&rates_work);
+        return 0;
+    }
+
+    if (strcmp(cmd, "drops") == 0) {
+        if (reply_cb == NULL) {
+            return -ENOTSUP;
+        }
+        k_work_submit(&drops_work);
+        return 0;
+    }
+
+    LOG_WRN("Unknown command: %s", cmd);
+    return -EINVAL;
+}
+
+/**
+ * @brief Get the IMU mode last requested by the host
+ * @return Requested mode
+ */
+enum bno08x_mode control_get_imu_mode(void)
+{
+    return (enum bno08x_mode)atomic_get(&imu_mode);
+}
+
+/**
+ * @brief Tell the host how long the IMU stream stopped for
+ * @param duration_us Length of the outage
+ */
+void control_report_gap(uint32_t duration_us)
+{
+    char line[CONTROL_REPLY_MAX_LEN];
+    int len;
+
+    if (event_cb == NULL) {
+        return;
+    }
+
+    len = snprintf(line, sizeof(line), "gap %u\n", (unsigned int)duration_us);
+    event_cb(line, MIN((size_t)len, sizeof(line) - 1));
+}
+
+/**
+ * @brief Get the gesture detectors last requested by the host
+ * @return BIT(enum bno08x_gesture) mask
+ */
+uint8_t control_get_gestures(void)
+{
+    return (uint8_t)atomic_get(&gestures);
+}
+
+/**
+ * @brief Take the orientation change last requested by the host
+ * @param req Destination
+ * @return true if there was a request since the last call
+ */
+bool control_take_orient(struct control_orient *req)
+{
+    k_spinlock_key_t key = k_spin_lock(&orient_lock);
+
+    *req = orient_req;
+    orient_req.op = CONTROL_ORIENT_NONE;
+    k_spin_unlock(&orient_lock, key);
+
+    return req->op != CONTROL_ORIENT_NONE;
+}
+
+/**
+ * @brief Send a gesture event to the host
+ * @param event Event from the driver
+ * @param timestamp Time of the event on the device timebase
+ */
+void control_report_gesture(const struct bno08x_gesture_event *event, uint32_t timestamp)
+{
+    char line[CONTROL_REPLY_MAX_LEN];
+    int len;
+
+    if (event_cb == NULL || event->gesture >= BNO08X_GESTURE_COUNT) {
+        return;
+    }
+
+    len = snprintf(line, sizeof(line), "gesture %s %x %u\n", gesture_names[event->gesture],
+                   (unsigned int)event->flags, (unsigned int)timestamp);
+    event_cb(line, MIN((size_t)len, sizeof(line) - 1));
+}
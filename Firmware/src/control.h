@@ -0,0 +1,76 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <zephyr/types.h>
+#include <zephyr/device.h>
+#include <drivers/sensor/bno08x.h>
+
+/*
+ * Text commands received from the host over NUS.
+ *
+ * Commands are parsed in the Bluetooth RX context and only record the
+ * requested state; the threads that own the hardware pick it up on their
+ * next iteration.
+ *
+ *   mode fusion   Orientation from the hub's own fusion (default)
+ *   mode raw      Raw sensor reports, orientation from orient_filter
+ *   rates         Reply with the report intervals each sensor supports, one
+ *                 "rate <sensor> <min_us> <max_us>" line per sensor
+ *   gestures <names>
+ *                 Arm the listed gesture detectors (tap, shake, flip, pickup,
+ *                 circle, separated by spaces) and disarm the others;
+ *                 "gestures off" disarms all
+ *   orient <x> <y> <z>
+ *                 Set the IMU output frame: each argument is the sensor axis,
+ *                 with sign, that becomes that output axis, e.g.
+ *                 "orient +y -x +z". Must be a rotation (no mirroring).
+ *                 Stored in the sensor hub; "orient off" clears it
+ *   tare          Take the current orientation as the reference
+ *   tare heading  Only reset the heading
+ *   drops         Reply "drops <audio> <imu> <failed>": audio blocks and IMU
+ *                 samples shed by flow control and notifications the
+ *                 Bluetooth stack refused, since boot
+ *
+ * Unsolicited lines sent to the host:
+ *
+ *   gap <us>      The IMU stream stopped for <us> microseconds while the hub
+ *                 recovered from a reset; the sample after it has
+ *                 IMU_FLAG_GAP set
+ *   gesture <name> <flags> <timestamp>
+ *                 The hub detected a gesture; flags are the detector's
+ *                 output in hex, timestamp is on the device timebase [us]
+ */
+
+// Longest command accepted, without line ending
+#define CONTROL_CMD_MAX_LEN     48
+
+// Longest reply line
+#define CONTROL_REPLY_MAX_LEN   48
+
+// IMU output frame change requested by the host
+enum control_orient_op {
+    CONTROL_ORIENT_NONE,
+    CONTROL_ORIENT_SET,
+    CONTROL_ORIENT_TARE,
+    CONTROL_ORIENT_TARE_HEADING,
+};
+
+struct control_orient {
+    enum control_orient_op op;
+    // CONTROL_ORIENT_SET: rotation as i, j, k, real
+    float quat[4];
+};
+
+// Sends one line of command output or one unsolicited line to the host
+typedef void (*control_reply_t)(const char *line, size_t len);
+
+// Function prototypes
+void control_init(const struct device *imu, control_reply_t reply, control_reply_t event);
+int control_handle_command(const uint8_t *data, uint16_t len);
+enum bno08x_mode control_get_imu_mode(void);
+void control_report_gap(uint32_t duration_us);
+uint8_t control_get_gestures(void);
+bool control_take_orient(struct control_orient *req);
+void control_report_gesture(const struct bno08x_gesture_event *event, uint32_t timestamp);
+
+#endif /* CONTROL_H */
@@ -0,0 +1,397 @@
+#include "fanout.h"
+#include "l2cap_stream.h"
+#include "metabow_svc.h"
+#include <string.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(fanout, LOG_LEVEL_INF);
+
+// Largest notification payload or SDU
+#define FANOUT_BUF_SIZE CONFIG_BT_L2CAP_TX_MTU
+// Each host can hold a different buffer for every credit
+#define FANOUT_BUF_COUNT (CONFIG_METABOW_FLOW_CREDITS * CONFIG_BT_MAX_CONN)
+#define FANOUT_STACK_SIZE 2048
+// As the writer thread, so it hands buffers over as soon as the writer waits
+#define FANOUT_PRIORITY -1
+
+// Payload and the characteristic it is for in the user data, NULL for the stream
+NET_BUF_POOL_FIXED_DEFINE(fanout_pool, FANOUT_BUF_COUNT, FANOUT_BUF_SIZE,
+                          sizeof(const struct bt_gatt_attr *), NULL);
+
+// A buffer waiting for the stack, holding a reference to both
+struct fanout_item {
+    struct bt_conn *conn;
+    struct net_buf *buf;
+};
+
+struct fanout_host {
+    struct bt_conn *conn;
+    struct flow flow;
+    // At most one item per credit
+    struct k_msgq queue;
+    struct fanout_item queue_buf[CONFIG_METABOW_FLOW_CREDITS];
+    struct k_work work;
+};
+
+// Indexed by bt_conn_index()
+static struct fanout_host hosts[CONFIG_BT_MAX_CONN];
+// Guards the host connections; never held while waiting for a credit
+static K_MUTEX_DEFINE(fanout_lock);
+static const struct bt_gatt_attr *fanout_stream_attr;
+
+static K_THREAD_STACK_DEFINE(fanout_stack, FANOUT_STACK_SIZE);
+static struct k_work_q fanout_wq;
+
+static inline const struct bt_gatt_attr **buf_attr(struct net_buf *buf)
+{
+    return net_buf_user_data(buf);
+}
+
+/**
+ * @brief Whether a host takes the stream instead of individual characteristics
+ */
+static bool host_streaming(struct bt_conn *conn)
+{
+#ifdef CONFIG_METABOW_SERVICE
+    if (metabow_svc_streaming(conn)) {
+        return false;
+    }
+#endif
+#ifdef CONFIG_METABOW_L2CAP
+    if (l2cap_stream_ready(conn)) {
+        return true;
+    }
+#endif
+    return bt_gatt_is_subscribed(conn, fanout_stream_attr, BT_GATT_CCC_NOTIFY);
+}
+
+static bool host_wants(struct bt_conn *conn, const struct bt_gatt_attr *attr)
+{
+    if (attr) {
+        return bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_NOTIFY);
+    }
+
+    return host_streaming(conn);
+}
+
+static size_t host_payload_size(struct bt_conn *conn, const struct bt_gatt_attr *attr)
+{
+#ifdef CONFIG_METABOW_L2CAP
+    if (!attr && l2cap_stream_ready(conn)) {
+        return l2cap_stream_mtu(conn);
+    }
+#endif
+    return bt_gatt_get_mtu(conn) - 3;
+}
+
+static void item_release(struct fanout_item *item)
+{
+    net_buf_unref(item->buf);
+    bt_conn_unref(item->conn);
+}
+
+static void fanout_notify_done(struct bt_conn *conn, void *user_data)
+{
+    fanout_sent(conn);
+}
+
+/**
+ * @brief Hand one buffer to the stack for a host
+ * @return 0 if the stack took it, negative error otherwise
+ */
+static int host_deliver(struct bt_conn *conn, struct net_buf *buf)
+{
+    struct bt_gatt_notify_params params = {
+        .attr = *buf_attr(buf) ? *buf_attr(buf) : fanout_stream_attr,
+        .data = buf->data,
+        .len = buf->len,
+        .func = fanout_notify_done,
+    };
+
+#ifdef CONFIG_METABOW_L2CAP
+    if (!*buf_attr(buf) && l2cap_stream_ready(conn)) {
+        return l2cap_stream_send(conn, buf->data, buf->len);
+    }
+#endif
+    return bt_gatt_notify_cb(conn, &params);
+}
+
+/**
+ * @brief Send a host's queued buffers, on the fan-out work queue
+ *
+ * Sending may wait for stack buffers, which the writer never does. Each
+ * item holds its connection, so this needs no lock; an item queued just
+ * before its host disconnected fails to send and returns its credit.
+ */
+static void host_work_handler(struct k_work *work)
+{
+    struct fanout_host *host = CONTAINER_OF(work, struct fanout_host, work);
+    struct fanout_item item;
+
+    while (k_msgq_get(&host->queue, &item, K_NO_WAIT) == 0) {
+        if (host_deliver(item.conn, item.buf) != 0) {
+            flow_give(&host->flow);
+            flow_drop(FLOW_DROP_FAILED, 1);
+        }
+        item_release(&item);
+    }
+}
+
+/**
+ * @brief Drop a host's queued buffers
+ */
+static void host_purge(struct fanout_host *host)
+{
+    struct fanout_item item;
+
+    while (k_msgq_get(&host->queue, &item, K_NO_WAIT) == 0) {
+        item_release(&item);
+    }
+}
+
+/**
+ * @brief Start the sender, call once Bluetooth is enabled
+ * @param stream_attr Characteristic value of the stream without an L2CAP
+ * channel, the NUS TX characteristic
+ */
+void fanout_init(const struct bt_gatt_attr *stream_attr)
+{
+    fanout_stream_attr = stream_attr;
+
+    for (size_t n = 0; n < ARRAY_SIZE(hosts); n++) {
+        k_msgq_init(&hosts[n].queue, (char *)hosts[n].queue_buf, sizeof(struct fanout_item),
+                    ARRAY_SIZE(hosts[n].queue_buf));
+        k_work_init(&hosts[n].work, host_work_handler);
+        flow_init(&hosts[n].flow);
+    }
+
+    k_work_queue_start(&fanout_wq, fanout_stack, K_THREAD_STACK_SIZEOF(fanout_stack),
+                       FANOUT_PRIORITY, NULL);
+    k_thread_name_set(&fanout_wq.thread, "fanout");
+}
+
+/**
+ * @brief Add a host, from the connected callback
+ * @param conn New connection
+ * @return Number of connected hosts, negative error if there is no room
+ */
+int fanout_connected(struct bt_conn *conn)
+{
+    struct fanout_host *host = &hosts[bt_conn_index(conn)];
+    int count = 0;
+
+    k_mutex_lock(&fanout_lock, K_FOREVER);
+    if (host->conn) {
+        k_mutex_unlock(&fanout_lock);
+        return -EALREADY;
+    }
+
+    host_purge(host);
+    flow_reset(&host->flow);
+    host->conn = bt_conn_ref(conn);
+
+    for (size_t n = 0; n < ARRAY_SIZE(hosts); n++) {
+        count += (hosts[n].conn != NULL);
+    }
+    k_mutex_unlock(&fanout_lock);
+
+    return count;
+}
+
+/**
+ * @brief Remove a host, from the disconnected callback
+ * @param conn Connection that went down
+ * @return Number of hosts still connected
+ */
+int fanout_disconnected(struct bt_conn *conn)
+{
+    struct fanout_host *host = &hosts[bt_conn_index(conn)];
+    int count = 0;
+
+    k_mutex_lock(&fanout_lock, K_FOREVER);
+    if (host->conn == conn) {
+        bt_conn_unref(host->conn);
+        host->conn = NULL;
+    }
+    host_purge(host);
+
+    for (size_t n = 0; n < ARRAY_SIZE(hosts); n++) {
+        count += (hosts[n].conn != NULL);
+    }
+    k_mutex_unlock(&fanout_lock);
+
+    return count;
+}
+
+/**
+ * @brief Whether any host wants a characteristic or the stream
+ *
+ * Lets the writer skip encoding what nobody receives.
+ *
+ * @param attr Characteristic value, NULL for the stream
+ */
+bool fanout_wants(const struct bt_gatt_attr *attr)
+{
+    bool wants = false;
+
+    k_mutex_lock(&fanout_lock, K_FOREVER);
+    for (size_t n = 0; n < ARRAY_SIZE(hosts) && !wants; n++) {
+        wants = hosts[n].conn && host_wants(hosts[n].conn, attr);
+    }
+    k_mutex_unlock(&fanout_lock);
+
+    return wants;
+}
+
+/**
+ * @brief Largest payload every host wanting a characteristic or the stream takes
+ * @param attr Characteristic value, NULL for the stream
+ * @return Notification payload or SDU size, the largest possible without hosts
+ */
+size_t fanout_payload_size(const struct bt_gatt_attr *attr)
+{
+    size_t size = FANOUT_BUF_SIZE - 3;
+
+    k_mutex_lock(&fanout_lock, K_FOREVER);
+    for (size_t n = 0; n < ARRAY_SIZE(hosts); n++) {
+        if (hosts[n].conn && host_wants(hosts[n].conn, attr)) {
+            size = MIN(size, host_payload_size(hosts[n].conn, attr));
+        }
+    }
+    k_mutex_unlock(&fanout_lock);
+
+    return size;
+}
+
+/**
+ * @brief Decide what to shed from the next block
+ *
+ * Called by the writer thread once per block. A host falling behind the
+ * others misses whole notifications rather than making them all shed.
+ *
+ * @return Least shedding any host receiving stream data needs
+ */
+enum flow_shed fanout_shed(void)
+{
+    enum flow_shed level = FLOW_SHED_IMU;
+    bool any = false;
+
+    k_mutex_lock(&fanout_lock, K_FOREVER);
+    for (size_t n = 0; n < ARRAY_SIZE(hosts); n++) {
+        struct bt_conn *conn = hosts[n].conn;
+
+#ifdef CONFIG_METABOW_SERVICE
+        if (!conn || !(host_streaming(conn) || metabow_svc_streaming(conn))) {
+            continue;
+        }
+#else
+        if (!conn || !host_streaming(conn)) {
+            continue;
+        }
+#endif
+        level = MIN(level, flow_shed(&hosts[n].flow));
+        any = true;
+    }
+    k_mutex_unlock(&fanout_lock);
+
+    return any ? level : FLOW_SHED_NONE;
+}
+
+/**
+ * @brief Queue a notification for every host that wants it
+ *
+ * The payload is copied once into a shared buffer. A host that has no
+ * free credit within the timeout misses it. Credits are waited for on a
+ * snapshot of the connections, without the lock, so the hosts' work items
+ * can return them meanwhile and connection changes are not held up.
+ *
+ * @param attr Characteristic value, NULL for the stream
+ * @param data Payload
+ * @param len Payload length, at most fanout_payload_size()
+ * @param timeout How long to wait for each host's credit
+ */
+void fanout_send(const struct bt_gatt_attr *attr, const uint8_t *data, size_t len,
+                 k_timeout_t timeout)
+{
+    struct bt_conn *conns[ARRAY_SIZE(hosts)];
+    struct net_buf *buf = NULL;
+
+    k_mutex_lock(&fanout_lock, K_FOREVER);
+    for (size_t n = 0; n < ARRAY_SIZE(hosts); n++) {
+        conns[n] = hosts[n].conn ? bt_conn_ref(hosts[n].conn) : NULL;
+    }
+    k_mutex_unlock(&fanout_lock);
+
+    for (size_t n = 0; n < ARRAY_SIZE(hosts); n++) {
+        struct fanout_host *host = &hosts[n];
+        struct fanout_item item;
+
+        if (!conns[n] || !host_wants(conns[n], attr)) {
+            continue;
+        }
+
+        if (len > host_payload_size(conns[n], attr) ||
+            flow_take(&host->flow, timeout) != 0) {
+            flow_drop(FLOW_DROP_FAILED, 1);
+            continue;
+        }
+
+        if (!buf) {
+            buf = net_buf_alloc(&fanout_pool, K_NO_WAIT);
+            if (!buf) {
+                // Cannot happen with every buffer covered by a credit
+                LOG_ERR("Out of fan-out buffers");
+                flow_give(&host->flow);
+                flow_drop(FLOW_DROP_FAILED, 1);
+                continue;
+            }
+            *buf_attr(buf) = attr;
+            net_buf_add_mem(buf, data, len);
+        }
+
+        item.conn = bt_conn_ref(conns[n]);
+        item.buf = net_buf_ref(buf);
+        // The queue has a slot for every credit, unless a reconnect refilled
+        // the credits while this send worked on the old connection
+        if (k_msgq_put(&host->queue, &item, K_NO_WAIT) != 0) {
+            item_release(&item);
+            flow_give(&host->flow);
+            flow_drop(FLOW_DROP_FAILED, 1);
+            continue;
+        }
+        k_work_submit_to_queue(&fanout_wq, &host->work);
+    }
+
+    for (size_t n = 0; n < ARRAY_SIZE(hosts); n++) {
+        if (conns[n]) {
+            bt_conn_unref(conns[n]);
+        }
+    }
+
+    if (buf) {
+        net_buf_unref(buf);
+    }
+}
+
+/**
+ * @brief Return every credit of a host whose stream channel closed
+ *
+ * SDUs the channel still held never complete, so their credits would be
+ * lost for the rest of the connection.
+ *
+ * @param conn Connection of the host
+ */
+void fanout_stream_closed(struct bt_conn *conn)
+{
+    flow_reset(&hosts[bt_conn_index(conn)].flow);
+}
+
+/**
+ * @brief Return a host's credit once the stack has sent a notification or SDU
+ * @param conn Connection it was sent on
+ */
+void fanout_sent(struct bt_conn *conn)
+{
+    flow_give(&hosts[bt_conn_index(conn)].flow);
+}
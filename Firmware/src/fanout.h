@@ -0,0 +1,46 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include "flow.h"
+
+/*
+ * Fan-out of the encoded streams to every connected host, up to
+ * CONFIG_BT_MAX_CONN.
+ *
+ * The writer encodes each notification once. fanout_send() copies it into
+ * a reference counted buffer and queues a reference for every host that
+ * wants it; a sender thread hands each host's queue to the stack and drops
+ * the references. A second host costs airtime and a queue slot, not
+ * another encode or copy.
+ *
+ * A buffer is for a characteristic, going to the hosts subscribed to it,
+ * or for the stream (attr NULL): v2 frames or v1 packets, going to every
+ * host not streaming from the MetaBow service, on its L2CAP channel if
+ * open and on NUS otherwise.
+ *
+ * Each host has its own flow control credits (flow.h), taken when a buffer
+ * is queued and returned when the stack has sent it. A host without a
+ * free credit within the caller's timeout misses that buffer and the
+ * others carry on; v2 hosts resync on the next frame, v1 packets wait
+ * for a credit so they are not cut. The writer encodes for the host with the most free
+ * credits: fanout_shed() is the least shedding any streaming host needs.
+ */
+
+// Function prototypes
+void fanout_init(const struct bt_gatt_attr *stream_attr);
+int fanout_connected(struct bt_conn *conn);
+int fanout_disconnected(struct bt_conn *conn);
+bool fanout_wants(const struct bt_gatt_attr *attr);
+size_t fanout_payload_size(const struct bt_gatt_attr *attr);
+enum flow_shed fanout_shed(void);
+void fanout_send(const struct bt_gatt_attr *attr, const uint8_t *data, size_t len,
+                 k_timeout_t timeout);
+void fanout_sent(struct bt_conn *conn);
+void fanout_stream_closed(struct bt_conn *conn);
+
+#endif /* FANOUT_H */
@@ -0,0 +1,122 @@
+#include "flow.h"
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(flow, LOG_LEVEL_INF);
+
+// Shedding starts at or below the low mark and ends at or above the high one
+#define FLOW_LOW_WATER  (CONFIG_METABOW_FLOW_CREDITS / 4)
+#define FLOW_HIGH_WATER (CONFIG_METABOW_FLOW_CREDITS / 2)
+
+static atomic_t drops[FLOW_DROP_COUNT];
+
+static const char *const shed_names[] = {
+    [FLOW_SHED_NONE] = "none",
+    [FLOW_SHED_AUDIO] = "audio",
+    [FLOW_SHED_IMU] = "audio and IMU",
+};
+
+/**
+ * @brief Give a connection every credit
+ *
+ * Completions still due from an old connection cannot push the count past
+ * CONFIG_METABOW_FLOW_CREDITS.
+ *
+ * @param flow Flow control state of the connection
+ */
+void flow_init(struct flow *flow)
+{
+    k_sem_init(&flow->credits, CONFIG_METABOW_FLOW_CREDITS, CONFIG_METABOW_FLOW_CREDITS);
+    flow->level = FLOW_SHED_NONE;
+}
+
+/**
+ * @brief Return every credit, for a new connection on the same slot
+ *
+ * Unlike flow_init() this is safe while a thread waits for a credit of
+ * the old connection: it gives up with -EAGAIN.
+ *
+ * @param flow Flow control state of the connection
+ */
+void flow_reset(struct flow *flow)
+{
+    k_sem_reset(&flow->credits);
+    for (int n = 0; n < CONFIG_METABOW_FLOW_CREDITS; n++) {
+        k_sem_give(&flow->credits);
+    }
+}
+
+/**
+ * @brief Take a credit before queueing a notification for the connection
+ * @param flow Flow control state of the connection
+ * @param timeout How long to wait for a completion
+ * @return 0 with a credit taken, -EAGAIN on timeout
+ */
+int flow_take(struct flow *flow, k_timeout_t timeout)
+{
+    return k_sem_take(&flow->credits, timeout);
+}
+
+/**
+ * @brief Return a credit, from a notification's completion callback
+ * @param flow Flow control state of the connection
+ */
+void flow_give(struct flow *flow)
+{
+    k_sem_give(&flow->credits);
+}
+
+/**
+ * @brief Decide what to shed from the next block
+ *
+ * Called by the writer thread once per block. Shedding steps up as soon as
+ * credits run short and steps down with some hysteresis.
+ *
+ * @param flow Flow control state of the connection
+ * @return Shed level the connection needs
+ */
+enum flow_shed flow_shed(struct flow *flow)
+{
+    const unsigned int free = k_sem_count_get(&flow->credits);
+    enum flow_shed level;
+
+    if (free == 0) {
+        level = FLOW_SHED_IMU;
+    } else if (free <= FLOW_LOW_WATER) {
+        level = MAX(flow->level, FLOW_SHED_AUDIO);
+    } else if (free < FLOW_HIGH_WATER) {
+        level = MIN(flow->level, FLOW_SHED_AUDIO);
+    } else {
+        level = FLOW_SHED_NONE;
+    }
+
+    if (level != flow->level) {
+        LOG_INF("Shedding %s (dropped %u audio blocks, %u IMU samples, %u notifications)",
+                shed_names[level], (unsigned int)atomic_get(&drops[FLOW_DROP_AUDIO]),
+                (unsigned int)atomic_get(&drops[FLOW_DROP_IMU]),
+                (unsigned int)atomic_get(&drops[FLOW_DROP_FAILED]));
+        flow->level = level;
+    }
+
+    return level;
+}
+
+/**
+ * @brief Count dropped data
+ * @param what Kind of data
+ * @param count Audio blocks, IMU samples or notifications
+ */
+void flow_drop(enum flow_drop what, uint32_t count)
+{
+    atomic_add(&drops[what], (atomic_val_t)count);
+}
+
+/**
+ * @brief Read the drop counters
+ * @param counts Counters since boot, indexed by enum flow_drop
+ */
+void flow_get_drops(uint32_t counts[FLOW_DROP_COUNT])
+{
+    for (int n = 0; n < FLOW_DROP_COUNT; n++) {
+        counts[n] = (uint32_t)atomic_get(&drops[n]);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <zephyr/kernel.h>
+
+/*
+ * Notification flow control, per connection.
+ *
+ * Each notification or SDU queued for a central takes one of its
+ * CONFIG_METABOW_FLOW_CREDITS credits and the stack's completion returns
+ * it, so a central that falls behind runs out of credits instead of
+ * filling the stack's buffers. The writer asks flow_shed() before each
+ * block how much load to shed while credits run short: audio first, then
+ * every other IMU sample.
+ *
+ * Dropped audio blocks, IMU samples and notifications that were refused by
+ * the stack or found a central without credits are counted for all
+ * connections together; the host reads them with the "drops" command.
+ */
+
+enum flow_shed {
+    FLOW_SHED_NONE,
+    // Audio blocks are dropped
+    FLOW_SHED_AUDIO,
+    // Audio blocks are dropped and IMU samples decimated
+    FLOW_SHED_IMU,
+};
+
+enum flow_drop {
+    FLOW_DROP_AUDIO,
+    FLOW_DROP_IMU,
+    FLOW_DROP_FAILED,
+    FLOW_DROP_COUNT
+};
+
+struct flow {
+    struct k_sem credits;
+    // Only used by the writer thread
+    enum flow_shed level;
+};
+
+// Function prototypes
+void flow_init(struct flow *flow);
+void flow_reset(struct flow *flow);
+int flow_take(struct flow *flow, k_timeout_t timeout);
+void flow_give(struct flow *flow);
+enum flow_shed flow_shed(struct flow *flow);
+void flow_drop(enum flow_drop what, uint32_t count);
+void flow_get_drops(uint32_t counts[FLOW_DROP_COUNT]);
+
+#endif /* FLOW_H */
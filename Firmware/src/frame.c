@@ -0,0 +1,93 @@
+#include "frame.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+
+// Shared by every frame, whichever thread sends it
+static atomic_t frame_seq;
+
+/**
+ * @brief Start a frame
+ * @param w Writer state
+ * @param buf Destination
+ * @param size Size of buf, at least FRAME_OVERHEAD
+ * @param type Frame type
+ * @param timestamp_us Device timebase timestamp of the frame
+ */
+void frame_begin(struct frame_writer *w, uint8_t *buf, size_t size,
+                 enum frame_type type, uint32_t timestamp_us)
+{
+    w->buf = buf;
+    w->size = size;
+    w->len = FRAME_HEADER_SIZE;
+    w->section = 0;
+
+    buf[0] = FRAME_MAGIC;
+    buf[1] = FRAME_VERSION;
+    buf[2] = (uint8_t)type;
+    buf[3] = 0;
+    sys_put_le32(timestamp_us, &buf[8]);
+}
+
+/**
+ * @brief Append a section
+ * @param w Writer state
+ * @param type Section type
+ * @param len Payload length; can be reduced later with frame_trim()
+ * @return Where to write the payload, NULL if the frame has no room for it
+ */
+uint8_t *frame_section(struct frame_writer *w, enum frame_section type, size_t len)
+{
+    uint8_t *p;
+
+    if (len > UINT16_MAX ||
+        w->len + FRAME_SECTION_HEADER_SIZE + len + FRAME_CRC_SIZE > w->size) {
+        return NULL;
+    }
+
+    p = w->buf + w->len;
+    p[0] = (uint8_t)type;
+    sys_put_le16((uint16_t)len, &p[1]);
+
+    w->section = w->len;
+    w->len += FRAME_SECTION_HEADER_SIZE + len;
+    w->buf[3]++;
+
+    return p + FRAME_SECTION_HEADER_SIZE;
+}
+
+/**
+ * @brief Shorten the last section to the payload actually written
+ * @param w Writer state
+ * @param len New payload length, not more than reserved
+ */
+void frame_trim(struct frame_writer *w, size_t len)
+{
+    uint8_t *p = w->buf + w->section;
+
+    if (w->section == 0 || len > sys_get_le16(&p[1])) {
+        return;
+    }
+
+    sys_put_le16((uint16_t)len, &p[1]);
+    w->len = w->section + FRAME_SECTION_HEADER_SIZE + len;
+}
+
+/**
+ * @brief Finish a frame: sequence number, length and CRC
+ * @param w Writer state
+ * @return Frame length
+ */
+size_t frame_end(struct frame_writer *w)
+{
+    uint16_t crc;
+
+    sys_put_le16((uint16_t)atomic_inc(&frame_seq), &w->buf[4]);
+    sys_put_le16((uint16_t)(w->len + FRAME_CRC_SIZE), &w->buf[6]);
+
+    crc = crc16_itu_t(0xffff, w->buf, w->len);
+    sys_put_le16(crc, w->buf + w->len);
+    w->len += FRAME_CRC_SIZE;
+
+    return w->len;
+}
@@ -0,0 +1,88 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <zephyr/types.h>
+
+/*
+ * BLE stream framing, protocol v2 (CONFIG_METABOW_FRAME_V2).
+ *
+ * Frames are written back to back on the NUS TX characteristic and may be
+ * split across notifications, so the host treats the notifications as one
+ * byte stream. Layout, little endian:
+ *
+ *   u8      FRAME_MAGIC
+ *   u8      FRAME_VERSION
+ *   u8      frame type, enum frame_type
+ *   u8      number of sections
+ *   u16     sequence number, incremented per frame
+ *   u16     frame length, header to CRC inclusive
+ *   u32     device timebase timestamp [us]: first audio sample of a stream
+ *           frame, send time otherwise
+ *   sections, each:
+ *     u8    section type, enum frame_section
+ *     u16   payload length
+ *           payload
+ *   u16     CRC-16/CCITT-FALSE (poly 0x1021, init 0xffff) of everything
+ *           before it
+ *
+ * A host that loses bytes scans for the next FRAME_MAGIC, FRAME_VERSION
+ * pair whose length and CRC check out. Sequence gaps count lost frames.
+ * Unknown section types are skipped by length.
+ */
+
+#define FRAME_MAGIC     0xA5
+#define FRAME_VERSION   2
+
+#define FRAME_HEADER_SIZE           12
+#define FRAME_SECTION_HEADER_SIZE   3
+#define FRAME_CRC_SIZE              2
+// Header and CRC together
+#define FRAME_OVERHEAD              (FRAME_HEADER_SIZE + FRAME_CRC_SIZE)
+
+enum frame_type {
+    // Audio and IMU data
+    FRAME_TYPE_STREAM = 1,
+    // Motion gate idle: no audio, sent about once a second
+    FRAME_TYPE_HEARTBEAT = 2,
+    // A line of control output, see control.h
+    FRAME_TYPE_CONTROL = 3,
+};
+
+enum frame_section {
+    // i16 PCM samples
+    FRAME_SECTION_PCM = 1,
+    // u8 IMU flags, u8 calibration status, u32 IMU timestamp, 13 f32
+    FRAME_SECTION_IMU = 2,
+    // u8 IMU flags, u8 calibration status, u32 IMU timestamp, compact sample (imu_codec.h)
+    FRAME_SECTION_IMU_COMPACT = 3,
+    // u8 IMU flags, u8 calibration status, delta batch (imu_delta.h)
+    FRAME_SECTION_IMU_DELTA = 4,
+    // f32 yaw, pitch, roll [deg]
+    FRAME_SECTION_YPR = 5,
+    // f32 battery state of charge [%]
+    FRAME_SECTION_BATTERY = 6,
+    // Text without line ending
+    FRAME_SECTION_TEXT = 7,
+};
+
+// IMU section prefix before the sample data
+#define FRAME_IMU_PREFIX_SIZE       6
+#define FRAME_IMU_DELTA_PREFIX_SIZE 2
+
+struct frame_writer {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    // Offset of the last section header
+    size_t section;
+};
+
+// Function prototypes
+void frame_begin(struct frame_writer *w, uint8_t *buf, size_t size,
+                 enum frame_type type, uint32_t timestamp_us);
+uint8_t *frame_section(struct frame_writer *w, enum frame_section type, size_t len);
+void frame_trim(struct frame_writer *w, size_t len);
+size_t frame_end(struct frame_writer *w);
+
+#endif /* FRAME_H */
@@ -0,0 +1,128 @@
+#include "imu_codec.h"
+#include <math.h>
+#include <zephyr/sys/byteorder.h>
+
+#define QUAT_FIELD_BITS     10
+#define QUAT_FIELD_MAX      ((1 << (QUAT_FIELD_BITS - 1)) - 1)
+#define QUAT_FIELD_SCALE    512.0f
+
+/**
+ * @brief Encode a unit quaternion as smallest three in 32 bits
+ * @param q Quaternion in i, j, k, real order
+ */
+static uint32_t encode_quat(const float q[4])
+{
+    float norm = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    uint32_t largest = 0;
+    uint32_t word;
+    int shift = 2 * QUAT_FIELD_BITS;
+    float scale;
+
+    if (norm == 0.0f) {
+        // No orientation yet: encode the identity
+        return 3U << 30;
+    }
+
+    for (uint32_t i = 1; i < 4; i++) {
+        if (fabsf(q[i]) > fabsf(q[largest])) {
+            largest = i;
+        }
+    }
+
+    // q and -q are the same rotation; make the dropped component positive
+    scale = ((q[largest] < 0.0f) ? -QUAT_FIELD_SCALE : QUAT_FIELD_SCALE) / norm;
+
+    word = largest << 30;
+    for (uint32_t i = 0; i < 4; i++) {
+        int32_t n;
+
+        if (i == largest) {
+            continue;
+        }
+
+        n = (int32_t)lroundf(q[i] * scale);
+        n = CLAMP(n, -QUAT_FIELD_MAX, QUAT_FIELD_MAX);
+        word |= ((uint32_t)n & BIT_MASK(QUAT_FIELD_BITS)) << shift;
+        shift -= QUAT_FIELD_BITS;
+    }
+
+    return word;
+}
+
+/**
+ * @brief Quantize a value to int16 with a power-of-two scale, saturating
+ */
+static int16_t quantize(float value, uint8_t exp)
+{
+    float scaled = ldexpf(value, exp);
+
+    if (scaled >= INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (scaled <= INT16_MIN) {
+        return INT16_MIN;
+    }
+
+    return (int16_t)lroundf(scaled);
+}
+
+/**
+ * @brief Encode one IMU sample in the compact format
+ * @param imu_data Quaternion (i, j, k, r), accel, gyro and magn, as in the float packet
+ * @param scale Per-stream scale exponents, 0..15
+ * @param status Status nibble, see IMU_COMPACT_STATUS_*
+ * @param out Destination, IMU_COMPACT_SIZE bytes
+ */
+void imu_compact_encode(const float imu_data[13], const struct imu_compact_scale *scale,
+                        uint8_t status, uint8_t out[IMU_COMPACT_SIZE])
+{
+    int16_t values[13];
+    uint8_t *p = out;
+
+    sys_put_le32(encode_quat(imu_data), p);
+    p += sizeof(uint32_t);
+
+    imu_compact_quantize(imu_data, scale, values);
+    for (int i = 4; i < 13; i++) {
+        sys_put_le16((uint16_t)values[i], p);
+        p += sizeof(int16_t);
+    }
+
+    sys_put_le16(imu_compact_scale_word(scale, status), p);
+}
+
+/**
+ * @brief Quantize all 13 channels to int16
+ *
+ * The quaternion goes to IMU_CODEC_QUAT_EXP, the vectors to their stream's
+ * scale exponent, saturating.
+ *
+ * @param imu_data Quaternion (i, j, k, r), accel, gyro and magn
+ * @param scale Per-stream scale exponents
+ * @param out Quantized channels, same order
+ */
+void imu_compact_quantize(const float imu_data[13], const struct imu_compact_scale *scale,
+                          int16_t out[13])
+{
+    const uint8_t exps[3] = {scale->accel_exp, scale->gyro_exp, scale->magn_exp};
+
+    for (int i = 0; i < 4; i++) {
+        out[i] = quantize(imu_data[i], IMU_CODEC_QUAT_EXP);
+    }
+
+    for (int stream = 0; stream < 3; stream++) {
+        for (int axis = 0; axis < 3; axis++) {
+            out[4 + 3 * stream + axis] = quantize(imu_data[4 + 3 * stream + axis], exps[stream]);
+        }
+    }
+}
+
+/**
+ * @brief Pack the scale exponents and status nibble into one 16 bit word
+ * @return bits 3-0 accel_exp, 7-4 gyro_exp, 11-8 magn_exp, 15-12 status
+ */
+uint16_t imu_compact_scale_word(const struct imu_compact_scale *scale, uint8_t status)
+{
+    return (scale->accel_exp & 0xF) | ((scale->gyro_exp & 0xF) << 4) |
+           ((scale->magn_exp & 0xF) << 8) | ((status & 0xF) << 12);
+}
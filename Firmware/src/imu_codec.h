@@ -0,0 +1,60 @@
+#ifndef IMU_CODEC_H
+#define IMU_CODEC_H
+
+#include <zephyr/types.h>
+#include <zephyr/sys/util.h>
+
+/*
+ * Compact IMU sample encoding, 24 bytes instead of 13 floats.
+ *
+ * Layout, little endian:
+ *   u32     quaternion, smallest three: bits 31-30 index (i, j, k, r) of the
+ *           dropped largest component, then three 10 bit two's complement
+ *           fields (bits 29-20, 19-10, 9-0) holding the other components in
+ *           index order, in units of 2^-9, sign chosen so the dropped one is
+ *           positive
+ *   i16[3]  accel, value = n * 2^-accel_exp
+ *   i16[3]  gyro,  value = n * 2^-gyro_exp
+ *   i16[3]  magn,  value = n * 2^-magn_exp
+ *   u16     bits 3-0 accel_exp, 7-4 gyro_exp, 11-8 magn_exp, 15-12 status
+ *
+ * Every field decodes with power-of-two scaling only, and the dropped
+ * component is sqrt(1 - a^2 - b^2 - c^2), so decoding in IEEE double is
+ * exact and the same on any host.
+ */
+
+#define IMU_COMPACT_SIZE            24
+
+// Scale exponents matching the hub's native Q points (fusion mode), used
+// until the hub's metadata says otherwise
+#define IMU_COMPACT_ACCEL_EXP       8   // m/s^2, +-128
+#define IMU_COMPACT_GYRO_EXP        9   // rad/s, +-64
+#define IMU_COMPACT_MAGN_EXP        4   // uT, +-2048
+// Largest exponent the 4 bit scale fields hold
+#define IMU_COMPACT_EXP_MAX         15
+
+// Raw mode: accel and magn are already integer counts
+#define IMU_COMPACT_RAW_ACCEL_EXP   0
+#define IMU_COMPACT_RAW_MAGN_EXP    0
+
+// Quaternion components in imu_compact_quantize(), Q14
+#define IMU_CODEC_QUAT_EXP          14
+
+// Status nibble
+#define IMU_COMPACT_STATUS_ACCURACY_MASK    0x3     // Rotation vector accuracy, 0..3
+#define IMU_COMPACT_STATUS_DEVICE_FILTER    BIT(2)  // Quaternion from orient_filter
+
+struct imu_compact_scale {
+    uint8_t accel_exp;
+    uint8_t gyro_exp;
+    uint8_t magn_exp;
+};
+
+// Function prototypes
+void imu_compact_encode(const float imu_data[13], const struct imu_compact_scale *scale,
+                        uint8_t status, uint8_t out[IMU_COMPACT_SIZE]);
+void imu_compact_quantize(const float imu_data[13], const struct imu_compact_scale *scale,
+                          int16_t out[13]);
+uint16_t imu_compact_scale_word(const struct imu_compact_scale *scale, uint8_t status);
+
+#endif /* IMU_CODEC_H */
@@ -0,0 +1,102 @@
+#include "imu_delta.h"
+#include <string.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+static int16_t prev_value[IMU_DELTA_CHANNELS];
+static bool have_prev;
+static uint16_t prev_scale_word;
+static uint8_t batch_seq;
+static uint32_t batches_since_key;
+
+/**
+ * @brief Write an unsigned LEB128 varint
+ * @return Bytes written
+ */
+static size_t put_varint(uint32_t value, uint8_t *out)
+{
+    size_t len = 0;
+
+    while (value >= 0x80) {
+        out[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (uint8_t)value;
+
+    return len;
+}
+
+/**
+ * @brief Map a signed delta to unsigned so small magnitudes stay short
+ */
+static inline uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/**
+ * @brief Force the next batch to start with a keyframe
+ */
+void imu_delta_reset(void)
+{
+    have_prev = false;
+}
+
+/**
+ * @brief Encode one batch of consecutive samples
+ * @param samples Samples in time order
+ * @param count Number of samples, at most IMU_DELTA_MAX_SAMPLES
+ * @param scale_word Scale and status of all samples in the batch
+ * @param out Destination, at least IMU_DELTA_MAX_SIZE bytes
+ * @return Bytes written
+ */
+size_t imu_delta_encode(const struct imu_delta_sample *samples, int count,
+                        uint16_t scale_word, uint8_t *out)
+{
+    uint8_t *p = out;
+    bool key;
+
+    count = MIN(count, IMU_DELTA_MAX_SAMPLES);
+
+    *p++ = batch_seq++;
+    if (count <= 0) {
+        *p++ = 0;
+        return p - out;
+    }
+
+    key = !have_prev || (scale_word != prev_scale_word) ||
+          (batches_since_key >= IMU_DELTA_KEYFRAME_INTERVAL);
+
+    *p++ = (uint8_t)count | (key ? IMU_DELTA_KEYFRAME_FLAG : 0);
+    sys_put_le16(scale_word, p);
+    p += sizeof(uint16_t);
+    sys_put_le32(samples[0].timestamp_us, p);
+    p += sizeof(uint32_t);
+
+    for (int n = 0; n < count; n++) {
+        const int16_t *value = samples[n].value;
+
+        if (n > 0) {
+            p += put_varint(samples[n].timestamp_us - samples[n - 1].timestamp_us, p);
+        }
+
+        if (n == 0 && key) {
+            for (int c = 0; c < IMU_DELTA_CHANNELS; c++) {
+                sys_put_le16((uint16_t)value[c], p);
+                p += sizeof(int16_t);
+            }
+        } else {
+            for (int c = 0; c < IMU_DELTA_CHANNELS; c++) {
+                p += put_varint(zigzag((int32_t)value[c] - prev_value[c]), p);
+            }
+        }
+
+        memcpy(prev_value, value, sizeof(prev_value));
+    }
+
+    have_prev = true;
+    prev_scale_word = scale_word;
+    batches_since_key = key ? 1 : batches_since_key + 1;
+
+    return p - out;
+}
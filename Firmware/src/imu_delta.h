@@ -0,0 +1,52 @@
+#ifndef IMU_DELTA_H
+#define IMU_DELTA_H
+
+#include <stddef.h>
+#include <zephyr/types.h>
+#include "imu_codec.h"
+
+/*
+ * Temporal delta coding of consecutive IMU samples.
+ *
+ * Each packet carries one batch of quantized samples (see
+ * imu_compact_quantize()), little endian:
+ *
+ *   u8      sequence number, incremented per batch
+ *   u8      bits 6-0 sample count, bit 7 set if the first sample is a keyframe
+ *   -- the rest only if the count is not zero --
+ *   u16     scale word, see imu_compact_scale_word()
+ *   u32     timestamp of the first sample, device timebase us
+ *   sample 0: keyframe: 13 x i16
+ *             otherwise: 13 zig-zag varints, delta to the previous batch's last sample
+ *   sample n: varint time since sample n-1 [us], then 13 zig-zag varints,
+ *             delta to sample n-1
+ *
+ * Varints are unsigned LEB128. A keyframe is sent every
+ * IMU_DELTA_KEYFRAME_INTERVAL batches and whenever the scale changes, so a
+ * decoder that sees a sequence gap waits at most that long to resync.
+ */
+
+#define IMU_DELTA_CHANNELS          13
+#define IMU_DELTA_MAX_SAMPLES       6
+#define IMU_DELTA_KEYFRAME_INTERVAL 32
+
+#define IMU_DELTA_KEYFRAME_FLAG     0x80
+#define IMU_DELTA_HEADER_SIZE       8
+#define IMU_DELTA_VARINT_MAX        5
+
+// Worst case: every channel delta and interval at full varint length
+#define IMU_DELTA_MAX_SIZE  (IMU_DELTA_HEADER_SIZE + \
+                             IMU_DELTA_MAX_SAMPLES * (IMU_DELTA_VARINT_MAX + \
+                                                      IMU_DELTA_CHANNELS * 3))
+
+struct imu_delta_sample {
+    int16_t value[IMU_DELTA_CHANNELS];
+    uint32_t timestamp_us;
+};
+
+// Function prototypes
+void imu_delta_reset(void);
+size_t imu_delta_encode(const struct imu_delta_sample *samples, int count,
+                        uint16_t scale_word, uint8_t *out);
+
+#endif /* IMU_DELTA_H */
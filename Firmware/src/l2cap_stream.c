@@ -0,0 +1,157 @@
+#include "l2cap_stream.h"
+#include "fanout.h"
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/l2cap.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(l2cap_stream, LOG_LEVEL_INF);
+
+// One SDU per flow control credit of each central, so allocation only fails on a bug
+NET_BUF_POOL_FIXED_DEFINE(sdu_pool, CONFIG_METABOW_FLOW_CREDITS * CONFIG_BT_MAX_CONN,
+                          BT_L2CAP_SDU_BUF_SIZE(CONFIG_BT_L2CAP_TX_MTU), 8, NULL);
+
+// One channel per connection, indexed by bt_conn_index()
+static struct bt_l2cap_le_chan stream_chans[CONFIG_BT_MAX_CONN];
+static ATOMIC_DEFINE(chan_ready, CONFIG_BT_MAX_CONN);
+
+static size_t chan_index(struct bt_l2cap_chan *chan)
+{
+    return CONTAINER_OF(chan, struct bt_l2cap_le_chan, chan) - stream_chans;
+}
+
+static void l2cap_connected(struct bt_l2cap_chan *chan)
+{
+    const size_t n = chan_index(chan);
+
+    LOG_INF("Channel %u connected, MTU %u, MPS %u", n, stream_chans[n].tx.mtu,
+            stream_chans[n].tx.mps);
+    atomic_set_bit(chan_ready, n);
+}
+
+static void l2cap_disconnected(struct bt_l2cap_chan *chan)
+{
+    const size_t n = chan_index(chan);
+
+    atomic_clear_bit(chan_ready, n);
+    // SDUs still queued on the channel will not report being sent
+    fanout_stream_closed(chan->conn);
+    LOG_INF("Channel %u disconnected, back to NUS", n);
+}
+
+static int l2cap_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+    // Commands go to NUS RX; anything sent here is ignored
+    return 0;
+}
+
+static void l2cap_sent(struct bt_l2cap_chan *chan)
+{
+    fanout_sent(chan->conn);
+}
+
+static const struct bt_l2cap_chan_ops stream_ops = {
+    .connected = l2cap_connected,
+    .disconnected = l2cap_disconnected,
+    .recv = l2cap_recv,
+    .sent = l2cap_sent,
+};
+
+static int l2cap_accept(struct bt_conn *conn, struct bt_l2cap_server *server,
+                        struct bt_l2cap_chan **chan)
+{
+    struct bt_l2cap_le_chan *le_chan = &stream_chans[bt_conn_index(conn)];
+
+    if (le_chan->chan.conn) {
+        LOG_WRN("Channel already in use");
+        return -ENOMEM;
+    }
+
+    memset(le_chan, 0, sizeof(*le_chan));
+    le_chan->chan.ops = &stream_ops;
+    *chan = &le_chan->chan;
+
+    return 0;
+}
+
+static struct bt_l2cap_server stream_server = {
+    .psm = CONFIG_METABOW_L2CAP_PSM,
+    .sec_level = BT_SECURITY_L1,
+    .accept = l2cap_accept,
+};
+
+/**
+ * @brief Listen for the stream channel, call once Bluetooth is enabled
+ * @return 0 on success, negative error from the stack otherwise
+ */
+int l2cap_stream_init(void)
+{
+    int err = bt_l2cap_server_register(&stream_server);
+
+    if (err) {
+        LOG_ERR("Could not listen on PSM 0x%02x: %d", CONFIG_METABOW_L2CAP_PSM, err);
+    }
+
+    return err;
+}
+
+/**
+ * @brief Whether a host opened the stream channel
+ * @param conn Connection of the host
+ */
+bool l2cap_stream_ready(struct bt_conn *conn)
+{
+    return atomic_test_bit(chan_ready, bt_conn_index(conn));
+}
+
+/**
+ * @brief Largest SDU a host's channel takes
+ * @param conn Connection of the host
+ * @return SDU size, 0 without a channel
+ */
+size_t l2cap_stream_mtu(struct bt_conn *conn)
+{
+    if (!l2cap_stream_ready(conn)) {
+        return 0;
+    }
+
+    return MIN(stream_chans[bt_conn_index(conn)].tx.mtu, CONFIG_BT_L2CAP_TX_MTU);
+}
+
+/**
+ * @brief Queue one SDU on a host's channel
+ *
+ * The caller holds a flow control credit of the connection, given back
+ * by the sent callback.
+ *
+ * @param conn Connection of the host
+ * @param data SDU
+ * @param len SDU length, at most l2cap_stream_mtu()
+ * @return 0 once queued, negative error otherwise
+ */
+int l2cap_stream_send(struct bt_conn *conn, const uint8_t *data, size_t len)
+{
+    struct net_buf *buf;
+    int err;
+
+    if (len > l2cap_stream_mtu(conn)) {
+        return -EMSGSIZE;
+    }
+
+    buf = net_buf_alloc(&sdu_pool, K_NO_WAIT);
+    if (buf == NULL) {
+        return -ENOBUFS;
+    }
+
+    net_buf_reserve(buf, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+    net_buf_add_mem(buf, data, len);
+
+    err = bt_l2cap_chan_send(&stream_chans[bt_conn_index(conn)].chan, buf);
+    if (err < 0) {
+        net_buf_unref(buf);
+        return err;
+    }
+
+    return 0;
+}
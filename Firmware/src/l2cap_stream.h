@@ -0,0 +1,32 @@
+#ifndef L2CAP_STREAM_H
+#define L2CAP_STREAM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/conn.h>
+
+/*
+ * Stream transport over an L2CAP connection-oriented channel
+ * (CONFIG_METABOW_L2CAP).
+ *
+ * The device listens on LE PSM CONFIG_METABOW_L2CAP_PSM, one channel per
+ * connection. A host that opens a channel there gets the v2 frame stream,
+ * control replies included, as SDUs of up to the smaller of both sides'
+ * MTU instead of NUS notifications; a host that does not keeps NUS.
+ * Commands still go to NUS RX.
+ *
+ * Compared with notifications an SDU spans several LL PDUs without an ATT
+ * header each, and the channel's own credits keep the host from being
+ * flooded. Each SDU also takes a flow control credit of the connection
+ * (flow.h), returned through fanout_sent() once the SDU is sent. The SDU
+ * is copied into a buffer of the channel, which the stack consumes.
+ */
+
+// Function prototypes
+int l2cap_stream_init(void);
+bool l2cap_stream_ready(struct bt_conn *conn);
+size_t l2cap_stream_mtu(struct bt_conn *conn);
+int l2cap_stream_send(struct bt_conn *conn, const uint8_t *data, size_t len);
+
+#endif /* L2CAP_STREAM_H */
@@ -0,0 +1,341 @@
+#include "link.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(link, LOG_LEVEL_INF);
+
+// Inter frame space between PDUs [us]
+#define LINK_T_IFS_US 150
+// Longest connection event of the controller, see
+// CONFIG_BT_CTLR_SDC_MAX_CONN_EVENT_LEN_DEFAULT in child_image/hci_rpmsg.conf [us]
+#define LINK_EVENT_LEN_US 10000
+// L2CAP and ATT headers in front of each notification payload
+#define LINK_NOTIFY_HEADER_SIZE (4 + 3)
+
+// Interval in 1.25 ms units, supervision timeout in 10 ms units
+static const struct bt_le_conn_param mode_params[LINK_MODE_COUNT] = {
+    // 7.5 to 15 ms: the audio block rate, room for a retransmission
+    [LINK_MODE_STREAM] = BT_LE_CONN_PARAM_INIT(6, 12, 0, 400),
+    // 100 to 200 ms: one heartbeat a second, commands still answered promptly
+    [LINK_MODE_IDLE] = BT_LE_CONN_PARAM_INIT(80, 160, 0, 400),
+};
+
+static const char *const mode_names[LINK_MODE_COUNT] = {
+    [LINK_MODE_STREAM] = "stream",
+    [LINK_MODE_IDLE] = "idle",
+};
+
+struct link {
+    struct bt_conn *conn;
+    struct k_work negotiate_work;
+    struct bt_gatt_exchange_params exchange_params;
+    // What the link currently runs with, from the update callbacks
+    uint8_t phy;
+    uint16_t data_len;
+    uint16_t mtu;
+    uint16_t interval;
+    uint16_t latency;
+};
+
+// One per central, indexed by bt_conn_index()
+static struct link links[CONFIG_BT_MAX_CONN];
+// Guards each link's conn between the Bluetooth callbacks and the work items
+static struct k_spinlock link_lock;
+// The mode applies to every link
+static atomic_t link_mode = ATOMIC_INIT(LINK_MODE_STREAM);
+
+static void link_request_link_params(struct link *link);
+static void link_request_params(struct k_work *work);
+static K_WORK_DEFINE(params_work, link_request_params);
+
+static const char *phy2str(uint8_t phy)
+{
+    switch (phy) {
+    case BT_GAP_LE_PHY_1M: return "1M";
+    case BT_GAP_LE_PHY_2M: return "2M";
+    case BT_GAP_LE_PHY_CODED: return "coded";
+    default: return "unknown";
+    }
+}
+
+/**
+ * @brief Air time of one data PDU and the empty PDU acknowledging it
+ * @param link Link, for its PHY
+ * @param len PDU payload length
+ * @return Time including both inter frame spaces [us]
+ */
+static uint32_t link_pdu_pair_us(const struct link *link, uint16_t len)
+{
+    // Preamble, access address, header and CRC of each PDU
+    const uint32_t overhead = (link->phy == BT_GAP_LE_PHY_2M ? 2 : 1) + 4 + 2 + 3;
+    const uint32_t bits = 8 * (2 * overhead + len);
+    uint32_t air_us;
+
+    switch (link->phy) {
+    case BT_GAP_LE_PHY_2M:
+        air_us = bits / 2;
+        break;
+    case BT_GAP_LE_PHY_CODED:
+        // S=8 coding, ignoring the longer coded preamble
+        air_us = bits * 8;
+        break;
+    default:
+        air_us = bits;
+        break;
+    }
+
+    return air_us + 2 * LINK_T_IFS_US;
+}
+
+/**
+ * @brief Estimate the notification throughput of the link
+ *
+ * Assumes the peripheral always has data queued and connection events run
+ * as long as the controller allows, so this is an upper bound. Latency
+ * does not matter then: the peripheral skips no events with data to send.
+ *
+ * @param link Link to estimate
+ * @return Notification payload throughput [bit/s]
+ */
+static uint32_t link_throughput_bps(const struct link *link)
+{
+    const uint32_t payload = link->mtu - 3;
+    const uint32_t interval_us = link->interval * 1250U;
+    uint32_t remaining = payload + LINK_NOTIFY_HEADER_SIZE;
+    uint32_t notify_us = 0;
+    uint64_t bps;
+
+    while (remaining > 0) {
+        uint16_t len = MIN(remaining, link->data_len);
+
+        notify_us += link_pdu_pair_us(link, len);
+        remaining -= len;
+    }
+
+    bps = (uint64_t)payload * 8 * USEC_PER_SEC / notify_us;
+    if (interval_us > LINK_EVENT_LEN_US) {
+        bps = bps * LINK_EVENT_LEN_US / interval_us;
+    }
+
+    return (uint32_t)bps;
+}
+
+static void link_log(const struct link *link, const char *what)
+{
+    LOG_INF("%s [%u]: PHY %s, data length %u, MTU %u, interval %u us, latency %u, "
+            "up to %u kbit/s", what, (unsigned int)(link - links), phy2str(link->phy),
+            link->data_len, link->mtu, link->interval * 1250U, link->latency,
+            link_throughput_bps(link) / 1000U);
+}
+
+static void link_mtu_exchanged(struct bt_conn *conn, uint8_t err,
+                               struct bt_gatt_exchange_params *params)
+{
+    if (err) {
+        LOG_WRN("MTU exchange failed (err %u)", err);
+    }
+}
+
+/**
+ * @brief Take a reference to a link's connection
+ * @return Connection to unref when done, NULL if the link is down
+ */
+static struct bt_conn *link_get_conn(struct link *link)
+{
+    k_spinlock_key_t key = k_spin_lock(&link_lock);
+    struct bt_conn *conn = link->conn ? bt_conn_ref(link->conn) : NULL;
+
+    k_spin_unlock(&link_lock, key);
+
+    return conn;
+}
+
+/**
+ * @brief Ask for the fastest PHY, data length and MTU, then the mode's parameters
+ */
+static void link_negotiate(struct k_work *work)
+{
+    struct link *link = CONTAINER_OF(work, struct link, negotiate_work);
+    struct bt_conn *conn = link_get_conn(link);
+    int err;
+
+    if (!conn) {
+        return;
+    }
+
+    err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+    if (err) {
+        LOG_WRN("PHY update request failed: %d", err);
+    }
+
+    err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+    if (err) {
+        LOG_WRN("Data length update request failed: %d", err);
+    }
+
+    // The central may have started an exchange already
+    link->exchange_params.func = link_mtu_exchanged;
+    err = bt_gatt_exchange_mtu(conn, &link->exchange_params);
+    if (err && err != -EALREADY) {
+        LOG_WRN("MTU exchange request failed: %d", err);
+    }
+
+    bt_conn_unref(conn);
+    link_request_link_params(link);
+}
+
+/**
+ * @brief Request the connection parameters of the current mode on one link
+ */
+static void link_request_link_params(struct link *link)
+{
+    const enum link_mode mode = (enum link_mode)atomic_get(&link_mode);
+    struct bt_conn *conn = link_get_conn(link);
+    int err;
+
+    if (!conn) {
+        return;
+    }
+
+    err = bt_conn_le_param_update(conn, &mode_params[mode]);
+    bt_conn_unref(conn);
+    if (err == -EALREADY) {
+        return;
+    }
+    if (err) {
+        LOG_WRN("%s connection parameter request failed: %d", mode_names[mode], err);
+        return;
+    }
+
+    LOG_INF("Requested %s connection parameters [%u]", mode_names[mode],
+            (unsigned int)(link - links));
+}
+
+/**
+ * @brief Request the connection parameters of the current mode on every link
+ */
+static void link_request_params(struct k_work *work)
+{
+    for (size_t n = 0; n < ARRAY_SIZE(links); n++) {
+        link_request_link_params(&links[n]);
+    }
+}
+
+static void link_connected(struct bt_conn *conn, uint8_t err)
+{
+    struct link *link = &links[bt_conn_index(conn)];
+    struct bt_conn_info info;
+    k_spinlock_key_t key;
+
+    if (err || bt_conn_get_info(conn, &info) != 0) {
+        return;
+    }
+
+    link->phy = info.le.phy->tx_phy;
+    link->data_len = info.le.data_len->tx_max_len;
+    link->mtu = bt_gatt_get_mtu(conn);
+    link->interval = info.le.interval;
+    link->latency = info.le.latency;
+    link_log(link, "Connected");
+
+    key = k_spin_lock(&link_lock);
+    link->conn = bt_conn_ref(conn);
+    k_spin_unlock(&link_lock, key);
+    k_work_submit(&link->negotiate_work);
+}
+
+static void link_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    struct link *link = &links[bt_conn_index(conn)];
+    k_spinlock_key_t key = k_spin_lock(&link_lock);
+    struct bt_conn *old = (conn == link->conn) ? link->conn : NULL;
+
+    if (old) {
+        link->conn = NULL;
+    }
+    k_spin_unlock(&link_lock, key);
+
+    // A negotiation already running holds its own reference
+    k_work_cancel(&link->negotiate_work);
+    if (old) {
+        bt_conn_unref(old);
+    }
+}
+
+static void link_param_updated(struct bt_conn *conn, uint16_t interval,
+                               uint16_t latency, uint16_t timeout)
+{
+    struct link *link = &links[bt_conn_index(conn)];
+
+    link->interval = interval;
+    link->latency = latency;
+    link_log(link, "Connection parameters updated");
+}
+
+static void link_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+    struct link *link = &links[bt_conn_index(conn)];
+
+    link->phy = param->tx_phy;
+    link_log(link, "PHY updated");
+}
+
+static void link_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+    struct link *link = &links[bt_conn_index(conn)];
+
+    link->data_len = info->tx_max_len;
+    link_log(link, "Data length updated");
+}
+
+static void link_mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+{
+    struct link *link = &links[bt_conn_index(conn)];
+
+    link->mtu = tx;
+    link_log(link, "MTU updated");
+}
+
+BT_CONN_CB_DEFINE(link_conn_callbacks) = {
+    .connected = link_connected,
+    .disconnected = link_disconnected,
+    .le_param_updated = link_param_updated,
+    .le_phy_updated = link_phy_updated,
+    .le_data_len_updated = link_data_len_updated,
+};
+
+static struct bt_gatt_cb link_gatt_callbacks = {
+    .att_mtu_updated = link_mtu_updated,
+};
+
+/**
+ * @brief Register for MTU updates, call once Bluetooth is enabled
+ */
+void link_init(void)
+{
+    for (size_t n = 0; n < ARRAY_SIZE(links); n++) {
+        k_work_init(&links[n].negotiate_work, link_negotiate);
+    }
+
+    bt_gatt_cb_register(&link_gatt_callbacks);
+}
+
+/**
+ * @brief Select the stream mode the connection parameters of every link suit
+ *
+ * Cheap when the mode is unchanged, so it can be called on every
+ * iteration of a loop.
+ *
+ * @param mode New mode
+ */
+void link_set_mode(enum link_mode mode)
+{
+    if (atomic_set(&link_mode, mode) == (atomic_val_t)mode) {
+        return;
+    }
+
+    k_work_submit(&params_work);
+}
@@ -0,0 +1,32 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <zephyr/types.h>
+
+/*
+ * BLE link manager.
+ *
+ * Once a central connects, the peripheral asks for the 2M PHY, the longest
+ * LL data length and an ATT MTU exchange, and requests the connection
+ * interval and latency of the current stream mode. A mode change requests
+ * new connection parameters. Each time one of these settles the effective
+ * link throughput is estimated from PHY, data length, MTU and interval and
+ * logged, so it can be compared with what the stream needs.
+ *
+ * The central has the last word on every parameter; refusals are logged
+ * and the link keeps what it has.
+ */
+
+enum link_mode {
+    // Audio and IMU stream: short interval, no latency
+    LINK_MODE_STREAM,
+    // Heartbeat only: long interval to save power
+    LINK_MODE_IDLE,
+    LINK_MODE_COUNT
+};
+
+// Function prototypes
+void link_init(void);
+void link_set_mode(enum link_mode mode);
+
+#endif /* LINK_H */
@@ -9,6 +9,7 @@
 #include <zephyr/audio/dmic.h>
 
 #include <zephyr/drivers/sensor.h>
+#include <drivers/sensor/bno08x.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/uuid.h>
@@ -28,7 +29,9 @@
 #include <zephyr/logging/log.h>
 
 // needed to set gain
+#ifdef CONFIG_NRFX_PDM
 #include <nrfx_pdm.h>
+#endif
 
 #include "lz4.h"
 
@@ -36,8 +39,26 @@
 #include <zephyr/bluetooth/services/bas.h>
 #include "battery_monitor.h"
 
+#include "timebase.h"
+#include "boot_profile.h"
+#include "orient_filter.h"
+#include "control.h"
+#include "motion_gate.h"
+#include "imu_codec.h"
+#include "imu_delta.h"
+#include "frame.h"
+#include "packetiser.h"
+#include "link.h"
+#include "fanout.h"
+#include "l2cap_stream.h"
+#include "metabow_svc.h"
+
 #include <zephyr/mgmt/mcumgr/transport/smp_bt.h>
 
+#ifdef CONFIG_METABOW_FILTER_BENCHMARK
+#include <zephyr/timing/timing.h>
+#endif
+
 //for testing on DK make this 1 and for testing on PCB make it 0
 #define TEST_DK_APP				0
 
@@ -89,8 +110,88 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 // #define IMU_DATA_SIZE (4+3+3+3)*sizeof(float)
 #define IMU_DATA_SIZE (13)*sizeof(float)
 #define IMU_DATA_FLAG_SIZE 1
+// IMU data flag bits
+#define IMU_FLAG_VALID           BIT(0)  // IMU fields hold a sample
+#define IMU_FLAG_DEVICE_FILTER   BIT(1)  // Raw mode: quaternion from orient_filter, gyro in rad/s, accel/mag in counts
+#define IMU_FLAG_HEARTBEAT       BIT(2)  // Motion gate idle: no audio in this packet
+#define IMU_FLAG_GAP             BIT(3)  // First sample after the IMU hub reset itself
 #define BATTERY_DATA_SIZE sizeof(float)  // Battery SoC as float
-#define BLE_BLOCK_SIZE MAX_BLOCK_SIZE+IMU_DATA_SIZE+IMU_DATA_FLAG_SIZE+BATTERY_DATA_SIZE
+// Device timebase timestamps of the first audio sample and of the IMU sample
+#define AUDIO_TIMESTAMP_SIZE sizeof(uint32_t)
+#define IMU_TIMESTAMP_SIZE sizeof(uint32_t)
+// IMU calibration accuracy, 2 bits per sensor (accel, gyro, mag, rotation vector)
+#define IMU_CAL_STATUS_SIZE 1
+// IMU section of the packet: 13 floats, or one compact sample
+#ifdef CONFIG_METABOW_IMU_COMPACT
+#define IMU_PACKET_DATA_SIZE IMU_COMPACT_SIZE
+#else
+#define IMU_PACKET_DATA_SIZE IMU_DATA_SIZE
+#endif
+#define IMU_PACKET_TAIL_SIZE (IMU_DATA_FLAG_SIZE+BATTERY_DATA_SIZE+AUDIO_TIMESTAMP_SIZE+IMU_TIMESTAMP_SIZE+IMU_CAL_STATUS_SIZE)
+// Optional yaw, pitch and roll in degrees after the calibration status
+#define IMU_YPR_SIZE (3*sizeof(float))
+#define IMU_YPR_DEG_PER_RAD 57.2957795f
+#ifdef CONFIG_METABOW_IMU_YPR
+#define IMU_PACKET_YPR_SIZE IMU_YPR_SIZE
+#else
+#define IMU_PACKET_YPR_SIZE 0
+#endif
+#ifdef CONFIG_METABOW_IMU_DELTA
+// Flags, battery, audio timestamp and calibration status, then one delta
+// batch and possibly a pad byte (see ble_write_thread)
+#define IMU_DELTA_PACKET_HEADER_SIZE (IMU_DATA_FLAG_SIZE+BATTERY_DATA_SIZE+AUDIO_TIMESTAMP_SIZE+IMU_CAL_STATUS_SIZE)
+#define BLE_BLOCK_SIZE MAX_BLOCK_SIZE+IMU_DELTA_PACKET_HEADER_SIZE+IMU_DELTA_MAX_SIZE+1
+#ifndef CONFIG_METABOW_FRAME_V2
+// Lengths of the fixed layouts, full or compact IMU data with or without
+// yaw, pitch and roll; no two are one byte apart, so the pad byte never
+// turns one into another
+static const size_t imu_fixed_packet_sizes[] = {
+	MAX_BLOCK_SIZE + IMU_DATA_SIZE + IMU_PACKET_TAIL_SIZE,
+	MAX_BLOCK_SIZE + IMU_DATA_SIZE + IMU_PACKET_TAIL_SIZE + IMU_YPR_SIZE,
+	MAX_BLOCK_SIZE + IMU_COMPACT_SIZE + IMU_PACKET_TAIL_SIZE,
+	MAX_BLOCK_SIZE + IMU_COMPACT_SIZE + IMU_PACKET_TAIL_SIZE + IMU_YPR_SIZE,
+};
+#endif
+#else
+#define BLE_BLOCK_SIZE MAX_BLOCK_SIZE+IMU_PACKET_DATA_SIZE+IMU_PACKET_TAIL_SIZE+IMU_PACKET_YPR_SIZE
+#endif
+
+#ifdef CONFIG_METABOW_FRAME_V2
+// v2 frame sections: PCM, IMU, yaw/pitch/roll, battery
+#ifdef CONFIG_METABOW_IMU_DELTA
+#define FRAME_IMU_SIZE (FRAME_IMU_DELTA_PREFIX_SIZE+IMU_DELTA_MAX_SIZE)
+#else
+#define FRAME_IMU_SIZE (FRAME_IMU_PREFIX_SIZE+IMU_PACKET_DATA_SIZE)
+#endif
+#define FRAME_MAX_SIZE (FRAME_OVERHEAD+4*FRAME_SECTION_HEADER_SIZE+MAX_BLOCK_SIZE+ \
+                        FRAME_IMU_SIZE+IMU_PACKET_YPR_SIZE+BATTERY_DATA_SIZE)
+#define FRAME_CONTROL_SIZE (FRAME_OVERHEAD+FRAME_SECTION_HEADER_SIZE+CONTROL_REPLY_MAX_LEN)
+BUILD_ASSERT(FRAME_MAX_SIZE <= PACKETISER_MAX_PAYLOAD, "frame must fit the packetiser");
+#endif
+
+#ifdef CONFIG_METABOW_SERVICE
+// MetaBow service IMU value: the IMU and yaw/pitch/roll sections of a v2
+// frame, built after a frame header that is not sent
+#define SVC_IMU_SIZE (2*FRAME_SECTION_HEADER_SIZE+FRAME_IMU_SIZE+IMU_PACKET_YPR_SIZE)
+// MetaBow service audio value: timestamp of the first sample, then PCM
+#define SVC_AUDIO_SIZE PACKETISER_MAX_PAYLOAD
+#endif
+
+// IMU samples travel through the queue together with their flags, timestamp and calibration status
+#define IMU_RECORD_SIZE (IMU_DATA_SIZE+IMU_DATA_FLAG_SIZE+IMU_TIMESTAMP_SIZE+IMU_CAL_STATUS_SIZE)
+// With delta coding every sample is queued for the next packets, otherwise
+// only the latest one is kept
+#ifdef CONFIG_METABOW_IMU_DELTA
+#define IMU_QUEUE_DEPTH (2*IMU_DELTA_MAX_SAMPLES)
+#else
+#define IMU_QUEUE_DEPTH 1
+#endif
+
+// Raw samples drained per fetch in raw mode
+#define IMU_RAW_BATCH 32
+// Fusion samples drained per fetch with delta coding
+#define IMU_FUSION_BATCH 16
+#define IMU_BENCH_ITERATIONS 1000
 
 K_MEM_SLAB_DEFINE(mem_slab, BLE_BLOCK_SIZE, BLOCK_COUNT, 4);
 
@@ -102,7 +203,7 @@ const struct device *const imu_dev = DEVICE_DT_GET(DT_NODELABEL(bno085));
 #error "bno08x not defined in device tree"
 #endif
 
-K_PIPE_DEFINE(imu_pipe, IMU_DATA_SIZE, 4);
+K_MSGQ_DEFINE(imu_msgq, IMU_RECORD_SIZE, IMU_QUEUE_DEPTH, 4);
 
 // #define IMU_CLK_NODE DT_ALIAS(imu_clk_sel_1)
 // #define IMU_CLK_NODE DT_NODELABEL(imu_clk_sel_1)
@@ -117,21 +218,20 @@ K_PIPE_DEFINE(imu_pipe, IMU_DATA_SIZE, 4);
 
 // BLE
 
-static K_SEM_DEFINE(ble_init_ok, 0, 1);
-static K_SEM_DEFINE(imu_init_ok, 0, 1);
 static K_SEM_DEFINE(dmic_data_available, 0, BLOCK_COUNT);
 
 // Battery BLE update work
 static struct k_work_delayable battery_ble_update_work;
 
 
-static struct bt_conn *current_conn;
 static struct bt_conn *auth_conn;
 
 struct mem_slab_data_t {
 	void *fifo_reserved;
 	void *data;
 	uint16_t len;
+	uint32_t timestamp_us;
+	bool heartbeat;
 };
 
 static K_FIFO_DEFINE(fifo_nus_tx_data);
@@ -146,17 +246,6 @@ static const struct bt_data sd[] = {
 	BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_NUS_VAL),
 };
 
-// static const char *phy2str(uint8_t phy)
-// {
-// 	switch (phy) {
-// 	case 0: return "No packets";
-// 	case BT_GAP_LE_PHY_1M: return "LE 1M";
-// 	case BT_GAP_LE_PHY_2M: return "LE 2M";
-// 	case BT_GAP_LE_PHY_CODED: return "LE Coded";
-// 	default: return "Unknown";
-// 	}
-// }
-
 static void connected(struct bt_conn *conn, uint8_t err)
 {
     char addr[BT_ADDR_LE_STR_LEN];
@@ -169,11 +258,20 @@ static void connected(struct bt_conn *conn, uint8_t err)
     bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
     LOG_INF("Connected %s", addr);
 
-    current_conn = bt_conn_ref(conn);
+    if (fanout_connected(conn) == 1) {
+#ifdef CONFIG_METABOW_FRAME_V2
+        // Only the first host, the others pick the stream up at the next frame
+        packetiser_reset();
+#endif
+        dk_set_led_on(CON_STATUS_LED);
+    }
+
+#ifdef CONFIG_METABOW_IMU_DELTA
+    // Let the new host start decoding with the next packet
+    imu_delta_reset();
+#endif
 
-    dk_set_led_on(CON_STATUS_LED);
-    
-    // Start battery level updates when connected
+    // Start battery level updates when connected, sending the level to the new host now
     k_work_reschedule(&battery_ble_update_work, K_NO_WAIT);
 }
 
@@ -185,17 +283,15 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 
     LOG_INF("Disconnected: %s (reason %u)", addr, reason);
 
-    if (auth_conn) {
+    if (auth_conn == conn) {
         bt_conn_unref(auth_conn);
         auth_conn = NULL;
     }
 
-    if (current_conn) {
-        bt_conn_unref(current_conn);
-        current_conn = NULL;
+    if (fanout_disconnected(conn) == 0) {
         dk_set_led_off(CON_STATUS_LED);
         
-        // Stop battery updates when disconnected
+        // Stop battery updates when the last host is gone
         k_work_cancel_delayable(&battery_ble_update_work);
     }
 }
@@ -210,69 +306,157 @@ static bool le_param_req(struct bt_conn *conn, struct bt_le_conn_param *param)
 	return true;
 }
 
-static void le_param_updated(struct bt_conn *conn, uint16_t interval,
-			     uint16_t latency, uint16_t timeout)
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected    = connected,
+	.disconnected = disconnected,
+	.le_param_req = le_param_req,
+};
+
+static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
+			  uint16_t len)
 {
-	LOG_INF("Connection parameters updated.\n"
-	       " interval: %d, latency: %d, timeout: %d\n",
-	       interval, latency, timeout);
+	int err;
+	char addr[BT_ADDR_LE_STR_LEN] = {0};
 
-}
+	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, ARRAY_SIZE(addr));
 
-// static void le_phy_updated(struct bt_conn *conn,
-// 			   struct bt_conn_le_phy_info *param)
-// {
-// 	LOG_INF("LE PHY updated: TX PHY %s, RX PHY %s\n",
-// 	       phy2str(param->tx_phy), phy2str(param->rx_phy));
+	LOG_INF("Received data from: %s", addr);
 
-// }
+	err = control_handle_command(data, len);
+	if (err) {
+		LOG_WRN("Command rejected: %d", err);
+	}
 
-// static void le_data_length_updated(struct bt_conn *conn,
-// 				   struct bt_conn_le_data_len_info *info)
-// {
-// 	LOG_INF("LE data len updated: TX (len: %d time: %d)"
-// 	       " RX (len: %d time: %d)\n", info->tx_max_len,
-// 	       info->tx_max_time, info->rx_max_len, info->rx_max_time);
+}
 
-// }
+/**
+ * @brief Send one stream payload to every host taking the stream
+ *
+ * v2 stream data never waits for credits: a host without one misses the
+ * notification and resyncs on the next frame, while the writer sheds load.
+ * Notifications carrying a control reply or event are never shed and wait
+ * up to CONFIG_METABOW_FLOW_TIMEOUT_MS for a credit. So does every v1
+ * chunk: v1 packets are split into chunks the host only tells apart by
+ * length, and a host falling behind slows the writer down instead of
+ * losing them.
+ *
+ * @param data Payload
+ * @param len Payload length, at most fanout_payload_size(NULL)
+ * @param urgent Whether it carries a control reply or event
+ */
+static void ble_notify(const uint8_t *data, size_t len, bool urgent)
+{
+#ifdef CONFIG_METABOW_FRAME_V2
+	fanout_send(NULL, data, len, urgent ? K_MSEC(CONFIG_METABOW_FLOW_TIMEOUT_MS) : K_NO_WAIT);
+#else
+	ARG_UNUSED(urgent);
+	fanout_send(NULL, data, len, K_MSEC(CONFIG_METABOW_FLOW_TIMEOUT_MS));
+#endif
+}
 
-void mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+#ifdef CONFIG_METABOW_FRAME_V2
+/**
+ * @brief Finish a v2 frame built in the packetiser and queue it
+ *
+ * The sequence number is taken while the packetiser is locked, so frames
+ * reach the host in sequence order whichever thread built them.
+ *
+ * @param w Writer of the frame
+ * @param urgent Control reply or event, never shed
+ */
+static void ble_commit_frame(struct frame_writer *w, bool urgent)
 {
-    LOG_INF("Updated MTU: TX: %d RX: %d bytes\n", tx, rx);
+	packetiser_commit(frame_end(w), fanout_payload_size(NULL), urgent);
 }
+#else
+/**
+ * @brief Send a packet to the host, split at the MTU
+ * @param data Packet
+ * @param size Packet length
+ */
+static void ble_send(const uint8_t *data, size_t size)
+{
+	const size_t max_packet_size = fanout_payload_size(NULL);
 
-static struct bt_gatt_cb gatt_callbacks = {
-        .att_mtu_updated = mtu_updated
-};
+	LOG_INF("BLE audio data buffer size: %d, MTU size: %d", size, max_packet_size);
 
-// static void exchange_func(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params)
-// {
-// 	if (!err) {
-// 		LOG_INF("MTU exchange done");
-// 	} else {
-// 		LOG_WRN("MTU exchange failed (err %" PRIu8 ")", err);
-// 	}
-// }
+	for (size_t sendIndex = 0; sendIndex < size; sendIndex += max_packet_size) {
+		size_t chunkLength = MIN(max_packet_size, size - sendIndex);
 
-BT_CONN_CB_DEFINE(conn_callbacks) = {
-	.connected    = connected,
-	.disconnected = disconnected,
-	.le_param_req = le_param_req,
-	.le_param_updated = le_param_updated,
-	// .le_phy_updated = le_phy_updated,
-	// .le_data_len_updated = le_data_length_updated,
-};
+		ble_notify(data + sendIndex, chunkLength, false);
+	}
+}
+#endif
 
-static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
-			  uint16_t len)
+/**
+ * @brief Send a line to the host on NUS
+ */
+static void nus_send_line(const char *line, size_t len)
 {
-	int err;
-	char addr[BT_ADDR_LE_STR_LEN] = {0};
+#ifdef CONFIG_METABOW_FRAME_V2
+	struct frame_writer w;
+	uint8_t *text;
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, ARRAY_SIZE(addr));
+	if (!fanout_wants(NULL)) {
+		return;
+	}
 
-	LOG_INF("Received data from: %s", addr);
+	// Frames delimit the lines, the line ending is not needed
+	if (len > 0 && line[len - 1] == '\n') {
+		len--;
+	}
+	len = MIN(len, CONTROL_REPLY_MAX_LEN);
+	frame_begin(&w, packetiser_reserve(FRAME_CONTROL_SIZE), FRAME_CONTROL_SIZE,
+		    FRAME_TYPE_CONTROL, timebase_now_us());
+	text = frame_section(&w, FRAME_SECTION_TEXT, len);
+	memcpy(text, line, len);
+	ble_commit_frame(&w, true);
+	// Replies do not wait for stream frames to fill the notification
+	packetiser_flush();
+#else
+	ble_notify((const uint8_t *)line, len, true);
+#endif
+}
+
+#ifdef CONFIG_METABOW_SERVICE
+/**
+ * @brief Notify a line on a MetaBow service characteristic
+ */
+static void svc_send_line(enum metabow_svc_stream stream, const char *line, size_t len)
+{
+	if (!metabow_svc_subscribed(stream)) {
+		return;
+	}
 
+	// One notification per line, the line ending is not needed
+	if (len > 0 && line[len - 1] == '\n') {
+		len--;
+	}
+	fanout_send(metabow_svc_attr(stream), (const uint8_t *)line, len,
+		    K_MSEC(CONFIG_METABOW_FLOW_TIMEOUT_MS));
+}
+#endif
+
+/**
+ * @brief Send a line of command output to the host
+ */
+static void control_reply(const char *line, size_t len)
+{
+	nus_send_line(line, len);
+#ifdef CONFIG_METABOW_SERVICE
+	svc_send_line(METABOW_SVC_CONTROL, line, len);
+#endif
+}
+
+/**
+ * @brief Send an unsolicited line to the host
+ */
+static void control_event(const char *line, size_t len)
+{
+	nus_send_line(line, len);
+#ifdef CONFIG_METABOW_SERVICE
+	svc_send_line(METABOW_SVC_EVENTS, line, len);
+#endif
 }
 
 static struct bt_nus_cb nus_cb = {
@@ -326,18 +510,105 @@ static void battery_ble_update_handler(struct k_work *work)
     } else {
         LOG_INF("BLE Battery Service updated: %d%% (%.2fV)", battery_level, battery_voltage);
     }
+
+#ifdef CONFIG_METABOW_SERVICE
+    float battery_soc = (float)battery_level;
+
+    metabow_svc_set_battery(battery_soc);
+    if (metabow_svc_subscribed(METABOW_SVC_BATTERY)) {
+        fanout_send(metabow_svc_attr(METABOW_SVC_BATTERY), (const uint8_t *)&battery_soc,
+                    sizeof(battery_soc), K_NO_WAIT);
+    }
+#endif
     
     // Reschedule for next update
     k_work_reschedule(&battery_ble_update_work, K_MSEC(BATTERY_SERVICE_UPDATE_INTERVAL_MS));
 }
 
 
+static void bt_ready(int err)
+{
+	if (err) {
+		LOG_ERR("Bluetooth init failed (err %d)", err);
+		return;
+	}
+
+	boot_profile_mark(BOOT_PHASE_BT_READY);
+}
+
+#if (TEST_DK_APP == 0)
+/**
+ * @brief Queue a packet without audio so the host still sees the device
+ * (battery, link) while the motion gate is idle
+ */
+static void send_heartbeat(void)
+{
+	void *buffer;
+	struct mem_slab_data_t *tx;
+
+	if (k_mem_slab_alloc(&mem_slab, &buffer, K_NO_WAIT) < 0) {
+		return;
+	}
+
+	tx = k_malloc(sizeof(*tx));
+	if (tx == NULL) {
+		k_mem_slab_free(&mem_slab, &buffer);
+		return;
+	}
+
+	memset(buffer, 0, MAX_BLOCK_SIZE);
+	tx->len = MAX_BLOCK_SIZE;
+	tx->data = buffer;
+	tx->timestamp_us = timebase_now_us();
+	tx->heartbeat = true;
+	k_fifo_put(&fifo_nus_rx_data, tx);
+}
+
+/**
+ * @brief Stop audio capture while the motion gate is idle
+ *
+ * Sends a heartbeat every CONFIG_METABOW_MOTION_GATE_HEARTBEAT_MS and
+ * restarts capture once the gate opens.
+ */
+static int audio_idle(void)
+{
+	void *buffer;
+	uint32_t size;
+	int ret;
+
+	ret = dmic_trigger(dmic_dev, DMIC_TRIGGER_STOP);
+	if (ret < 0) {
+		LOG_ERR("STOP trigger failed: %d", ret);
+		return ret;
+	}
+
+	// Release blocks captured before the stop
+	while (dmic_read(dmic_dev, 0, &buffer, &size, 0) == 0) {
+		k_mem_slab_free(&mem_slab, &buffer);
+	}
+
+	while (motion_gate_wait_streaming(K_MSEC(CONFIG_METABOW_MOTION_GATE_HEARTBEAT_MS)) != 0) {
+		send_heartbeat();
+	}
+
+	timebase_audio_restart();
+	ret = dmic_trigger(dmic_dev, DMIC_TRIGGER_START);
+	if (ret < 0) {
+		LOG_ERR("START trigger failed: %d", ret);
+	}
+
+	return ret;
+}
+#endif
+
 int main(void)
 {
 	int blink_status = 0;
 	int err = 0;
 	int ret;
 
+	boot_profile_mark(BOOT_PHASE_MAIN);
+
 	
 #if (TEST_DK_APP == 0)
 	if (!device_is_ready(dmic_dev)) {
@@ -350,8 +621,6 @@ int main(void)
 		return 0;
 	}
 
-	k_sem_give(&imu_init_ok);
-
 	struct pcm_stream_cfg stream = {
 		.pcm_width = SAMPLE_BIT_WIDTH,
 		.mem_slab  = &mem_slab,
@@ -388,8 +657,13 @@ int main(void)
 		return ret;
 	}
 	
+#ifdef CONFIG_NRFX_PDM
 	nrf_pdm_gain_set(NRF_PDM0, NRF_PDM_GAIN_MAXIMUM, NRF_PDM_GAIN_MAXIMUM);
 #endif
+
+	timebase_init(MAX_SAMPLE_RATE);
+	boot_profile_mark(BOOT_PHASE_DMIC_READY);
+#endif
 	configure_gpio();
 
 	// err = uart_init();
@@ -397,56 +671,74 @@ int main(void)
 	// 	error();
 	// }
 
-	err = bt_enable(NULL);
+	/* The Bluetooth controller, the sensor hub (on the bno08x init thread)
+	 * and the battery monitor come up in parallel; only wait where the next
+	 * step actually depends on an earlier one.
+	 */
+	err = bt_enable(bt_ready);
 	if (err) {
 		error();
 	}
+
+	err = battery_monitor_init();
+	if (err) {
+		LOG_ERR("Battery monitor init failed: %d", err);
+		// Continue anyway, battery monitoring is not critical
+	} else {
+		boot_profile_mark(BOOT_PHASE_BATTERY_READY);
+	}
+
+	k_work_init_delayable(&battery_ble_update_work, battery_ble_update_handler);
+
+	err = boot_profile_wait(BOOT_PHASE_BIT(BOOT_PHASE_BT_READY), K_SECONDS(5));
+	if (err) {
+		error();
+	}
+
 	// /* ---------- expose mcumgr SMP DFU service -------------- */
 	smp_bt_register();        /* init Secure DFU OTA */
 
-
 	LOG_INF("Bluetooth initialized");
 
-	k_sem_give(&ble_init_ok);
-
 	if (IS_ENABLED(CONFIG_SETTINGS)) {
 		settings_load();
 	}
+	boot_profile_mark(BOOT_PHASE_SETTINGS_LOADED);
+
+	control_init(imu_dev, control_reply, control_event);
+#ifdef CONFIG_METABOW_FRAME_V2
+	packetiser_init(ble_notify);
+#endif
 
 	err = bt_nus_init(&nus_cb);
 	if (err) {
 		LOG_ERR("Failed to initialize NUS service (err: %d)", err);
 		return 0;
 	}
+	// NUS TX characteristic value, notified directly to get completion callbacks
+	fanout_init(bt_gatt_find_by_uuid(NULL, 0, BT_UUID_NUS_TX));
+#ifdef CONFIG_METABOW_L2CAP
+	l2cap_stream_init();
+#endif
 
-	k_sleep(K_MSEC(500));
-	// Initialize battery monitoring
-	err = battery_monitor_init();
+	uint8_t initial_battery = battery_get_soc();
+	err = bt_bas_set_battery_level(initial_battery);
 	if (err) {
-		LOG_ERR("Battery monitor init failed: %d", err);
-		// Continue anyway, battery monitoring is not critical
+		LOG_WRN("Failed to set initial battery level: %d", err);
+	} else {
+		LOG_INF("Initial battery level set to %d%%", initial_battery);
 	}
 
-	    // Initialize battery BLE update work
-    k_work_init_delayable(&battery_ble_update_work, battery_ble_update_handler);
-
-    // Get initial battery reading and set it
-    k_sleep(K_MSEC(100)); // Small delay to ensure battery monitor has a reading
-    uint8_t initial_battery = battery_get_soc();
-    err = bt_bas_set_battery_level(initial_battery);
-    if (err) {
-        LOG_WRN("Failed to set initial battery level: %d", err);
-    } else {
-        LOG_INF("Initial battery level set to %d%%", initial_battery);
-    }
+	// Before advertising, a central may connect as soon as it starts
+	link_init();
 
+	// Resumed after each connection while a connection slot is free
 	err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
 	if (err) {
 		LOG_ERR("Advertising failed to start (err %d)", err);
 		return 0;
 	}
-
-	bt_gatt_cb_register(&gatt_callbacks);
+	boot_profile_mark(BOOT_PHASE_ADVERTISING);
 
 	//===TESTING=======================================
 	// if (!gpio_is_ready_dt(&imu_clk_sel)) {
@@ -487,6 +779,13 @@ int main(void)
 
 		void *buffer;
 		uint32_t size;
+
+		if (!motion_gate_is_streaming()) {
+			ret = audio_idle();
+			if (ret < 0) {
+				return ret;
+			}
+		}
 #if defined(DEBUG_PRINT)
 		LOG_INF("mem_slabs in use before next dmic read: %d", k_mem_slab_num_used_get(&mem_slab));
 #endif
@@ -495,6 +794,12 @@ int main(void)
 			LOG_ERR("dmic read failed: %d", ret);
 			return ret;
 		}
+		uint32_t audio_ts = timebase_audio_block(size / BYTES_PER_SAMPLE);
+		// The timebase carries on from uptime, so the first block is not at 0
+		if (!boot_profile_reached(BOOT_PHASE_FIRST_AUDIO)) {
+			boot_profile_mark(BOOT_PHASE_FIRST_AUDIO);
+		}
+		motion_gate_resumed();
 		
 		struct mem_slab_data_t *tx = k_malloc(sizeof(*tx));
 		if (tx == NULL) {
@@ -503,6 +808,8 @@ int main(void)
 		}
 		tx->len = size;
 		tx->data = buffer;
+		tx->timestamp_us = audio_ts;
+		tx->heartbeat = false;
 		k_fifo_put(&fifo_nus_rx_data, tx);
 		// LOG_INF("dmic buffer size: %d", size);
 #endif
@@ -519,121 +826,845 @@ int main(void)
 
 }
 
+#if defined(CONFIG_METABOW_IMU_COMPACT) || defined(CONFIG_METABOW_IMU_DELTA)
+// Updated from the hub's metadata once the IMU is up
+static struct imu_compact_scale fusion_scale = {
+	.accel_exp = IMU_COMPACT_ACCEL_EXP,
+	.gyro_exp = IMU_COMPACT_GYRO_EXP,
+	.magn_exp = IMU_COMPACT_MAGN_EXP,
+};
+static const struct imu_compact_scale raw_scale = {
+	.accel_exp = IMU_COMPACT_RAW_ACCEL_EXP,
+	.gyro_exp = IMU_COMPACT_GYRO_EXP,
+	.magn_exp = IMU_COMPACT_RAW_MAGN_EXP,
+};
+
+/**
+ * @brief Quantize fusion samples with the Q points the hub reports them in,
+ * so the integer encodings keep exactly the hub's resolution
+ */
+static void imu_scale_from_hub(void)
+{
+	static const enum bno08x_sensor sensors[] = {
+		BNO08X_SENSOR_ACCEL, BNO08X_SENSOR_GYRO, BNO08X_SENSOR_MAGN,
+	};
+	uint8_t *exps[] = {&fusion_scale.accel_exp, &fusion_scale.gyro_exp, &fusion_scale.magn_exp};
+	struct bno08x_sensor_info info;
+
+	for (int n = 0; n < ARRAY_SIZE(sensors); n++) {
+		if (bno08x_sensor_info_get(imu_dev, sensors[n], &info) == 0 &&
+		    info.q_point <= IMU_COMPACT_EXP_MAX) {
+			*exps[n] = info.q_point;
+		}
+	}
+
+	LOG_INF("IMU scale exponents: accel %u, gyro %u, magn %u",
+		fusion_scale.accel_exp, fusion_scale.gyro_exp, fusion_scale.magn_exp);
+}
+
+/**
+ * @brief Scale and status nibble of an IMU record for the integer encodings
+ */
+static const struct imu_compact_scale *imu_record_scale(uint8_t imu_flags,
+							uint8_t imu_cal_status, uint8_t *status)
+{
+	*status = BNO08X_CAL_STATUS_GET(imu_cal_status, ROTATION_VEC);
+	if (imu_flags & IMU_FLAG_DEVICE_FILTER) {
+		*status |= IMU_COMPACT_STATUS_DEVICE_FILTER;
+		return &raw_scale;
+	}
+	return &fusion_scale;
+}
+#endif
+
+#ifdef CONFIG_METABOW_IMU_COMPACT
+/**
+ * @brief Encode the floats of an IMU record in the compact format
+ */
+static void imu_pack_compact(const uint8_t *imu_record, uint8_t imu_flags,
+			     uint8_t imu_cal_status, uint8_t *out)
+{
+	float imu_data[IMU_DATA_SIZE/sizeof(float)];
+	uint8_t status;
+	const struct imu_compact_scale *scale = imu_record_scale(imu_flags, imu_cal_status, &status);
+
+	memcpy(imu_data, imu_record, IMU_DATA_SIZE);
+	imu_compact_encode(imu_data, scale, status, out);
+}
+#endif
+
+#if defined(CONFIG_METABOW_IMU_DELTA) || defined(CONFIG_METABOW_FRAME_V2)
+/**
+ * @brief Whether to leave out an IMU sample
+ *
+ * Every other sample is left out while flow control sheds IMU data.
+ *
+ * @param shed Current shed level
+ * @return true to drop the sample
+ */
+static bool imu_decimate(enum flow_shed shed)
+{
+	static bool dropped;
+
+	dropped = (shed == FLOW_SHED_IMU) && !dropped;
+	if (dropped) {
+		flow_drop(FLOW_DROP_IMU, 1);
+	}
+
+	return dropped;
+}
+#endif
+
+#ifdef CONFIG_METABOW_IMU_DELTA
+/**
+ * @brief Delta encode the queued IMU records into one batch
+ *
+ * Takes up to IMU_DELTA_MAX_SAMPLES records, stopping early at a change of
+ * IMU flags so that all samples of a batch share one scale.
+ *
+ * @param out Batch destination, IMU_DELTA_MAX_SIZE bytes
+ * @param imu_flags Flags of the batch's records, 0 if there were none
+ * @param imu_cal_status Calibration status of the last record
+ * @param shed Flow control shed level, decimates the records
+ * @return Batch length
+ */
+static size_t imu_pack_delta(uint8_t *out, uint8_t *imu_flags, uint8_t *imu_cal_status,
+			     enum flow_shed shed)
+{
+	struct imu_delta_sample samples[IMU_DELTA_MAX_SAMPLES];
+	uint8_t imu_record[IMU_RECORD_SIZE];
+	float imu_data[IMU_DATA_SIZE/sizeof(float)];
+	const struct imu_compact_scale *scale;
+	uint8_t status;
+	int count = 0;
+
+	*imu_flags = 0;
+	*imu_cal_status = 0;
+	if (k_msgq_get(&imu_msgq, imu_record, K_USEC(50)) < 0) {
+		return imu_delta_encode(samples, 0, 0, out);
+	}
+
+	*imu_flags = imu_record[IMU_DATA_SIZE];
+	do {
+		*imu_cal_status = imu_record[IMU_DATA_SIZE + IMU_DATA_FLAG_SIZE + IMU_TIMESTAMP_SIZE];
+		scale = imu_record_scale(*imu_flags, *imu_cal_status, &status);
+		if (imu_decimate(shed)) {
+			continue;
+		}
+		memcpy(imu_data, imu_record, IMU_DATA_SIZE);
+		imu_compact_quantize(imu_data, scale, samples[count].value);
+		memcpy(&samples[count].timestamp_us, imu_record + IMU_DATA_SIZE + IMU_DATA_FLAG_SIZE,
+		       IMU_TIMESTAMP_SIZE);
+		count++;
+	} while (count < IMU_DELTA_MAX_SAMPLES &&
+		 k_msgq_peek(&imu_msgq, imu_record) == 0 &&
+		 imu_record[IMU_DATA_SIZE] == *imu_flags &&
+		 k_msgq_get(&imu_msgq, imu_record, K_NO_WAIT) == 0);
+
+	return imu_delta_encode(samples, count, imu_compact_scale_word(scale, status), out);
+}
+#endif
+
+#ifdef CONFIG_METABOW_FRAME_V2
+/**
+ * @brief Add the queued IMU data to a v2 frame
+ *
+ * Adds the IMU section, and the yaw/pitch/roll section when built in, or
+ * nothing if no sample is queued.
+ *
+ * @param w Writer with room for FRAME_IMU_SIZE and IMU_PACKET_YPR_SIZE
+ *          plus their section headers
+ * @param shed Flow control shed level
+ */
+static void frame_add_imu(struct frame_writer *w, enum flow_shed shed)
+{
+	uint8_t *p;
+
+#ifdef CONFIG_METABOW_IMU_DELTA
+	// Always sent, so the host sees every batch sequence number
+	p = frame_section(w, FRAME_SECTION_IMU_DELTA, FRAME_IMU_SIZE);
+	frame_trim(w, FRAME_IMU_DELTA_PREFIX_SIZE +
+		   imu_pack_delta(p + FRAME_IMU_DELTA_PREFIX_SIZE, &p[0], &p[1], shed));
+#else
+	uint8_t imu_record[IMU_RECORD_SIZE];
+
+	if (k_msgq_get(&imu_msgq, imu_record, K_USEC(50)) == 0 && !imu_decimate(shed)) {
+		uint8_t imu_data_flag = imu_record[IMU_DATA_SIZE];
+		uint8_t imu_cal_status = imu_record[IMU_DATA_SIZE + IMU_DATA_FLAG_SIZE + IMU_TIMESTAMP_SIZE];
+
+#ifdef CONFIG_METABOW_IMU_COMPACT
+		p = frame_section(w, FRAME_SECTION_IMU_COMPACT, FRAME_IMU_SIZE);
+		imu_pack_compact(imu_record, imu_data_flag, imu_cal_status, p + FRAME_IMU_PREFIX_SIZE);
+#else
+		p = frame_section(w, FRAME_SECTION_IMU, FRAME_IMU_SIZE);
+		memcpy(p + FRAME_IMU_PREFIX_SIZE, imu_record, IMU_DATA_SIZE);
+#endif
+		p[0] = imu_data_flag;
+		p[1] = imu_cal_status;
+		memcpy(&p[2], imu_record + IMU_DATA_SIZE + IMU_DATA_FLAG_SIZE, IMU_TIMESTAMP_SIZE);
+
+#ifdef CONFIG_METABOW_IMU_YPR
+		if (imu_data_flag & IMU_FLAG_VALID) {
+			float quat[4];
+			float ypr[3];
+
+			memcpy(quat, imu_record, sizeof(quat));
+			bno08x_quat_to_ypr(quat, ypr);
+			for (int n = 0; n < 3; n++) {
+				ypr[n] *= IMU_YPR_DEG_PER_RAD;
+			}
+			p = frame_section(w, FRAME_SECTION_YPR, IMU_YPR_SIZE);
+			memcpy(p, ypr, IMU_YPR_SIZE);
+		}
+#endif
+	}
+#endif
+}
+
+/**
+ * @brief Build a v2 frame from an audio block and the queued IMU data
+ * @param w Writer, started by this function
+ * @param frame Destination, FRAME_MAX_SIZE bytes
+ * @param buf Audio block, no audio for a heartbeat
+ * @param shed Flow control shed level
+ * @param imu Set to the IMU sections in the frame
+ * @param imu_len Set to their length, 0 if there were none
+ */
+static void ble_build_frame(struct frame_writer *w, uint8_t *frame,
+			    const struct mem_slab_data_t *buf, enum flow_shed shed,
+			    const uint8_t **imu, size_t *imu_len)
+{
+	float battery_soc = (float)battery_get_soc();
+	uint8_t *p;
+
+	frame_begin(w, frame, FRAME_MAX_SIZE,
+		    buf->heartbeat ? FRAME_TYPE_HEARTBEAT : FRAME_TYPE_STREAM, buf->timestamp_us);
+
+	if (!buf->heartbeat && shed >= FLOW_SHED_AUDIO) {
+		flow_drop(FLOW_DROP_AUDIO, 1);
+	} else if (!buf->heartbeat) {
+		p = frame_section(w, FRAME_SECTION_PCM, buf->len);
+		if (p) {
+			memcpy(p, buf->data, buf->len);
+		}
+	}
+
+	*imu = frame + w->len;
+	frame_add_imu(w, shed);
+	*imu_len = frame + w->len - *imu;
+
+	p = frame_section(w, FRAME_SECTION_BATTERY, BATTERY_DATA_SIZE);
+	memcpy(p, &battery_soc, BATTERY_DATA_SIZE);
+}
+#endif
+
+#ifdef CONFIG_METABOW_SERVICE
+/**
+ * @brief Notify an audio block on the MetaBow service audio characteristic
+ *
+ * A block longer than the notification payload is split; each part starts
+ * with the timestamp of its first sample.
+ */
+static void svc_send_audio(const struct mem_slab_data_t *buf)
+{
+	static uint8_t value[SVC_AUDIO_SIZE];
+	const struct bt_gatt_attr *attr = metabow_svc_attr(METABOW_SVC_AUDIO);
+	// The smallest payload of the subscribed hosts
+	const size_t payload = MIN(fanout_payload_size(attr), SVC_AUDIO_SIZE);
+	// Whole samples per notification
+	const size_t chunk = ROUND_DOWN(payload - AUDIO_TIMESTAMP_SIZE, sizeof(int16_t));
+
+	for (size_t offset = 0; offset < buf->len; offset += chunk) {
+		const size_t len = MIN(chunk, buf->len - offset);
+		const uint32_t timestamp_us = buf->timestamp_us +
+			(uint32_t)((uint64_t)(offset / sizeof(int16_t)) * USEC_PER_SEC / MAX_SAMPLE_RATE);
+
+		memcpy(value, &timestamp_us, AUDIO_TIMESTAMP_SIZE);
+		memcpy(value + AUDIO_TIMESTAMP_SIZE, (const uint8_t *)buf->data + offset, len);
+		fanout_send(attr, value, AUDIO_TIMESTAMP_SIZE + len, K_NO_WAIT);
+	}
+}
+
+/**
+ * @brief Send an audio block and the queued IMU data on the MetaBow service
+ *
+ * Only the streams with a subscriber are encoded. IMU samples nobody
+ * subscribed to are discarded so the queue holds fresh ones. When a v2
+ * frame was built for the same block its IMU sections are reused, the
+ * queued samples having gone into it.
+ *
+ * @param buf Audio block, no audio for a heartbeat
+ * @param shed Flow control shed level
+ * @param sections IMU sections of the block's v2 frame, NULL if none was built
+ * @param sections_len Their length
+ */
+static void svc_send_block(const struct mem_slab_data_t *buf, enum flow_shed shed,
+			   const uint8_t *sections, size_t sections_len)
+{
+	static uint8_t imu[FRAME_OVERHEAD + SVC_IMU_SIZE];
+	const struct bt_gatt_attr *imu_attr = metabow_svc_attr(METABOW_SVC_IMU);
+	struct frame_writer w;
+
+	if (!buf->heartbeat && fanout_wants(metabow_svc_attr(METABOW_SVC_AUDIO))) {
+		if (shed < FLOW_SHED_AUDIO) {
+			svc_send_audio(buf);
+		} else if (!sections) {
+			// Counted with the frame otherwise
+			flow_drop(FLOW_DROP_AUDIO, 1);
+		}
+	}
+
+	if (!fanout_wants(imu_attr)) {
+		if (!sections) {
+			k_msgq_purge(&imu_msgq);
+		}
+		return;
+	}
+
+	if (!sections) {
+		// Only the sections are sent, the frame is never ended
+		frame_begin(&w, imu, sizeof(imu), FRAME_TYPE_STREAM, buf->timestamp_us);
+		frame_add_imu(&w, shed);
+		sections = imu + FRAME_HEADER_SIZE;
+		sections_len = w.len - FRAME_HEADER_SIZE;
+	}
+	if (sections_len > 0) {
+		fanout_send(imu_attr, sections, sections_len, K_NO_WAIT);
+	}
+}
+#endif
+
 void ble_write_thread(void)
 {
     /* Don't go any further until BLE is initialized */
-    k_sem_take(&ble_init_ok, K_FOREVER);
-    int rc;
+    boot_profile_wait(BOOT_PHASE_BIT(BOOT_PHASE_BT_READY), K_FOREVER);
     
     for (;;) {
+#ifdef CONFIG_METABOW_FRAME_V2
+        // A partly filled notification waits a little for the next frame
+        struct mem_slab_data_t *buf = k_fifo_get(&fifo_nus_rx_data,
+                packetiser_pending() ? K_MSEC(CONFIG_METABOW_PACKET_HOLD_MS) : K_FOREVER);
+        if (buf == NULL) {
+            packetiser_flush();
+        }
+#else
         struct mem_slab_data_t *buf = k_fifo_get(&fifo_nus_rx_data, K_FOREVER);
+#endif
         if(buf != NULL){
             void *buffer = buf->data;
+#ifdef CONFIG_METABOW_FRAME_V2
+            struct frame_writer w;
+            const enum flow_shed shed = fanout_shed();
+            const uint8_t *imu = NULL;
+            size_t imu_len = 0;
+
+            // Encoded once whichever hosts take it
+            if (fanout_wants(NULL)) {
+                ble_build_frame(&w, packetiser_reserve(FRAME_MAX_SIZE), buf, shed,
+                                &imu, &imu_len);
+#ifdef CONFIG_METABOW_SERVICE
+                // Before the commit, which may move the frame
+                svc_send_block(buf, shed, imu, imu_len);
+#endif
+                ble_commit_frame(&w, false);
+            } else {
+#ifdef CONFIG_METABOW_SERVICE
+                svc_send_block(buf, shed, NULL, 0);
+#else
+                k_msgq_purge(&imu_msgq);
+#endif
+            }
+#else
             uint32_t size = BLE_BLOCK_SIZE;
 
+#ifdef CONFIG_METABOW_IMU_DELTA
+            uint8_t *hdr = (uint8_t*)buffer + MAX_BLOCK_SIZE;
+            uint8_t imu_data_flag;
+            uint8_t imu_cal_status;
+            size = MAX_BLOCK_SIZE + IMU_DELTA_PACKET_HEADER_SIZE +
+                   imu_pack_delta(hdr + IMU_DELTA_PACKET_HEADER_SIZE, &imu_data_flag, &imu_cal_status,
+                                  FLOW_SHED_NONE);
+            // Hosts tell the layouts apart by length, never match a fixed one
+            for (size_t n = 0; n < ARRAY_SIZE(imu_fixed_packet_sizes); n++) {
+                if (size == imu_fixed_packet_sizes[n]) {
+                    *((uint8_t*)buffer + size++) = 0;
+                    break;
+                }
+            }
+
+            if (buf->heartbeat) {
+                imu_data_flag |= IMU_FLAG_HEARTBEAT;
+            }
+            float battery_soc = (float)battery_get_soc();
+            hdr[0] = imu_data_flag;
+            memcpy(hdr + IMU_DATA_FLAG_SIZE, &battery_soc, BATTERY_DATA_SIZE);
+            memcpy(hdr + IMU_DATA_FLAG_SIZE + BATTERY_DATA_SIZE, &buf->timestamp_us, AUDIO_TIMESTAMP_SIZE);
+            hdr[IMU_DATA_FLAG_SIZE + BATTERY_DATA_SIZE + AUDIO_TIMESTAMP_SIZE] = imu_cal_status;
+#else
             // Get IMU data
-            size_t bytes_read;
-            rc = k_pipe_get(&imu_pipe, (uint8_t*)buffer+MAX_BLOCK_SIZE, IMU_DATA_SIZE, &bytes_read,
-                    IMU_DATA_SIZE, K_USEC(50));
+            uint8_t imu_record[IMU_RECORD_SIZE];
+            uint32_t imu_ts = 0;
+            uint8_t imu_cal_status = 0;
+            int rc = k_msgq_get(&imu_msgq, imu_record, K_USEC(50));
             uint8_t imu_data_flag = 0;
-            if((rc < 0) && (bytes_read == 0)){
-                imu_data_flag = 0;
-            }else if ((rc < 0) || (bytes_read < IMU_DATA_SIZE)) {
-                LOG_ERR("Failed to get all IMU data from pipe, read: %d", bytes_read);
+            if (rc < 0) {
                 imu_data_flag = 0;
             }else{
-                imu_data_flag = 1;
+                imu_data_flag = imu_record[IMU_DATA_SIZE];
+                memcpy(&imu_ts, imu_record + IMU_DATA_SIZE + IMU_DATA_FLAG_SIZE, IMU_TIMESTAMP_SIZE);
+                imu_cal_status = imu_record[IMU_DATA_SIZE + IMU_DATA_FLAG_SIZE + IMU_TIMESTAMP_SIZE];
+#ifdef CONFIG_METABOW_IMU_COMPACT
+                imu_pack_compact(imu_record, imu_data_flag, imu_cal_status,
+                                 (uint8_t*)buffer + MAX_BLOCK_SIZE);
+#else
+                memcpy((uint8_t*)buffer + MAX_BLOCK_SIZE, imu_record, IMU_DATA_SIZE);
+#endif
             }
             
+            if (buf->heartbeat) {
+                imu_data_flag |= IMU_FLAG_HEARTBEAT;
+            }
+
             // Set IMU data flag
-            *((uint8_t*)buffer + MAX_BLOCK_SIZE + IMU_DATA_SIZE) = imu_data_flag;
+            *((uint8_t*)buffer + MAX_BLOCK_SIZE + IMU_PACKET_DATA_SIZE) = imu_data_flag;
             
             // Add battery SoC data
             float battery_soc = (float)battery_get_soc();  // Get current battery percentage
-            memcpy((uint8_t*)buffer + MAX_BLOCK_SIZE + IMU_DATA_SIZE + IMU_DATA_FLAG_SIZE, 
+            memcpy((uint8_t*)buffer + MAX_BLOCK_SIZE + IMU_PACKET_DATA_SIZE + IMU_DATA_FLAG_SIZE, 
                    &battery_soc, BATTERY_DATA_SIZE);
             
-            LOG_INF("Sending BLE data with Battery SoC: %.1f%%", battery_soc);
-
-            const size_t max_packet_size = bt_nus_get_mtu(current_conn);
-            LOG_INF("BLE audio data buffer size: %d, MTU size: %d", size, max_packet_size);
-            
-            if (size > max_packet_size){
-                for (uint32_t sendIndex = 0; sendIndex < size; sendIndex += max_packet_size) {
-                    uint32_t chunkLength = sendIndex + max_packet_size < size
-                            ? max_packet_size
-                            : (size - sendIndex);
-                    if (bt_nus_send(current_conn, (uint8_t*) buffer + sendIndex, chunkLength)) {
-                        // LOG_WRN("Failed to send audio data over BLE connection");
-                    }
-                }
-            }else{
-                if (bt_nus_send(current_conn, (uint8_t*) buffer, size)) {
-                    // LOG_WRN("Failed to send audio data over BLE connection");
+            // Add timestamps
+            uint8_t *ts = (uint8_t*)buffer + MAX_BLOCK_SIZE + IMU_PACKET_DATA_SIZE + IMU_DATA_FLAG_SIZE + BATTERY_DATA_SIZE;
+            memcpy(ts, &buf->timestamp_us, AUDIO_TIMESTAMP_SIZE);
+            memcpy(ts + AUDIO_TIMESTAMP_SIZE, &imu_ts, IMU_TIMESTAMP_SIZE);
+            ts[AUDIO_TIMESTAMP_SIZE + IMU_TIMESTAMP_SIZE] = imu_cal_status;
+
+#ifdef CONFIG_METABOW_IMU_YPR
+            float ypr[3] = {0};
+            if (imu_data_flag & IMU_FLAG_VALID) {
+                float quat[4];
+                memcpy(quat, imu_record, sizeof(quat));
+                bno08x_quat_to_ypr(quat, ypr);
+                for (int n = 0; n < 3; n++) {
+                    ypr[n] *= IMU_YPR_DEG_PER_RAD;
                 }
             }
+            memcpy(ts + AUDIO_TIMESTAMP_SIZE + IMU_TIMESTAMP_SIZE + IMU_CAL_STATUS_SIZE, ypr, IMU_YPR_SIZE);
+#endif
+#endif
+
+            LOG_INF("Sending BLE data with Battery SoC: %.1f%%", battery_soc);
+
+            ble_send((uint8_t*) buffer, size);
+#endif
             k_mem_slab_free(&mem_slab, &buffer);
             k_free(buf);
         }
     }
 }
 
-void imu_fetch_thread(void)
+/**
+ * @brief Read the latest hub fusion sample
+ */
+static int imu_read_fusion(float *imu_data, uint32_t *imu_ts, uint8_t *imu_cal_status)
 {
-	k_sem_take(&imu_init_ok, K_FOREVER);
-	// todo add out of tree sensor_channel include to define custom channels
-	#define SENSOR_CHAN_ROTATION_VEC_IJKR 61
 	struct sensor_value quat[4];
 	struct sensor_value accel[3];
 	struct sensor_value gyro[3];
 	struct sensor_value mag[3];
+	struct sensor_value sample_time;
+	struct sensor_value cal_status;
+	int rc;
+
+	rc = sensor_channel_get(imu_dev, SENSOR_CHAN_ROTATION_VEC_IJKR, quat);
+	if (rc < 0){LOG_ERR("could not get ROTATION_VEC data: %d", rc);return rc;}
+	rc = sensor_channel_get(imu_dev, SENSOR_CHAN_ACCEL_XYZ, accel);
+	if (rc < 0){LOG_ERR("could not get ACCEL_XYZ data: %d", rc);return rc;}
+	rc = sensor_channel_get(imu_dev, SENSOR_CHAN_GYRO_XYZ, gyro);
+	if (rc < 0){LOG_ERR("could not get GYRO_XYZ data: %d", rc);return rc;}
+	rc = sensor_channel_get(imu_dev, SENSOR_CHAN_MAGN_XYZ, mag);
+	if (rc < 0){LOG_ERR("could not get MAGN_XYZ data: %d", rc);return rc;}
+	rc = sensor_channel_get(imu_dev, SENSOR_CHAN_ROTATION_VEC_TIMESTAMP, &sample_time);
+	if (rc < 0){LOG_ERR("could not get sample timestamp: %d", rc);return rc;}
+	*imu_ts = timebase_from_uptime_us((uint64_t)sample_time.val1 * USEC_PER_SEC + sample_time.val2);
+	rc = sensor_channel_get(imu_dev, SENSOR_CHAN_CALIBRATION_STATUS, &cal_status);
+	if (rc < 0){LOG_ERR("could not get calibration status: %d", rc);return rc;}
+	*imu_cal_status = (uint8_t)cal_status.val1;
+
+	// TBD should become a struct
+	imu_data[0] = (float)sensor_value_to_double(&quat[0]);
+	imu_data[1] = (float)sensor_value_to_double(&quat[1]);
+	imu_data[2] = (float)sensor_value_to_double(&quat[2]);
+	imu_data[3] = (float)sensor_value_to_double(&quat[3]);
+
+	imu_data[4] = (float)sensor_value_to_double(&accel[0]);
+	imu_data[5] = (float)sensor_value_to_double(&accel[1]);
+	imu_data[6] = (float)sensor_value_to_double(&accel[2]);
+
+	imu_data[7] = (float)sensor_value_to_double(&gyro[0]);
+	imu_data[8] = (float)sensor_value_to_double(&gyro[1]);
+	imu_data[9] = (float)sensor_value_to_double(&gyro[2]);
+
+	imu_data[10] = (float)sensor_value_to_double(&mag[0]);
+	imu_data[11] = (float)sensor_value_to_double(&mag[1]);
+	imu_data[12] = (float)sensor_value_to_double(&mag[2]);
+
+#if defined(DEBUG_PRINT)
+	LOG_INF("Rotation: I: %f, J: %f, K: %f, R: %f", sensor_value_to_double(&quat[0]), sensor_value_to_double(&quat[1]), sensor_value_to_double(&quat[2]), sensor_value_to_double(&quat[3]));
+	LOG_INF("Acceleration: X: %f, Y: %f, Z: %f", sensor_value_to_double(&accel[0]), sensor_value_to_double(&accel[1]), sensor_value_to_double(&accel[2]));
+	LOG_INF("Gyroscope: X: %f, Y: %f, Z: %f", sensor_value_to_double(&gyro[0]), sensor_value_to_double(&gyro[1]), sensor_value_to_double(&gyro[2]));
+	LOG_INF("Magnetometer: X: %f, Y: %f, Z: %f", sensor_value_to_double(&mag[0]), sensor_value_to_double(&mag[1]), sensor_value_to_double(&mag[2]));
+#endif
+	return 0;
+}
+
+/**
+ * @brief Run every raw sample received since the last call through the
+ * orientation filter and report the newest one
+ *
+ * Accel and mag are sent in raw counts, gyro in rad/s.
+ */
+static int imu_read_raw(float *imu_data, uint32_t *imu_ts)
+{
+	static struct bno08x_raw_sample raw[IMU_RAW_BATCH];
+	const struct bno08x_raw_sample *last;
+	int n = bno08x_raw_read(imu_dev, raw, ARRAY_SIZE(raw));
+
+	if (n <= 0) {
+		return (n == 0) ? -EAGAIN : n;
+	}
+
+	for (int i = 0; i < n; i++) {
+		orient_filter_update(raw[i].gyro, raw[i].accel, raw[i].magn, raw[i].timestamp_us);
+	}
+
+	last = &raw[n - 1];
+	orient_filter_get_quat(imu_data);
+	for (int i = 0; i < 3; i++) {
+		imu_data[4 + i] = (float)last->accel[i];
+		imu_data[7 + i] = last->gyro[i] * ORIENT_FILTER_GYRO_RAD_PER_LSB;
+		imu_data[10 + i] = (float)last->magn[i];
+	}
+	*imu_ts = timebase_from_uptime_us(last->timestamp_us);
+
+	return 0;
+}
+
+// IMU_FLAG_GAP while the sample that ends a stream outage is not queued yet
+static uint8_t imu_gap_flag;
+
+/**
+ * @brief Note a stream outage that ended in the latest fetch, so that the
+ * next record carries IMU_FLAG_GAP
+ */
+static void imu_check_gap(void)
+{
+	struct bno08x_gap gap;
+
+	if (bno08x_gap_read(imu_dev, &gap) == 0) {
+		imu_gap_flag = IMU_FLAG_GAP;
+		control_report_gap(gap.duration_us);
+	}
+}
+
+/**
+ * @brief Lay out an IMU sample as a queue record
+ */
+static void imu_record_pack(uint8_t *imu_record, const float *imu_data, uint8_t imu_flags,
+			    uint32_t imu_ts, uint8_t imu_cal_status)
+{
+	memcpy(imu_record, imu_data, IMU_DATA_SIZE);
+	imu_record[IMU_DATA_SIZE] = imu_flags | imu_gap_flag;
+	imu_gap_flag = 0;
+	memcpy(imu_record + IMU_DATA_SIZE + IMU_DATA_FLAG_SIZE, &imu_ts, IMU_TIMESTAMP_SIZE);
+	imu_record[IMU_DATA_SIZE + IMU_DATA_FLAG_SIZE + IMU_TIMESTAMP_SIZE] = imu_cal_status;
+}
+
+/**
+ * @brief Queue an IMU record without waiting for the BLE thread, dropping
+ * the oldest record if it has fallen behind
+ */
+static void imu_queue_put(const uint8_t *imu_record)
+{
+	uint8_t stale[IMU_RECORD_SIZE];
+
+	while (k_msgq_put(&imu_msgq, imu_record, K_NO_WAIT) < 0) {
+		k_msgq_get(&imu_msgq, stale, K_NO_WAIT);
+	}
+	boot_profile_mark(BOOT_PHASE_FIRST_IMU);
+}
+
+#ifdef CONFIG_METABOW_IMU_DELTA
+/**
+ * @brief Queue every hub fusion sample received since the last fetch
+ *
+ * Accel, gyro and mag are the latest values at the time of each rotation
+ * vector sample.
+ */
+static int imu_queue_fusion(void)
+{
+	static struct bno08x_sample samples[IMU_FUSION_BATCH];
+	uint8_t imu_record[IMU_RECORD_SIZE];
 	float imu_data[IMU_DATA_SIZE/sizeof(float)];
-	size_t bytes_written;
+	struct sensor_value cal_status;
+	int n = bno08x_sample_read(imu_dev, samples, ARRAY_SIZE(samples));
+	int rc;
+
+	if (n <= 0) {
+		return (n == 0) ? -EAGAIN : n;
+	}
+
+	rc = sensor_channel_get(imu_dev, SENSOR_CHAN_CALIBRATION_STATUS, &cal_status);
+	if (rc < 0) {
+		LOG_ERR("could not get calibration status: %d", rc);
+		return rc;
+	}
+
+	for (int i = 0; i < n; i++) {
+		memcpy(&imu_data[0], samples[i].quat, sizeof(samples[i].quat));
+		memcpy(&imu_data[4], samples[i].accel, sizeof(samples[i].accel));
+		memcpy(&imu_data[7], samples[i].gyro, sizeof(samples[i].gyro));
+		memcpy(&imu_data[10], samples[i].magn, sizeof(samples[i].magn));
+		imu_record_pack(imu_record, imu_data, IMU_FLAG_VALID,
+				timebase_from_uptime_us(samples[i].timestamp_us),
+				(uint8_t)cal_status.val1);
+		imu_queue_put(imu_record);
+	}
+
+	return 0;
+}
+#endif
+
+/**
+ * @brief Pass the hub's latest stability state to the motion gate
+ */
+static void imu_update_gate(void)
+{
+	struct sensor_value stability;
+
+	if (sensor_channel_get(imu_dev, SENSOR_CHAN_STABILITY, &stability) == 0) {
+		motion_gate_update((enum bno08x_stability)stability.val1);
+	}
+}
+
+#ifdef CONFIG_METABOW_GESTURES
+/**
+ * @brief Send the gesture events of the latest fetch to the host
+ *
+ * They go out as control lines right away instead of through the IMU
+ * queue, so a cue is not held behind the audio packets waiting for the
+ * BLE thread.
+ */
+static void imu_send_gestures(void)
+{
+	struct bno08x_gesture_event events[4];
+	int n;
+
+	do {
+		n = bno08x_gesture_read(imu_dev, events, ARRAY_SIZE(events));
+		for (int i = 0; i < n; i++) {
+			control_report_gesture(&events[i],
+					       timebase_from_uptime_us(events[i].timestamp_us));
+		}
+	} while (n == ARRAY_SIZE(events));
+}
+
+/**
+ * @brief Arm the gesture detectors the host asked for
+ * @param armed Detectors armed so far, updated
+ */
+static void imu_update_gestures(uint8_t *armed)
+{
+	// Last failure, so a retry failing the same way is not logged again
+	static int failed_rc;
+	struct sensor_value val = { .val1 = control_get_gestures() };
 	int rc;
+
+	if (val.val1 == *armed) {
+		return;
+	}
+
+	rc = sensor_attr_set(imu_dev, SENSOR_CHAN_ALL, SENSOR_ATTR_BNO08X_GESTURES, &val);
+	if (rc < 0) {
+		// Retried on the next pass, e.g. once the hub's queue has room
+		if (rc != failed_rc) {
+			LOG_ERR("could not arm gestures: %d", rc);
+			failed_rc = rc;
+		}
+		return;
+	}
+
+	failed_rc = 0;
+	*armed = (uint8_t)val.val1;
+}
+#endif
+
+#ifdef CONFIG_BNO08X_ORIENTATION
+/**
+ * @brief Pass an output frame change from the host on to the hub
+ */
+static void imu_update_orient(void)
+{
+	struct control_orient req;
+	int rc;
+
+	if (!control_take_orient(&req)) {
+		return;
+	}
+
+	if (req.op == CONTROL_ORIENT_SET) {
+		rc = bno08x_reorient(imu_dev, req.quat);
+	} else {
+		rc = bno08x_tare(imu_dev, req.op == CONTROL_ORIENT_TARE_HEADING);
+	}
+	if (rc < 0) {
+		LOG_ERR("could not change the IMU frame: %d", rc);
+	}
+}
+#endif
+
+#ifdef CONFIG_METABOW_FILTER_BENCHMARK
+/**
+ * @brief Compare the per-sample CPU cost of hub fusion readout with the
+ * on-device filter. SH2 decoding is common to both and not included; the
+ * driver's decode bench covers it.
+ */
+static void imu_bench(void)
+{
+	float imu_data[IMU_DATA_SIZE/sizeof(float)];
+	uint32_t imu_ts;
+	uint8_t cal_status;
+	timing_t start, end;
+	uint64_t fusion_ns;
+	uint32_t filter_ns;
+
+	sensor_sample_fetch(imu_dev);
+
+	timing_init();
+	timing_start();
+	start = timing_counter_get();
+	for (int n = 0; n < IMU_BENCH_ITERATIONS; n++) {
+		imu_read_fusion(imu_data, &imu_ts, &cal_status);
+	}
+	end = timing_counter_get();
+	fusion_ns = timing_cycles_to_ns(timing_cycles_get(&start, &end)) / IMU_BENCH_ITERATIONS;
+	timing_stop();
+
+	filter_ns = orient_filter_bench_ns(IMU_BENCH_ITERATIONS);
+
+	LOG_INF("IMU cost per sample: hub fusion readout %u ns, on-device filter %u ns",
+		(uint32_t)fusion_ns, filter_ns);
+}
+#endif
+
+void imu_fetch_thread(void)
+{
+	int rc = bno08x_wait_ready(imu_dev, K_FOREVER);
+	if (rc < 0) {
+		LOG_ERR("IMU bring-up failed: %d", rc);
+		return;
+	}
+	boot_profile_mark(BOOT_PHASE_IMU_READY);
+#if defined(CONFIG_METABOW_IMU_COMPACT) || defined(CONFIG_METABOW_IMU_DELTA)
+	imu_scale_from_hub();
+#endif
+#ifdef CONFIG_METABOW_FILTER_BENCHMARK
+	imu_bench();
+#endif
+	enum bno08x_mode mode = BNO08X_MODE_FUSION;
+	enum bno08x_mode attempted = mode;
+	uint8_t imu_record[IMU_RECORD_SIZE];
+	float imu_data[IMU_DATA_SIZE/sizeof(float)];
+	uint32_t imu_ts;
+	uint8_t imu_flags;
+	uint8_t imu_cal_status;
+#ifdef CONFIG_METABOW_GESTURES
+	uint8_t gestures = 0;
+#endif
 	for (;;) {
-		
+		enum bno08x_mode requested = motion_gate_is_streaming() ?
+			control_get_imu_mode() : BNO08X_MODE_IDLE;
+
+		link_set_mode(requested == BNO08X_MODE_IDLE ? LINK_MODE_IDLE : LINK_MODE_STREAM);
+
+#ifdef CONFIG_METABOW_GESTURES
+		imu_update_gestures(&gestures);
+#endif
+#ifdef CONFIG_BNO08X_ORIENTATION
+		imu_update_orient();
+#endif
+
+		if (requested != attempted) {
+			struct sensor_value val = { .val1 = requested };
+
+			attempted = requested;
+			rc = sensor_attr_set(imu_dev, SENSOR_CHAN_ALL, SENSOR_ATTR_BNO08X_MODE, &val);
+			if (rc < 0) {
+				LOG_ERR("could not switch IMU mode: %d", rc);
+			} else {
+				mode = requested;
+				orient_filter_init();
+				LOG_INF("IMU mode %d", mode);
+			}
+		}
+
+		if (mode == BNO08X_MODE_IDLE) {
+			// Only motion reports are armed; sleep until the hub has one
+			rc = bno08x_wait_int(imu_dev, K_MSEC(CONFIG_METABOW_MOTION_GATE_HEARTBEAT_MS));
+			if (rc == 0) {
+				sensor_sample_fetch(imu_dev);
+				imu_update_gate();
+#ifdef CONFIG_METABOW_GESTURES
+				imu_send_gestures();
+#endif
+			}
+			continue;
+		}
+
 		sensor_sample_fetch(imu_dev);
+		imu_update_gate();
+		imu_check_gap();
+#ifdef CONFIG_METABOW_GESTURES
+		imu_send_gestures();
+#endif
 
-		rc = sensor_channel_get(imu_dev, SENSOR_CHAN_ROTATION_VEC_IJKR, quat);
-		if (rc < 0){LOG_ERR("could not get ROTATION_VEC data: %d", rc);continue;}
-		rc = sensor_channel_get(imu_dev, SENSOR_CHAN_ACCEL_XYZ, accel);
-		if (rc < 0){LOG_ERR("could not get ACCEL_XYZ data: %d", rc);continue;}
-		rc = sensor_channel_get(imu_dev, SENSOR_CHAN_GYRO_XYZ, gyro);
-		if (rc < 0){LOG_ERR("could not get GYRO_XYZ data: %d", rc);continue;}
-		rc = sensor_channel_get(imu_dev, SENSOR_CHAN_MAGN_XYZ, mag);
-		if (rc < 0){LOG_ERR("could not get MAGN_XYZ data: %d", rc);continue;}
-
-		// TBD should become a struct
-		imu_data[0] = (float)sensor_value_to_double(&quat[0]);
-		imu_data[1] = (float)sensor_value_to_double(&quat[1]);
-		imu_data[2] = (float)sensor_value_to_double(&quat[2]);
-		imu_data[3] = (float)sensor_value_to_double(&quat[3]);
-
-		imu_data[4] = (float)sensor_value_to_double(&accel[0]);
-		imu_data[5] = (float)sensor_value_to_double(&accel[1]);
-		imu_data[6] = (float)sensor_value_to_double(&accel[2]);
-
-		imu_data[7] = (float)sensor_value_to_double(&gyro[0]);
-		imu_data[8] = (float)sensor_value_to_double(&gyro[1]);
-		imu_data[9] = (float)sensor_value_to_double(&gyro[2]);
-
-		imu_data[10] = (float)sensor_value_to_double(&mag[0]);
-		imu_data[11] = (float)sensor_value_to_double(&mag[1]);
-		imu_data[12] = (float)sensor_value_to_double(&mag[2]);
-
-		rc = k_pipe_put(&imu_pipe, imu_data, IMU_DATA_SIZE, &bytes_written, IMU_DATA_SIZE, K_FOREVER);
-		
-		if (rc < 0) {
-            LOG_ERR("Failed to put IMU data into pipe: %d", rc);
-        } else if (bytes_written < IMU_DATA_SIZE) {
-            LOG_ERR("Only %d bytes written to IMU pipe", bytes_written);
-        }
-#if defined(DEBUG_PRINT)
-		LOG_INF("Rotation: I: %f, J: %f, K: %f, R: %f", sensor_value_to_double(&quat[0]), sensor_value_to_double(&quat[1]), sensor_value_to_double(&quat[2]), sensor_value_to_double(&quat[3]));
-		LOG_INF("Acceleration: X: %f, Y: %f, Z: %f", sensor_value_to_double(&accel[0]), sensor_value_to_double(&accel[1]), sensor_value_to_double(&accel[2]));
-		LOG_INF("Gyroscope: X: %f, Y: %f, Z: %f", sensor_value_to_double(&gyro[0]), sensor_value_to_double(&gyro[1]), sensor_value_to_double(&gyro[2]));
-		LOG_INF("Magnetometer: X: %f, Y: %f, Z: %f", sensor_value_to_double(&mag[0]), sensor_value_to_double(&mag[1]), sensor_value_to_double(&mag[2]));
+#ifdef CONFIG_METABOW_IMU_DELTA
+		if (mode == BNO08X_MODE_FUSION) {
+			// Every report is sent, several per packet
+			imu_queue_fusion();
+			k_sleep(K_USEC(200));
+			continue;
+		}
 #endif
+
+		if (mode == BNO08X_MODE_RAW) {
+			rc = imu_read_raw(imu_data, &imu_ts);
+			imu_flags = IMU_FLAG_VALID | IMU_FLAG_DEVICE_FILTER;
+			// Raw samples are uncalibrated
+			imu_cal_status = 0;
+		} else {
+			rc = imu_read_fusion(imu_data, &imu_ts, &imu_cal_status);
+			imu_flags = IMU_FLAG_VALID;
+		}
+		if (rc < 0) {
+			k_sleep(K_USEC(200));
+			continue;
+		}
+
+		imu_record_pack(imu_record, imu_data, imu_flags, imu_ts, imu_cal_status);
+
+		if (mode == BNO08X_MODE_RAW) {
+			// The filter has to keep up with the raw rate, so never wait for
+			// the BLE thread; replace whatever sample it has not taken yet
+			imu_queue_put(imu_record);
+		} else {
+			rc = k_msgq_put(&imu_msgq, imu_record, K_FOREVER);
+			if (rc < 0) {
+				LOG_ERR("Failed to put IMU data into queue: %d", rc);
+			} else {
+				boot_profile_mark(BOOT_PHASE_FIRST_IMU);
+			}
+		}
 		// bt_nus_send(current_conn, (uint8_t*) quat, sizeof(quat));
 		k_sleep(K_USEC(200));
 	}
@@ -0,0 +1,125 @@
+#include "metabow_svc.h"
+#include "control.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(metabow_svc, LOG_LEVEL_INF);
+
+// Streams with notifications enabled, a bit per enum metabow_svc_stream
+static atomic_t subscribed;
+static float battery_soc;
+
+static ssize_t read_battery(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                            void *buf, uint16_t len, uint16_t offset)
+{
+    float soc = battery_soc;
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &soc, sizeof(soc));
+}
+
+static ssize_t write_control(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                             const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    int err;
+
+    if (offset != 0) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+
+    err = control_handle_command(buf, len);
+    if (err) {
+        LOG_WRN("Command rejected: %d", err);
+    }
+
+    return len;
+}
+
+static void ccc_changed(enum metabow_svc_stream stream, uint16_t value)
+{
+    if (value & BT_GATT_CCC_NOTIFY) {
+        atomic_set_bit(&subscribed, stream);
+    } else {
+        atomic_clear_bit(&subscribed, stream);
+    }
+}
+
+#define METABOW_CCC_CHANGED(name, stream)                                     \
+    static void name(const struct bt_gatt_attr *attr, uint16_t value)       \
+    {                                                                         \
+        ccc_changed(stream, value);                                           \
+    }
+
+METABOW_CCC_CHANGED(audio_ccc_changed, METABOW_SVC_AUDIO)
+METABOW_CCC_CHANGED(imu_ccc_changed, METABOW_SVC_IMU)
+METABOW_CCC_CHANGED(events_ccc_changed, METABOW_SVC_EVENTS)
+METABOW_CCC_CHANGED(battery_ccc_changed, METABOW_SVC_BATTERY)
+METABOW_CCC_CHANGED(control_ccc_changed, METABOW_SVC_CONTROL)
+
+// Each stream takes three attributes: declaration, value and CCC
+#define METABOW_SVC_VALUE_ATTR(stream) (2 + 3 * (stream))
+
+BT_GATT_SERVICE_DEFINE(metabow_svc,
+    BT_GATT_PRIMARY_SERVICE(BT_UUID_METABOW_SERVICE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(BT_UUID_METABOW_VAL(1)),
+                           BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_NONE, NULL, NULL, NULL),
+    BT_GATT_CCC(audio_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(BT_UUID_METABOW_VAL(2)),
+                           BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_NONE, NULL, NULL, NULL),
+    BT_GATT_CCC(imu_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(BT_UUID_METABOW_VAL(3)),
+                           BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_NONE, NULL, NULL, NULL),
+    BT_GATT_CCC(events_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(BT_UUID_METABOW_VAL(4)),
+                           BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_READ,
+                           read_battery, NULL, NULL),
+    BT_GATT_CCC(battery_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(BT_UUID_METABOW_VAL(5)),
+                           BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP |
+                           BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_WRITE, NULL, write_control, NULL),
+    BT_GATT_CCC(control_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE)
+);
+
+/**
+ * @brief Whether any host has notifications of a stream enabled
+ */
+bool metabow_svc_subscribed(enum metabow_svc_stream stream)
+{
+    return atomic_test_bit(&subscribed, stream);
+}
+
+/**
+ * @brief Whether a host takes the audio or IMU stream from the service
+ *
+ * While true the combined stream is not sent to that host on NUS.
+ *
+ * @param conn Connection of the host, NULL for any host
+ */
+bool metabow_svc_streaming(struct bt_conn *conn)
+{
+    if (!conn) {
+        return metabow_svc_subscribed(METABOW_SVC_AUDIO) ||
+               metabow_svc_subscribed(METABOW_SVC_IMU);
+    }
+
+    return bt_gatt_is_subscribed(conn, metabow_svc_attr(METABOW_SVC_AUDIO), BT_GATT_CCC_NOTIFY) ||
+           bt_gatt_is_subscribed(conn, metabow_svc_attr(METABOW_SVC_IMU), BT_GATT_CCC_NOTIFY);
+}
+
+/**
+ * @brief Value attribute of a stream's characteristic, for notifying it
+ */
+const struct bt_gatt_attr *metabow_svc_attr(enum metabow_svc_stream stream)
+{
+    return &metabow_svc.attrs[METABOW_SVC_VALUE_ATTR(stream)];
+}
+
+/**
+ * @brief Set the value returned by a battery read
+ * @param soc State of charge [%]
+ */
+void metabow_svc_set_battery(float soc)
+{
+    battery_soc = soc;
+}
@@ -0,0 +1,48 @@
+#ifndef METABOW_SVC_H
+#define METABOW_SVC_H
+
+#include <stdbool.h>
+#include <zephyr/bluetooth/gatt.h>
+
+/*
+ * MetaBow GATT service (CONFIG_METABOW_SERVICE).
+ *
+ * One characteristic per stream, each with its own CCC, for hosts that
+ * only want part of what the NUS stream carries. The writer thread only
+ * encodes the streams with a subscriber, once for all hosts (fanout.h), and
+ * sends no NUS stream to a host with audio or IMU subscribed. Values are
+ * little endian:
+ *
+ *   audio    notify        u32 timestamp of the first sample [us], i16 PCM;
+ *                          a block longer than the MTU allows is split
+ *   imu      notify        v2 frame sections (frame.h) without frame
+ *                          header and CRC: the IMU section, then the YPR
+ *                          section when built in
+ *   events   notify        unsolicited lines (control.h) without line ending
+ *   battery  read, notify  f32 battery state of charge [%]
+ *   control  write, notify commands as on NUS RX; replies are notified
+ *
+ * Notifications longer than the ATT MTU allows are refused by the stack
+ * and counted as failed (flow.h); hosts should exchange a large MTU.
+ */
+
+// 6d620000-6d65-7461-626f-770000000000, "mbmetabow"
+#define BT_UUID_METABOW_VAL(n) BT_UUID_128_ENCODE(0x6d620000 + (n), 0x6d65, 0x7461, 0x626f, 0x770000000000)
+#define BT_UUID_METABOW_SERVICE BT_UUID_DECLARE_128(BT_UUID_METABOW_VAL(0))
+
+enum metabow_svc_stream {
+    METABOW_SVC_AUDIO,
+    METABOW_SVC_IMU,
+    METABOW_SVC_EVENTS,
+    METABOW_SVC_BATTERY,
+    METABOW_SVC_CONTROL,
+    METABOW_SVC_COUNT
+};
+
+// Function prototypes
+bool metabow_svc_subscribed(enum metabow_svc_stream stream);
+bool metabow_svc_streaming(struct bt_conn *conn);
+const struct bt_gatt_attr *metabow_svc_attr(enum metabow_svc_stream stream);
+void metabow_svc_set_battery(float soc);
+
+#endif /* METABOW_SVC_H */
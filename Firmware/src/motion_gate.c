@@ -0,0 +1,148 @@
+#include "motion_gate.h"
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(motion_gate, LOG_LEVEL_INF);
+
+#define GATE_EVT_STREAMING BIT(0)
+
+static K_EVENT_DEFINE(gate_events);
+static struct k_spinlock gate_lock;
+
+static enum motion_gate_state gate_state = MOTION_GATE_STREAMING;
+static int64_t state_since_ms;
+static int64_t still_since_ms = -1;
+static uint64_t state_total_ms[MOTION_GATE_STATE_COUNT];
+
+// Time of the wake report, 0 once the first audio block after it is read
+static uint64_t wake_us;
+static uint32_t wake_count;
+static uint32_t resume_max_us;
+
+static const char *const state_names[MOTION_GATE_STATE_COUNT] = {
+    [MOTION_GATE_STREAMING] = "streaming",
+    [MOTION_GATE_IDLE] = "idle",
+};
+
+/**
+ * @brief Whether a stability state counts as put down
+ */
+static inline bool is_still(enum bno08x_stability stability)
+{
+    return (stability == BNO08X_STABILITY_ON_TABLE) || (stability == BNO08X_STABILITY_STABLE);
+}
+
+/**
+ * @brief Feed the latest stability state from the hub
+ *
+ * Called by the IMU thread after every fetch. Holding the bow still in the
+ * hand (stationary) keeps it streaming; only lying on a surface closes the
+ * gate.
+ *
+ * @param stability Value of SENSOR_CHAN_STABILITY
+ */
+void motion_gate_update(enum bno08x_stability stability)
+{
+    int64_t now_ms = k_uptime_get();
+    enum motion_gate_state from, to;
+    uint32_t held_ms;
+    k_spinlock_key_t key;
+
+    if (!IS_ENABLED(CONFIG_METABOW_MOTION_GATE)) {
+        return;
+    }
+
+    key = k_spin_lock(&gate_lock);
+    from = gate_state;
+    to = from;
+
+    if (from == MOTION_GATE_STREAMING) {
+        if (!is_still(stability)) {
+            still_since_ms = -1;
+        } else if (still_since_ms < 0) {
+            still_since_ms = now_ms;
+        } else if (now_ms - still_since_ms >= CONFIG_METABOW_MOTION_GATE_IDLE_DELAY_MS) {
+            to = MOTION_GATE_IDLE;
+        }
+    } else if (stability == BNO08X_STABILITY_MOTION) {
+        to = MOTION_GATE_STREAMING;
+        still_since_ms = -1;
+        wake_us = k_ticks_to_us_floor64(k_uptime_ticks());
+        wake_count++;
+    }
+
+    if (to == from) {
+        k_spin_unlock(&gate_lock, key);
+        return;
+    }
+
+    held_ms = (uint32_t)(now_ms - state_since_ms);
+    state_total_ms[from] += held_ms;
+    state_since_ms = now_ms;
+    gate_state = to;
+
+    if (to == MOTION_GATE_STREAMING) {
+        k_event_post(&gate_events, GATE_EVT_STREAMING);
+    } else {
+        k_event_set(&gate_events, 0);
+    }
+    k_spin_unlock(&gate_lock, key);
+
+    LOG_INF("%s -> %s after %u ms (streaming %llu ms, idle %llu ms total)",
+            state_names[from], state_names[to], held_ms,
+            state_total_ms[MOTION_GATE_STREAMING], state_total_ms[MOTION_GATE_IDLE]);
+}
+
+/**
+ * @brief Check whether audio and IMU data should be streamed
+ * @return true unless the gate is idle
+ */
+bool motion_gate_is_streaming(void)
+{
+    return gate_state == MOTION_GATE_STREAMING;
+}
+
+/**
+ * @brief Wait until the gate opens
+ * @param timeout How long to wait
+ * @return 0 once streaming, -EAGAIN on timeout
+ */
+int motion_gate_wait_streaming(k_timeout_t timeout)
+{
+    if (motion_gate_is_streaming()) {
+        return 0;
+    }
+
+    if (k_event_wait(&gate_events, GATE_EVT_STREAMING, false, timeout) == 0) {
+        return -EAGAIN;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Report that streaming has resumed
+ *
+ * Called with the first audio block read after the gate opens; completes
+ * the resume latency measurement for the last wake.
+ */
+void motion_gate_resumed(void)
+{
+    uint64_t now_us = k_ticks_to_us_floor64(k_uptime_ticks());
+    k_spinlock_key_t key = k_spin_lock(&gate_lock);
+    uint32_t latency_us;
+    uint32_t wakes;
+
+    if (wake_us == 0) {
+        k_spin_unlock(&gate_lock, key);
+        return;
+    }
+
+    latency_us = (uint32_t)(now_us - wake_us);
+    wake_us = 0;
+    resume_max_us = MAX(resume_max_us, latency_us);
+    wakes = wake_count;
+    k_spin_unlock(&gate_lock, key);
+
+    LOG_INF("Resume latency %u us (max %u us over %u wakes)", latency_us, resume_max_us, wakes);
+}
+
@@ -0,0 +1,33 @@
+#ifndef MOTION_GATE_H
+#define MOTION_GATE_H
+
+#include <zephyr/kernel.h>
+#include <drivers/sensor/bno08x.h>
+
+/*
+ * Motion-gated streaming.
+ *
+ * The IMU thread feeds the hub's stability state in. Once the bow has been
+ * lying still (on table or stable) for CONFIG_METABOW_MOTION_GATE_IDLE_DELAY_MS
+ * the gate closes: audio capture stops, the hub drops to its motion
+ * detectors and only a heartbeat packet is sent. The first motion report
+ * opens the gate again.
+ *
+ * Time spent in each state and the resume latency, from the wake report to
+ * the first audio block after it, are tracked so power traces taken with an
+ * external meter can be lined up with the states.
+ */
+
+enum motion_gate_state {
+    MOTION_GATE_STREAMING,
+    MOTION_GATE_IDLE,
+    MOTION_GATE_STATE_COUNT
+};
+
+// Function prototypes
+void motion_gate_update(enum bno08x_stability stability);
+bool motion_gate_is_streaming(void);
+int motion_gate_wait_streaming(k_timeout_t timeout);
+void motion_gate_resumed(void);
+
+#endif /* MOTION_GATE_H */
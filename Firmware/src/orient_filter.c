@@ -0,0 +1,285 @@
+#include "orient_filter.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#ifdef CONFIG_METABOW_FILTER_BENCHMARK
+#include <zephyr/timing/timing.h>
+#endif
+
+LOG_MODULE_REGISTER(orient_filter, LOG_LEVEL_INF);
+
+#define Q30_ONE             (1 << 30)
+
+// 2^50 / 1e6: microseconds to Q30 seconds after a 20 bit shift
+#define US_TO_Q30_MUL       1125899907ULL
+
+struct filter_state {
+    int32_t q[4];           // w, x, y, z in Q30
+    int32_t integral[3];    // Integral feedback (gyro bias estimate), Q24 rad/s
+    uint64_t last_us;
+    bool started;
+};
+
+static struct filter_state state;
+
+/**
+ * @brief Multiply two Q30 values
+ */
+static inline int32_t q30_mul(int32_t a, int32_t b)
+{
+    return (int32_t)(((int64_t)a * b) >> 30);
+}
+
+/**
+ * @brief Integer square root
+ */
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t res = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > v) {
+        bit >>= 2;
+    }
+
+    while (bit != 0) {
+        if (v >= res + bit) {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t)res;
+}
+
+/**
+ * @brief Normalize a raw sensor vector to Q30
+ * @return false if the vector is zero
+ */
+static bool normalize_counts(const int16_t in[3], int32_t out[3])
+{
+    uint64_t sq = (int64_t)in[0] * in[0] + (int64_t)in[1] * in[1] + (int64_t)in[2] * in[2];
+    uint32_t norm = isqrt64(sq);
+    int64_t recip;
+
+    if (norm == 0) {
+        return false;
+    }
+
+    // Q46 reciprocal keeps in * recip within 2^46 since |in| <= norm
+    recip = (1LL << 46) / norm;
+    for (int i = 0; i < 3; i++) {
+        out[i] = (int32_t)((in[i] * recip) >> 16);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Cross product of two Q30 vectors, accumulated into acc
+ */
+static void cross_add(const int32_t a[3], const int32_t b[3], int32_t acc[3])
+{
+    acc[0] += (int32_t)(((int64_t)a[1] * b[2] - (int64_t)a[2] * b[1]) >> 30);
+    acc[1] += (int32_t)(((int64_t)a[2] * b[0] - (int64_t)a[0] * b[2]) >> 30);
+    acc[2] += (int32_t)(((int64_t)a[0] * b[1] - (int64_t)a[1] * b[0]) >> 30);
+}
+
+/**
+ * @brief Rescale the quaternion to unit length
+ */
+static void normalize_quat(int32_t q[4])
+{
+    uint64_t sq = 0;
+    uint32_t norm;
+    int32_t recip;
+
+    for (int i = 0; i < 4; i++) {
+        sq += (int64_t)q[i] * q[i];
+    }
+
+    norm = isqrt64(sq);
+    if (norm == 0) {
+        q[0] = Q30_ONE;
+        q[1] = q[2] = q[3] = 0;
+        return;
+    }
+
+    recip = (int32_t)((1LL << 60) / norm);
+    for (int i = 0; i < 4; i++) {
+        q[i] = q30_mul(q[i], recip);
+    }
+}
+
+/**
+ * @brief Reset the filter to the identity orientation
+ */
+void orient_filter_init(void)
+{
+    state = (struct filter_state){
+        .q = {Q30_ONE, 0, 0, 0},
+    };
+}
+
+/**
+ * @brief Advance the filter by one raw sample
+ *
+ * Samples must be passed in time order. The first sample after init, or
+ * after a gap longer than ORIENT_FILTER_MAX_DT_US, only sets the time base.
+ *
+ * @param gyro Raw gyroscope counts
+ * @param accel Raw accelerometer counts, any scale
+ * @param magn Raw magnetometer counts, any scale; all zero if not available
+ * @param timestamp_us Sample time in microseconds
+ */
+void orient_filter_update(const int16_t gyro[3], const int16_t accel[3],
+                          const int16_t magn[3], uint64_t timestamp_us)
+{
+    int32_t *q = state.q;
+    int32_t a[3], m[3];
+    int32_t err[3] = {0, 0, 0};
+    int32_t rate[3];
+    int32_t r[3][3];
+    int64_t dt_q30, half_dt_q30;
+    uint64_t dt_us = timestamp_us - state.last_us;
+    bool have_accel, have_magn;
+
+    if (!state.started || timestamp_us <= state.last_us || dt_us > ORIENT_FILTER_MAX_DT_US) {
+        state.last_us = timestamp_us;
+        state.started = true;
+        return;
+    }
+    state.last_us = timestamp_us;
+
+    dt_q30 = (int64_t)((dt_us * US_TO_Q30_MUL) >> 20);
+    half_dt_q30 = dt_q30 >> 1;
+
+    // Body to earth rotation matrix
+    int32_t wx = q30_mul(q[0], q[1]), wy = q30_mul(q[0], q[2]);
+    int32_t wz = q30_mul(q[0], q[3]);
+    int32_t xx = q30_mul(q[1], q[1]), xy = q30_mul(q[1], q[2]);
+    int32_t xz = q30_mul(q[1], q[3]), yy = q30_mul(q[2], q[2]);
+    int32_t yz = q30_mul(q[2], q[3]), zz = q30_mul(q[3], q[3]);
+
+    r[0][0] = (int32_t)(Q30_ONE - 2 * ((int64_t)yy + zz));
+    r[0][1] = (int32_t)(2 * ((int64_t)xy - wz));
+    r[0][2] = (int32_t)(2 * ((int64_t)xz + wy));
+    r[1][0] = (int32_t)(2 * ((int64_t)xy + wz));
+    r[1][1] = (int32_t)(Q30_ONE - 2 * ((int64_t)xx + zz));
+    r[1][2] = (int32_t)(2 * ((int64_t)yz - wx));
+    r[2][0] = (int32_t)(2 * ((int64_t)xz - wy));
+    r[2][1] = (int32_t)(2 * ((int64_t)yz + wx));
+    r[2][2] = (int32_t)(Q30_ONE - 2 * ((int64_t)xx + yy));
+
+    have_accel = normalize_counts(accel, a);
+    have_magn = have_accel && normalize_counts(magn, m);
+
+    if (have_accel) {
+        // Estimated direction of gravity in the body frame is the third row
+        cross_add(a, r[2], err);
+    }
+
+    if (have_magn) {
+        int64_t h[3];
+        int32_t b_x, b_z, w[3];
+
+        // Field in the earth frame, flattened onto the x-z plane
+        for (int i = 0; i < 3; i++) {
+            h[i] = ((int64_t)r[i][0] * m[0] + (int64_t)r[i][1] * m[1] +
+                    (int64_t)r[i][2] * m[2]) >> 30;
+        }
+        b_x = (int32_t)isqrt64((uint64_t)(h[0] * h[0] + h[1] * h[1]));
+        b_z = (int32_t)h[2];
+
+        // Expected field direction back in the body frame
+        for (int i = 0; i < 3; i++) {
+            w[i] = (int32_t)(((int64_t)b_x * r[0][i] + (int64_t)b_z * r[2][i]) >> 30);
+        }
+        cross_add(m, w, err);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        // Q16 gain times Q30 error gives Q46, down to Q24 rad/s
+        int64_t p = ((int64_t)ORIENT_FILTER_KP_Q16 * err[i]) >> 22;
+        int64_t k = ((int64_t)ORIENT_FILTER_KI_Q16 * err[i]) >> 22;
+
+        state.integral[i] += (int32_t)((k * dt_q30) >> 30);
+        rate[i] = gyro[i] * ORIENT_FILTER_GYRO_RAD_PER_LSB_Q24 + state.integral[i] + (int32_t)p;
+
+        // Half-step rotation angle in Q30
+        rate[i] = (int32_t)(((int64_t)rate[i] * half_dt_q30) >> 24);
+    }
+
+    int32_t q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+    q[0] -= q30_mul(q1, rate[0]) + q30_mul(q2, rate[1]) + q30_mul(q3, rate[2]);
+    q[1] += q30_mul(q0, rate[0]) + q30_mul(q2, rate[2]) - q30_mul(q3, rate[1]);
+    q[2] += q30_mul(q0, rate[1]) - q30_mul(q1, rate[2]) + q30_mul(q3, rate[0]);
+    q[3] += q30_mul(q0, rate[2]) + q30_mul(q1, rate[1]) - q30_mul(q2, rate[0]);
+
+    normalize_quat(q);
+}
+
+/**
+ * @brief Get the current orientation
+ * @param quat Output quaternion in i, j, k, real order, as the hub reports it
+ */
+void orient_filter_get_quat(float quat[4])
+{
+    const float scale = 1.0f / Q30_ONE;
+
+    quat[0] = state.q[1] * scale;
+    quat[1] = state.q[2] * scale;
+    quat[2] = state.q[3] * scale;
+    quat[3] = state.q[0] * scale;
+}
+
+/**
+ * @brief Measure the cost of one filter update
+ *
+ * Runs the filter on a synthetic slowly rotating input and restores the
+ * previous filter state afterwards.
+ *
+ * @param iterations Number of updates to time
+ * @return Average nanoseconds per update, 0 if benchmarking is not built in
+ */
+uint32_t orient_filter_bench_ns(uint32_t iterations)
+{
+#ifdef CONFIG_METABOW_FILTER_BENCHMARK
+    struct filter_state saved = state;
+    const int16_t accel[3] = {120, -340, 4050};
+    const int16_t magn[3] = {310, -85, -410};
+    int16_t gyro[3];
+    timing_t start, end;
+    uint64_t ns;
+
+    if (iterations == 0) {
+        return 0;
+    }
+
+    orient_filter_init();
+    timing_init();
+    timing_start();
+
+    start = timing_counter_get();
+    for (uint32_t n = 0; n < iterations; n++) {
+        gyro[0] = (int16_t)(n & 0xFF);
+        gyro[1] = -(int16_t)(n & 0x7F);
+        gyro[2] = 200;
+        orient_filter_update(gyro, accel, magn, (uint64_t)n * 1000);
+    }
+    end = timing_counter_get();
+    ns = timing_cycles_to_ns(timing_cycles_get(&start, &end));
+
+    timing_stop();
+    state = saved;
+
+    return (uint32_t)(ns / iterations);
+#else
+    ARG_UNUSED(iterations);
+    return 0;
+#endif
+}
@@ -0,0 +1,35 @@
+#ifndef ORIENT_FILTER_H
+#define ORIENT_FILTER_H
+
+#include <zephyr/types.h>
+
+/*
+ * Fixed-point Mahony orientation filter for raw IMU samples.
+ *
+ * Runs on the BNO08x raw accelerometer, gyroscope and magnetometer reports
+ * when the hub's own fusion is switched off. The quaternion is kept in Q30
+ * and angular rates in Q24 rad/s; only the gyroscope scale matters, accel
+ * and magnetometer vectors are normalized before use. Without magnetometer
+ * samples the filter falls back to accel-only correction and yaw drifts.
+ */
+
+// Nominal raw gyroscope scale: +-2000 dps full scale, 16.4 LSB/dps,
+// (pi / 180) / 16.4 rad/s per LSB in Q24
+#define ORIENT_FILTER_GYRO_RAD_PER_LSB_Q24  17855
+#define ORIENT_FILTER_GYRO_RAD_PER_LSB      (0.0174532925f / 16.4f)
+
+// Proportional and integral feedback gains, Q16 (0.5 and 0.05)
+#define ORIENT_FILTER_KP_Q16                32768
+#define ORIENT_FILTER_KI_Q16                3277
+
+// Sample gaps longer than this restart integration instead of jumping
+#define ORIENT_FILTER_MAX_DT_US             100000
+
+// Function prototypes
+void orient_filter_init(void);
+void orient_filter_update(const int16_t gyro[3], const int16_t accel[3],
+                          const int16_t magn[3], uint64_t timestamp_us);
+void orient_filter_get_quat(float quat[4]);
+uint32_t orient_filter_bench_ns(uint32_t iterations);
+
+#endif /* ORIENT_FILTER_H */
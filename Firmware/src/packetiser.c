@@ -0,0 +1,144 @@
+#include "packetiser.h"
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(packetiser, LOG_LEVEL_INF);
+
+// Room for a held partial notification plus the largest frame
+#define PACKETISER_BUF_SIZE (2 * PACKETISER_MAX_PAYLOAD)
+// Notifications between efficiency log lines
+#define PACKETISER_STATS_INTERVAL 1024
+
+static K_MUTEX_DEFINE(packetiser_lock);
+static packetiser_send_t send_cb;
+
+static uint8_t buffer[PACKETISER_BUF_SIZE];
+static size_t pending;
+// Held bytes up to the end of the last urgent frame, 0 if none is held
+static size_t urgent_end;
+// Notification payload size at the last commit
+static size_t payload_size = PACKETISER_MAX_PAYLOAD;
+
+static uint32_t stat_notifications;
+static uint32_t stat_bytes;
+
+/**
+ * @brief Send one notification and account for it
+ */
+static void packetiser_send(const uint8_t *data, size_t len)
+{
+    send_cb(data, len, (size_t)(data - buffer) < urgent_end);
+
+    stat_notifications++;
+    stat_bytes += len;
+    if (stat_notifications == PACKETISER_STATS_INTERVAL) {
+        uint32_t per_notification = stat_bytes / stat_notifications;
+
+        LOG_INF("%u bytes per notification, %u%% of the %u byte payload",
+                per_notification, per_notification * 100 / payload_size, payload_size);
+        stat_notifications = 0;
+        stat_bytes = 0;
+    }
+}
+
+/**
+ * @brief Send every full notification, keep the remainder
+ */
+static void packetiser_drain(size_t len)
+{
+    size_t sent = 0;
+
+    while (pending - sent >= len) {
+        packetiser_send(buffer + sent, len);
+        sent += len;
+    }
+
+    if (sent > 0) {
+        pending -= sent;
+        memmove(buffer, buffer + sent, pending);
+        urgent_end = (urgent_end > sent) ? urgent_end - sent : 0;
+    }
+}
+
+/**
+ * @brief Set where notifications go
+ * @param send Called with each notification payload
+ */
+void packetiser_init(packetiser_send_t send)
+{
+    send_cb = send;
+}
+
+/**
+ * @brief Reserve room for a frame and lock the packetiser
+ *
+ * On success the caller writes the frame to the returned address and must
+ * call packetiser_commit(), also for an unused reservation.
+ *
+ * @param len Largest frame length, at most PACKETISER_MAX_PAYLOAD
+ * @return Where to build the frame, NULL if len is too long
+ */
+uint8_t *packetiser_reserve(size_t len)
+{
+    if (len > PACKETISER_MAX_PAYLOAD) {
+        return NULL;
+    }
+
+    // Less than one notification is ever held, so this always fits
+    k_mutex_lock(&packetiser_lock, K_FOREVER);
+    return buffer + pending;
+}
+
+/**
+ * @brief Add the frame written after packetiser_reserve() and unlock
+ * @param len Frame length, 0 to drop the reservation
+ * @param payload Notification payload size of the connection (ATT MTU - 3)
+ * @param urgent Whether the notifications carrying the frame must not be shed
+ */
+void packetiser_commit(size_t len, size_t payload, bool urgent)
+{
+    payload_size = CLAMP(payload, 1, PACKETISER_MAX_PAYLOAD);
+    pending += len;
+    if (urgent && len > 0) {
+        urgent_end = pending;
+    }
+    packetiser_drain(payload_size);
+
+    k_mutex_unlock(&packetiser_lock);
+}
+
+/**
+ * @brief Send the held partial notification
+ */
+void packetiser_flush(void)
+{
+    k_mutex_lock(&packetiser_lock, K_FOREVER);
+    if (pending > 0) {
+        packetiser_send(buffer, pending);
+        pending = 0;
+        urgent_end = 0;
+    }
+    k_mutex_unlock(&packetiser_lock);
+}
+
+/**
+ * @brief Whether a partial notification is held
+ */
+bool packetiser_pending(void)
+{
+    return pending > 0;
+}
+
+/**
+ * @brief Drop held data, for a new connection
+ */
+void packetiser_reset(void)
+{
+    k_mutex_lock(&packetiser_lock, K_FOREVER);
+    pending = 0;
+    urgent_end = 0;
+    stat_notifications = 0;
+    stat_bytes = 0;
+    k_mutex_unlock(&packetiser_lock);
+}
@@ -0,0 +1,36 @@
+#ifndef PACKETISER_H
+#define PACKETISER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+/*
+ * Notification packetiser for v2 frames (CONFIG_METABOW_FRAME_V2).
+ *
+ * Frames are built in place at the tail of one buffer and go out as
+ * notifications of the full ATT payload size, a frame continuing in the
+ * next notification where it does not fit. Only the unsent remainder, less
+ * than one notification, is moved back to the front. A partly filled
+ * notification is held until more frames arrive or packetiser_flush().
+ *
+ * packetiser_reserve() locks the packetiser until the matching
+ * packetiser_commit(), so any thread can add frames. The send callback is
+ * told which notifications carry an urgent frame (control replies and
+ * events), so it can wait for the link rather than shed them.
+ */
+
+// Largest ATT notification payload the stack can carry
+#define PACKETISER_MAX_PAYLOAD (CONFIG_BT_L2CAP_TX_MTU - 3)
+
+typedef void (*packetiser_send_t)(const uint8_t *data, size_t len, bool urgent);
+
+// Function prototypes
+void packetiser_init(packetiser_send_t send);
+uint8_t *packetiser_reserve(size_t len);
+void packetiser_commit(size_t len, size_t payload, bool urgent);
+void packetiser_flush(void);
+bool packetiser_pending(void);
+void packetiser_reset(void);
+
+#endif /* PACKETISER_H */
@@ -0,0 +1,202 @@
+#include "timebase.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(timebase, LOG_LEVEL_INF);
+
+static struct k_spinlock tb_lock;
+
+// 0 until timebase_init(), the timebase follows kernel uptime until then
+static uint32_t tb_sample_rate;
+static uint64_t tb_samples;          // Audio samples delivered so far
+static uint32_t tb_anchor_cyc;       // Cycle count at which tb_samples was reached
+static bool tb_anchored;
+
+// Measured rate of k_cycle_get_32() against the audio clock
+static float tb_cycles_per_us;
+static float tb_nominal_cycles_per_us;
+
+// Start of the current cycle-rate measurement window
+static uint32_t tb_window_cyc;
+static uint64_t tb_window_samples;
+
+/**
+ * @brief Convert an audio sample position to timebase microseconds
+ */
+static inline uint64_t samples_to_us(uint64_t samples)
+{
+    return samples * USEC_PER_SEC / tb_sample_rate;
+}
+
+/**
+ * @brief Current time in 64 bit timebase microseconds. Call with tb_lock held.
+ */
+static uint64_t now_us_locked(void)
+{
+    uint32_t elapsed_cyc;
+
+    if (tb_sample_rate == 0) {
+        return k_ticks_to_us_floor64(k_uptime_ticks());
+    }
+
+    elapsed_cyc = k_cycle_get_32() - tb_anchor_cyc;
+
+    return samples_to_us(tb_samples) + (uint64_t)(elapsed_cyc / tb_cycles_per_us);
+}
+
+/**
+ * @brief Re-estimate the cycle counter rate once a full window of audio has passed
+ */
+static void update_drift(void)
+{
+    uint64_t window_us;
+    float measured;
+
+    if (tb_samples - tb_window_samples < TIMEBASE_DRIFT_WINDOW_SAMPLES) {
+        return;
+    }
+
+    window_us = samples_to_us(tb_samples) - samples_to_us(tb_window_samples);
+    measured = (float)(tb_anchor_cyc - tb_window_cyc) / (float)window_us;
+    tb_cycles_per_us += (measured - tb_cycles_per_us) / (1 << TIMEBASE_DRIFT_SMOOTH_SHIFT);
+
+    tb_window_cyc = tb_anchor_cyc;
+    tb_window_samples = tb_samples;
+
+    LOG_DBG("Cycle counter drift vs audio: %d ppm", timebase_drift_ppm());
+}
+
+/**
+ * @brief Initialize the timebase
+ *
+ * The timebase carries on from the kernel uptime it followed until now, so
+ * timestamps taken before stay in order with later ones.
+ *
+ * @param sample_rate Audio sample rate in Hz; the master clock
+ */
+void timebase_init(uint32_t sample_rate)
+{
+    k_spinlock_key_t key = k_spin_lock(&tb_lock);
+
+    tb_samples = now_us_locked() * sample_rate / USEC_PER_SEC;
+    tb_sample_rate = sample_rate;
+    tb_anchor_cyc = k_cycle_get_32();
+    tb_anchored = false;
+    tb_nominal_cycles_per_us = (float)sys_clock_hw_cycles_per_sec() / USEC_PER_SEC;
+    tb_cycles_per_us = tb_nominal_cycles_per_us;
+
+    k_spin_unlock(&tb_lock, key);
+}
+
+/**
+ * @brief Account for an audio block that has just been read
+ *
+ * Must be called once per block, in stream order, as soon as the block is
+ * returned by the DMIC driver. Blocks can be read late but never early, so
+ * an early block pulls the anchor down at once while late ones only move it
+ * by a fraction of the difference.
+ *
+ * @param samples Number of samples in the block
+ * @return Timestamp of the first sample of the block
+ */
+uint32_t timebase_audio_block(uint32_t samples)
+{
+    k_spinlock_key_t key = k_spin_lock(&tb_lock);
+    uint32_t now_cyc = k_cycle_get_32();
+    uint64_t first = tb_samples;
+
+    tb_samples += samples;
+
+    if (!tb_anchored) {
+        tb_anchor_cyc = now_cyc;
+        tb_window_cyc = now_cyc;
+        tb_window_samples = tb_samples;
+        tb_anchored = true;
+    } else {
+        uint64_t block_us = samples_to_us(tb_samples) - samples_to_us(first);
+        uint32_t predicted = tb_anchor_cyc + (uint32_t)(block_us * tb_cycles_per_us);
+        int32_t late = (int32_t)(now_cyc - predicted);
+
+        if (late < 0) {
+            tb_anchor_cyc = now_cyc;
+        } else {
+            tb_anchor_cyc = predicted + (late >> TIMEBASE_ANCHOR_FOLLOW_SHIFT);
+        }
+
+        update_drift();
+    }
+
+    k_spin_unlock(&tb_lock, key);
+
+    return (uint32_t)samples_to_us(first);
+}
+
+/**
+ * @brief Prepare for audio restarting after a pause in capture
+ *
+ * Moves the sample position on by the time the stream was stopped, measured
+ * with the cycle counter, so timestamps stay monotonic across the gap. The
+ * first block after the restart re-anchors the cycle counter.
+ */
+void timebase_audio_restart(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&tb_lock);
+    uint64_t now = now_us_locked();
+
+    tb_samples = now * tb_sample_rate / USEC_PER_SEC;
+    tb_anchor_cyc = k_cycle_get_32();
+    tb_anchored = false;
+
+    k_spin_unlock(&tb_lock, key);
+}
+
+/**
+ * @brief Current time in the device timebase
+ * @return Timebase microseconds
+ */
+uint32_t timebase_now_us(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&tb_lock);
+    uint64_t now = now_us_locked();
+
+    k_spin_unlock(&tb_lock, key);
+
+    return (uint32_t)now;
+}
+
+/**
+ * @brief Convert a kernel uptime timestamp to the device timebase
+ *
+ * Intended for recent events (sensor samples); the conversion uses the age
+ * of the event, so the two clocks only need to agree over that interval.
+ *
+ * @param uptime_us Event time in kernel uptime microseconds
+ * @return Timebase microseconds
+ */
+uint32_t timebase_from_uptime_us(uint64_t uptime_us)
+{
+    k_spinlock_key_t key = k_spin_lock(&tb_lock);
+    uint64_t now_uptime_us = k_ticks_to_us_floor64(k_uptime_ticks());
+    uint64_t now = now_us_locked();
+
+    k_spin_unlock(&tb_lock, key);
+
+    if (uptime_us > now_uptime_us) {
+        uptime_us = now_uptime_us;
+    }
+
+    return (uint32_t)(now - (now_uptime_us - uptime_us));
+}
+
+/**
+ * @brief Estimated cycle counter rate error against the audio clock
+ * @return Drift in parts per million; positive means the cycle counter is fast
+ */
+int32_t timebase_drift_ppm(void)
+{
+    if (tb_sample_rate == 0) {
+        return 0;
+    }
+
+    return (int32_t)((tb_cycles_per_us / tb_nominal_cycles_per_us - 1.0f) * 1e6f);
+}
@@ -0,0 +1,38 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <zephyr/types.h>
+
+/*
+ * Device timebase shared by audio and IMU data.
+ *
+ * Time is counted in microseconds of audio: the PDM sample counter is the
+ * master clock, so audio sample n of the stream is at n * 1e6 / rate. Between
+ * audio blocks the time is interpolated with k_cycle_get_32(). The cycle
+ * counter runs from LFCLK, which is the internal RC oscillator on this board,
+ * so its rate relative to the audio clock is re-estimated continuously.
+ *
+ * Before timebase_init() the time is kernel uptime, and the audio stream
+ * starts where that left off.
+ *
+ * Timestamps are 32 bit and wrap after about 71 minutes.
+ */
+
+// Block arrival jitter rejection: the anchor follows late blocks by 1/N
+#define TIMEBASE_ANCHOR_FOLLOW_SHIFT    4
+
+// Audio samples between cycle-rate estimates (10 s at 16 kHz)
+#define TIMEBASE_DRIFT_WINDOW_SAMPLES   160000
+
+// Cycle-rate estimate smoothing: each new window moves it by 1/N
+#define TIMEBASE_DRIFT_SMOOTH_SHIFT     2
+
+// Function prototypes
+void timebase_init(uint32_t sample_rate);
+uint32_t timebase_audio_block(uint32_t samples);
+void timebase_audio_restart(void);
+uint32_t timebase_now_us(void);
+uint32_t timebase_from_uptime_us(uint64_t uptime_us);
+int32_t timebase_drift_ppm(void);
+
+#endif /* TIMEBASE_H */